@@ -47,6 +47,7 @@ ESP8266::ESP8266(PinName tx, PinName rx, PinName reset, int baud, int timeout) :
     
     _baud = baud;
     _timeout = timeout;
+    _raw = false;
     
     _serial.baud(_baud);
     
@@ -149,6 +150,24 @@ bool ESP8266::open(bool type, char* ip, int port, int id) {
           execute()))
         return false;
     
+    // Raw counterparts: cb(n) takes the next n bytes off the uart without
+    // the interpreter seeing them and answers '>' once they are sent,
+    // crb(n) writes the count and a newline, then the bytes
+    if (!(command("function cb(n) "
+                    "uart.on('data',n,function(d) "
+                      "uart.on('data');"
+                      "c:send(d);"
+                      "uart.write(0,'>') "
+                    "end,0) "
+                  "end;") &&
+          command("function crb(n) "
+                    "d=cm:sub(1,n);"
+                    "cm=cm:sub(n+1,-1);"
+                    "uart.write(0,#d..'\\n',d) "
+                  "end") &&
+          execute()))
+        return false;
+    
     // Convert port to a string    
     char port_buf[16];
     sprintf(port_buf, "%d", port);
@@ -189,14 +208,18 @@ bool ESP8266::close() {
 }
 
 bool ESP8266::send(const char *buffer, int len) {     
+    if (_raw)
+        return sendRaw(buffer, len);
+        
     for (int line = 0; line < len; line += ESP_MAX_LINE) {
         if (!command("cs('"))
             return false;
 
         for (int i = 0; i < ESP_MAX_LINE && line+i < len; i++) {
-            int a = buffer[line+i] / 100;
-            int b = (buffer[line+i] - a*100) / 10;
-            int c = (buffer[line+i] - a*100 - b*10);
+            int v = (unsigned char)buffer[line+i];
+            int a = v / 100;
+            int b = (v - a*100) / 10;
+            int c = (v - a*100 - b*10);
             
             if (serialputc('\\') < 0 ||
                 serialputc(a + '0') < 0 ||
@@ -213,6 +236,9 @@ bool ESP8266::send(const char *buffer, int len) {
 }
 
 bool ESP8266::recv(char *buffer, int *len) {
+    if (_raw)
+        return recvRaw(buffer, len);
+        
     char len_buf[16];
     sprintf(len_buf, "%d", *len);
     
@@ -249,6 +275,96 @@ bool ESP8266::recv(char *buffer, int *len) {
     return flush();
 }
 
+bool ESP8266::discard() {
+    return command("cm=''") && execute();
+}
+
+bool ESP8266::sendRaw(const char *buffer, int len) {
+    for (int chunk = 0; chunk < len; chunk += ESP_MAX_RAW) {
+        int n = std::min(len - chunk, ESP_MAX_RAW);
+        char len_buf[16];
+        sprintf(len_buf, "%d", n);
+        
+        // Once the prompt is back the ESP is waiting for the bytes
+        if (!(command("cb(") &&
+              command(len_buf) &&
+              command(")") &&
+              execute()))
+            return false;
+            
+        for (int i = 0; i < n; i++) {
+            if (serialputc(buffer[chunk+i]) < 0)
+                return false;
+        }
+        
+        // Wait for the '>' that follows c:send
+        if (!flush())
+            return false;
+    }
+    
+    return true;
+}
+
+bool ESP8266::recvRaw(char *buffer, int *len) {
+    char len_buf[16];
+    sprintf(len_buf, "%d", *len);
+    
+    if (!(command("crb(") &&
+          command(len_buf) &&
+          command(")") &&
+          command("\r\n") &&
+          discardEcho()))
+        return false;
+        
+    // Read in the count, then that many bytes as they are
+    int count = 0;
+    
+    while (true) {
+        int c = serialgetc();
+        
+        if (c == '\n')
+            break;
+        else if (c < '0' || c > '9')
+            return false;
+            
+        count = count*10 + (c - '0');
+    }
+    
+    if (count > *len)
+        return false;
+    
+    for (int i = 0; i < count; i++) {
+        int c = serialgetc();
+        
+        if (c < 0)
+            return false;
+            
+        buffer[i] = c;
+    }
+    
+    *len = count;
+    
+    // Flush to next prompt
+    return flush();
+}
+
+bool ESP8266::setRawMode(bool raw) {
+    if (raw) {
+        char ok_buf[5];
+        int ok_len = 5;
+        
+        // open() defined the helpers unless the Lua side rejected them
+        if (!(command("print(cb~=nil and crb~=nil)") && execute(ok_buf, &ok_len)))
+            return false;
+            
+        if (ok_len != 4 || memcmp(ok_buf, "true", 4) != 0)
+            return false;
+    }
+    
+    _raw = raw;
+    return true;
+}
+
 int ESP8266::putc(char c) {
     char buffer[1] = { c };
     
@@ -339,7 +455,8 @@ int ESP8266::serialgetc() {
 #ifdef ESP8266_ECHO
             printf("%c", c);
 #endif
-            return c;
+            // Raw payload bytes above 0x7f must not read as a timeout
+            return (unsigned char)c;
         }
             
         if (timer.read_ms() > _timeout)
@@ -353,7 +470,7 @@ int ESP8266::serialputc(char c) {
     
     while (true) {
         if (_serial.writeable())
-            return _serial.putc(c);
+            return _serial.putc((unsigned char)c);
             
         if (timer.read_ms() > _timeout)
             return -1;
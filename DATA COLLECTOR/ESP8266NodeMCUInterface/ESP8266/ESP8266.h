@@ -34,6 +34,7 @@
 #define ESP_TCP_TYPE 1
 #define ESP_UDP_TYPE 0 
 #define ESP_MAX_LINE 62
+#define ESP_MAX_RAW 255
 
 /**
  * The ESP8266 class
@@ -133,6 +134,28 @@ public:
     */
     bool recv(char *buffer, int *len);
     
+    /**
+    * Drop whatever has been received and not read yet, in one command
+    * however much it is
+    *
+    * @return true on success
+    */
+    bool discard();
+    
+    /**
+    * Choose how send and recv move payload bytes over the serial link
+    *
+    * By default every byte goes as a \ddd Lua escape, ESP_MAX_LINE bytes
+    * per command. In raw mode the count goes first and the ESP then takes
+    * or gives that many bytes as they are, up to ESP_MAX_RAW per command.
+    * Call after open(), which defines the Lua helpers for both.
+    *
+    * @param raw true for raw transfers
+    * @return false if raw mode was asked for but the helpers are missing;
+    *   transfers stay escaped then
+    */
+    bool setRawMode(bool raw);
+    
     /**
     * Check if wifi is writable
     *
@@ -175,7 +198,7 @@ private:
     /**
     * Read a character with timeout
     *
-    * @return the character read or -1 on timeout
+    * @return the character read as 0-255 or -1 on timeout
     */
     int serialgetc();
     
@@ -219,6 +242,12 @@ private:
     * @return true if successful
     */
     bool execute(char *resp_buffer = 0, int *resp_len = 0);
+    
+    /**
+    * send and recv in raw mode
+    */
+    bool sendRaw(const char *buffer, int len);
+    bool recvRaw(char *buffer, int *len);
 
 protected:
     BufferedSerial _serial;
@@ -232,6 +261,7 @@ protected:
     
     int _baud;
     int _timeout;
+    bool _raw;
 };
 
 #endif
\ No newline at end of file
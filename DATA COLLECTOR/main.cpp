@@ -17,23 +17,16 @@ BORROW ESP8266 MAC ADDRESS: 18-FE-34-0D-CB-40
 #include "mbed.h"
 #include "ESP8266.h"
 #include "AS3935.h"
+#include "strike_batch.h"
+#include "strike_clock.h"
+#include "strike_stream.h"
 
 #define LIGHTNINGDETECTORID 1
-
-//DECLARATIONS: STRUCTS
-// Struct to send over TCP
-struct DATA
-{
-    char detectorID;
-    char distanceKM;
-    unsigned long time;
-};
-
-union rawReceivedData
-{
-    struct DATA struc;
-    char dataString[sizeof(DATA)];
-};
+#define BATCHMAXAGEMS 1000                                                      //Send a batch at most this long after its first strike
+#define BATCHMAXIDLEMS 200                                                      //Send a batch once no strike has come for this long
+#define SYNCINTERVALMS 16000                                                    //Synchronize the clock this often
+#define SYNCTIMEOUTMS 1000                                                      //Give up on a sync reply after this long
+#define SYNCSTARTUP 4                                                           //Sync exchanges before the lightning detector is armed
 
 //using namespace std::chrono
 //DECLARATIONS: GLOBAL VARIABLES
@@ -42,7 +35,7 @@ DigitalOut led2(LED2);
 DigitalOut led4(LED4);                                                          //DEBUGGING: On-board LED used for debugging purposes
 char dataTEMP[8] = "5";                                                         //DEBUGGING: A buffer to store the incoming data
 Serial pc(USBTX, USBRX);                                                        //Set up the mbed USB port for debugging/monitoring
-Timer clocky;                                                                    //A clock used to log the time of each lightning strike
+Timer clocky;                                                                   //A clock used to log the time of each lightning strike, never stopped
 ESP8266 wifi(p28, p27, p26, 9600, 3000);                                        //The WiFi module
 AS3935 ld(p11, p12, p13, p14, "ld", 2000000);                                   //MOSI, MISO, SCK, CS, SPI bus freq (hz)
 InterruptIn as3935INT(p15);                                                     //Interrupt signal that is given by the AS3935 Lightning Detector
@@ -55,13 +48,20 @@ Timer timeoutTimer;
 unsigned int timeout;                                                           //A maximum time (in seconds) before timeout
 int county;                                                                     //A counter for timeouts in the ESP8266
 bool ended;                                                                     //A boolean letting us know when the ESP8266's role is terminated
-union rawReceivedData dataToSend;                                                  //A struct to send over TCP to the server
+StrikeBatcher batcher(LIGHTNINGDETECTORID, BATCHMAXAGEMS, BATCHMAXIDLEMS);      //Strikes waiting to be sent, packed into one frame (see strike_batch.h)
+uint8_t frame[STRIKE_STREAM_OVERHEAD + STRIKE_BATCH_MAX_SIZE];                  //A finished frame waiting for the main loop to send it, behind the stream header
+volatile size_t frameSize;                                                      //Bytes in the frame (header excluded), 0 once it has been sent
+volatile int droppedStrikes;                                                    //Strikes that came while both the batch and frame were full
+StrikeClock timebase;                                                           //Maps clocky onto the personal device's clock (see strike_clock.h)
+StrikeStreamParser<> replies;                                                   //Bytes from the personal device, cut into frames
+uint8_t syncSequence;                                                           //Sequence number of the last sync request
 
 
 //DECLARATIONS: FUNCTION PROTOTYPES
 void LightningDetected();                                                       //Interrupt routine to handle the event of lightning occurring
 void SetupTransmitter();                                                        //Sets up the WiFi card for transmitting
 void SetupLightningDetector();                                                  //Sets up the AS3935 lightning detector
+bool SyncClock();                                                               //Runs one clock sync exchange with the personal device
 void dev_recv();                                                                //DEBUGGING: Write out any errors that may occur within the WiFi module
 void pc_recv();                                                                 //DEBUGGING: Write out any errors that may occur within the WiFi module
 
@@ -75,16 +75,47 @@ int main()
     wait(0.5);                                                                  //Give it a little time to fully reset
     wifiRST = 1;                                                                //Raise the reset pin
     wait(1);                                                                    //Give it a second to re-initialize
+    clocky.start();                                                             //Start the clock
     //Set up the transmitter
     SetupTransmitter();
+    //Synchronize the clock before any strike is timed with it
+    for(int i = 0; i < SYNCSTARTUP; i++)
+    {
+        if(!SyncClock())
+        {
+            pc.printf("No sync reply\r\n");
+        }
+        wait(1);
+    }
+    uint32_t lastSync = clocky.read_ms();                                       //When the clock was last synchronized
     //Initialize the lightning detector
     SetupLightningDetector();
     pc.printf("Ready!\r\n");                                                    //DEBUGGING: Let the debugger know it's ready
-    clocky.start();                                                             //Start the clock
     while(1) 
     {
-        //Do nothing in the main thread
-        wait(1);
+        //Finish the batch once it is full, old or idle. The interrupt adds
+        // strikes to it, so keep it out while we do
+        {
+            CriticalSectionLock lock;
+            if(frameSize == 0 && batcher.due(timebase.to_common(clocky.read_ms())))
+            {
+                frameSize = batcher.flush(frame + STRIKE_STREAM_OVERHEAD);
+            }
+        }
+        //Send outside the lock: strikes keep going into the next batch meanwhile
+        if(frameSize > 0)
+        {
+            strike_stream_header(frame, frameSize);                             //Mark where the frame starts, so the receiver can find it
+            wifi.send((char *)frame, STRIKE_STREAM_OVERHEAD + frameSize);       //Send the data
+            frameSize = 0;
+        }
+        //Keep the clock synchronized; strikes go into the batch meanwhile
+        if((uint32_t)clocky.read_ms() - lastSync >= SYNCINTERVALMS)
+        {
+            SyncClock();
+            lastSync = clocky.read_ms();
+        }
+        wait_ms(10);
     }
 }
 
@@ -96,7 +127,7 @@ LIGHTNING DETECTED
 // interrupt in the event of lightning being detected
 void LightningDetected()
 {
-    clocky.stop();                                                              //Stop the clock to record the time
+    uint32_t localTime = clocky.read_ms();                                      //Record the time before anything else
     led1 = 1;                                                                   //DEBUGGING: Blink the LED
     char OriginInt;                                                             //DEBUGGING: Declare variable for obtaining the debug code
     wait_ms(2);
@@ -112,19 +143,87 @@ void LightningDetected()
     if (OriginInt == 8) 
     { // detection
         dataTEMP[0] = ld.lightningDistanceKm();                                 //Shove the distance into index 0
-        dataToSend.struc.distanceKM = dataTEMP[0];                              //Shove the distance into the struct
+        unsigned long energy = ld.getEnergy();                                  //Get the energy detected
         pc.printf("Lightning detection, distance=%dkm\r\n", dataTEMP[0]);       //DEBUGGING: Print out the distance
-        pc.printf("Energy %d\r\n", ld.getEnergy());                             //DEBUGGING: Get the energy detected
+        pc.printf("Energy %lu\r\n", energy);                                    //DEBUGGING: Print out the energy
         ld.clearStats();                                                        //Clear the contents and get 
+        //Queue the strike; the main loop sends it with the others in the batch
+        uint32_t strikeTime = timebase.to_common(localTime);                    //The time in milliseconds, on the personal device's clock
+        if(!batcher.add(strikeTime, dataTEMP[0], energy))
+        {
+            //Batch full: hand it to the main loop if it is free, else lose the strike
+            if(frameSize == 0)
+            {
+                frameSize = batcher.flush(frame + STRIKE_STREAM_OVERHEAD);
+                batcher.add(strikeTime, dataTEMP[0], energy);
+            }
+            else
+            {
+                droppedStrikes++;
+            }
+        }
     }
     dataTEMP[1] = (char)LIGHTNINGDETECTORID;                                    //Shove the detector's ID into index 1
-    dataToSend.struc.detectorID = (char)LIGHTNINGDETECTORID;                    //Shove thed etector's dsitance into the struct
-    dataToSend.struc.time = clocky.read();                                      //Shove the time in milliseconds into the struct
-    wifi.send((char *)dataToSend.dataString, sizeof(DATA));                     //Send the data
-    clocky.start();                                                             //Start the clock again
-    
-    //TODO: Send the struct
-    
+}
+
+/**************************
+SYNCHRONIZING THE CLOCK
+***************************/
+//Summary: This function will run one NTP-style exchange with the personal
+// device (see strike_clock.h): clear out old replies, send a request, wait
+// for the reply carrying the personal device's receive and send times, and
+// hand all four times to timebase. The reply is noticed when a check of the ESP8266 finds it, so
+// the time of the check that found it is taken as its arrival
+bool SyncClock()
+{
+    //Drop whatever is still waiting, late replies or ones meant for another
+    // collector: read first, 32 bytes a round trip, they would hold up the
+    // reply and make it look later than it came
+    if(!wifi.discard())
+    {
+        return false;
+    }
+    mbed::Span<const uint8_t> stale;
+    while(replies.next(&stale))
+    {
+    }
+    uint8_t request[STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REQUEST_SIZE];
+    strike_stream_header(request, STRIKE_SYNC_REQUEST_SIZE);
+    encode_strike_sync_request(LIGHTNINGDETECTORID, ++syncSequence, request + STRIKE_STREAM_OVERHEAD);
+    if(!wifi.send((char *)request, sizeof(request)))
+    {
+        return false;
+    }
+    uint32_t sent = clocky.read_ms();                                           //The prompt is back, so the ESP8266 has sent it
+    while((uint32_t)clocky.read_ms() - sent < SYNCTIMEOUTMS)
+    {
+        uint32_t checked = clocky.read_ms();
+        int waiting = wifi.readable();
+        if(waiting <= 0)
+        {
+            continue;
+        }
+        char bytes[32];
+        int count = waiting < (int)sizeof(bytes) ? waiting : (int)sizeof(bytes);
+        if(!wifi.recv(bytes, &count))
+        {
+            return false;
+        }
+        replies.push((const uint8_t *)bytes, count);
+        mbed::Span<const uint8_t> frame;
+        while(replies.next(&frame))
+        {
+            StrikeSyncReply reply;
+            if(decode_strike_sync_reply(frame.data(), frame.size(), &reply) == STRIKE_PACKET_OK &&
+               reply.detector_id == LIGHTNINGDETECTORID && reply.sequence == syncSequence)
+            {
+                //The interrupt reads timebase, so keep it out while it changes
+                CriticalSectionLock lock;
+                return timebase.add_exchange(sent, reply.receive_ms, reply.send_ms, checked);
+            }
+        }
+    }
+    return false;
 }
 
 /**************************
@@ -149,6 +248,11 @@ void SetupTransmitter()
         wait(2);
         pc.printf("Connecting to server...\r\n");
     }
+    //Send and receive bytes as they are instead of as \ddd escapes
+    if(!wifi.setRawMode(true))
+    {
+        pc.printf("Raw transfers not available, escaping instead\r\n");
+    }
 }
 
 /**************************
@@ -9,21 +9,12 @@ Description: The purpose of this program is to set up a single mbed device to
 
 #include "mbed.h"
 #include "uLCD_4DGL.h"
+#include "strike_batch.h"
+#include "strike_clock.h"
+#include "strike_stream.h"
 
-//DECLARATIONS: STRUCTS
-// Struct to receive over TCP
-struct DATA
-{
-    char detectorID;
-    char distanceKM;
-    unsigned long time;
-};
-
-union rawReceivedData
-{
-    struct DATA struc;
-    char dataString[sizeof(DATA)];
-};
+//Time for a sync reply's Lua line, sc:send('...') with 4 characters per byte, to go out to the ESP8266 at 9600 baud (ms)
+#define SYNCREPLYLINEMS ((9 + 4 * (STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE) + 4) * 10000 / 9600)
 
 //DECLARATIONS: GLOBAL VARIABLES
 PwmOut speaker(p22);                                                            //Speaker output (needs H-Bridge for sufficient volume)
@@ -44,12 +35,23 @@ Timer timeoutTimer;
 unsigned int timeout;                                                           //A maximum time (in seconds) before timeout
 int county;                                                                     //Count how many times XXXXXXXXXX
 bool ended;                                                                     //A boolean letting us know when the ESP8266's role is terminated
+StrikeStreamParser<512> parser;                                                 //Bytes from the ESP8266, cut into frames (see strike_stream.h); holds the ~0.3 s of 9600 baud input that arrives while a warning is written out
+Timer commonClock;                                                              //The timebase every collector synchronizes its clock to (see strike_clock.h)
+Timer beepTimer;                                                                //Time into the warning beeps, which play out while frames keep being handled
+bool beeping;                                                                   //Whether the warning beeps are playing
+StrikeEvent nearest;                                                            //The closest strike in the frames handled since the last warning
+int strikes;                                                                    //How many strikes those frames carried
 
 //DECLARATIONS: FUNCTION PROTOTYPES
 void SetupReceiver();                                                           //Sets up the receiver/server            
 void SendCMD();                                                                 //Sends command to the WiFi module
 void getreply();                                                                //Gathers data/replies from the WiFi module (for debugging)
 void dev_recv();                                                                //Handles what happens when the module spits out data for the mbed
+void HandleFrame(mbed::Span<const uint8_t> frame);                              //Notes the strikes in a received frame for the next warning
+void NoteStrike(const StrikeEvent &strike);                                     //Keeps the closest strike since the last warning
+void AnswerSync(mbed::Span<const uint8_t> frame);                               //Answers a collector's clock sync request
+void WarnUser();                                                                //Shows the closest new strike and starts the warning beeps
+void UpdateBeep();                                                              //Turns the speaker on and off as the warning beeps go
 void pc_recv();                                                                 //DEBUGGING: Handles what happens when we type in characters from the PC
 
 /*******************************************************************************
@@ -57,6 +59,7 @@ MAIN FUNCTION
 *******************************************************************************/
 int main() 
 {
+    commonClock.start();                                                        //Start the common clock
     wifi.baud(9600);                                                            //Set the baudrate to match the ESP8266
     wifiRST = 0;                                                                //Reset the ESP8266
     wait(0.5);                                                                  //Give it a little time to fully reset
@@ -65,13 +68,28 @@ int main()
     //Set up the receiver
     SetupReceiver();
     wifi.attach(&dev_recv, Serial::RxIrq);                                      //After setting up, attach the WiFi module to the appropriate interrupt routines
-    //Main loop (don't do anything)
+    //Main loop: handle frames as dev_recv completes them
+    int loops = 0;
     while(1) 
     {
-        //Do something lol
-        led2 = !led2;
-        wait(1);
-        //sleep(1);
+        mbed::Span<const uint8_t> frame;
+        while(parser.next(&frame))
+        {
+            HandleFrame(frame);
+        }
+        //Only once the frames are drained: writing the warning out takes a while
+        if(strikes > 0)
+        {
+            WarnUser();
+        }
+        UpdateBeep();
+        //Blink once a second to show we're alive
+        if(++loops == 100)
+        {
+            led2 = !led2;
+            loops = 0;
+        }
+        wait_ms(10);
     }
 }
 
@@ -139,19 +157,17 @@ void SetupReceiver()
     getreply();     //Get a reply
     pc.printf(buf); //Print the returned statement to the PC
     
-    strcpy(snd, "print(payload)\r\n");                                          //Print just the payload of the TCP packets
+    strcpy(snd, "sc=conn\r\n");                                                 //Remember who sent it, to send a sync reply back to
     SendCMD();      //Send written command to the ESP8266
     timeout=3;      //Set the timeout interval (in seconds)
     getreply();     //Get a reply
     pc.printf(buf); //Print the returned statement to the PC
     
-    /*
-    strcpy(snd, "conn:send(\"<h1>test</h1>\")\r\n");                            //DEBUG: Send some html to test the server functionality
+    strcpy(snd, "uart.write(0,payload)\r\n");                                   //Pass the payload of the TCP packets on as it is (print would add a newline and stop at a zero byte)
     SendCMD();      //Send written command to the ESP8266
     timeout=3;      //Set the timeout interval (in seconds)
     getreply();     //Get a reply
     pc.printf(buf); //Print the returned statement to the PC
-    */
     
     strcpy(snd, "end)\r\n");                                                    //End function
     SendCMD();      //Send written command to the ESP8266
@@ -206,44 +222,155 @@ void getreply()
 Receiving ESP8266 Data
 ***************************/
 //Summary: This function will emplace any characters received by the
-// ESP8266 module to the PC terminal. Essentially, this will place all
-// incoming network traffic into the appropriate variables
+// ESP8266 module into the frame parser. Bytes can come in pieces of any
+// size, so the main loop picks out whole frames once they are there
 void dev_recv()
 {
-    //Make the speaker make a warning sound
-    speaker.period(1.0/500.0);                                                  // 500hz period
-    //Make it beep 3 times
-    for(int i = 0; i < 3; i++)
+    while(wifi.readable())
     {
-        speaker =0.5;                                                           //50% duty cycle - max volume
-        wait(0.1);
-        speaker=0.0;                                                            //Turn off audio
-        wait(0.1);
+        parser.push(wifi.getc());
     }
-    //Each packet should only contain 4 char's
-    union rawReceivedData receivedPacket;
-    for(int dataCounter = 0; dataCounter < sizeof(DATA); dataCounter++)
+}
+
+/**************************
+Handling A Frame
+***************************/
+//Summary: This function will note the strikes in one frame for the next
+// warning; the main loop shows them once the parser is drained, so nothing
+// slow runs while frames wait. The frame still sits in the parser's buffer;
+// nothing is copied out
+void HandleFrame(mbed::Span<const uint8_t> frame)
+{
+    //Sync requests are answered right away and don't beep
+    if(frame[0] == STRIKE_SYNC_REQUEST_VERSION)
+    {
+        AnswerSync(frame);
+        return;
+    }
+    //Collectors send batches; single-strike packets are still understood
+    StrikeEvent strike;
+    StrikePacketStatus status;
+    if(frame[0] == STRIKE_PACKET_VERSION)
     {
-        if(wifi.readable())
+        status = decode_strike_packet(frame.data(), frame.size(), &strike);
+        if(status == STRIKE_PACKET_OK)
         {
-            receivedPacket.dataString[dataCounter] = wifi.getc();
+            NoteStrike(strike);
         }
-        else
+    }
+    else
+    {
+        //The strikes are read straight out of the frame
+        StrikeBatchView batch;
+        status = decode_strike_batch(frame.data(), frame.size(), &batch);
+        if(status == STRIKE_PACKET_OK)
         {
-            break;
+            StrikeBatchReader reader(batch);
+            while(reader.next(&strike))
+            {
+                NoteStrike(strike);
+            }
         }
     }
-    pc.printf("Message from #%d:\n", (int)receivedPacket.struc.detectorID);
-    pc.printf("WARNING! Lightning detected at %dcm!\r\n", (int)receivedPacket.struc.distanceKM);
-    pc.printf("Finished!\r\n");
+    if(status != STRIKE_PACKET_OK)
+    {
+        //From another firmware version or malformed: don't trust any of it
+        pc.printf("Dropped packet (%d bytes, status %d)\r\n", (int)frame.size(), (int)status);
+    }
+}
+
+/**************************
+Answering A Sync Request
+***************************/
+//Summary: This function will send a collector the time its request came in
+// and the time the reply goes out, both on commonClock. The reply is one Lua
+// line of fixed length, so the time its last character leaves for the
+// ESP8266 is known before it is sent. If two collectors' frames come in at
+// once, sc may be the other one; the collector drops replies that don't
+// carry its id and sequence
+void AnswerSync(mbed::Span<const uint8_t> frame)
+{
+    uint32_t received = commonClock.read_ms();                                  //Time the main loop took the request from the parser
+    StrikeSyncReply reply;
+    if(decode_strike_sync_request(frame.data(), frame.size(), &reply.detector_id, &reply.sequence) != STRIKE_PACKET_OK)
+    {
+        pc.printf("Dropped sync request (%d bytes)\r\n", (int)frame.size());
+        return;
+    }
+    reply.receive_ms = received;
+    reply.send_ms = commonClock.read_ms() + SYNCREPLYLINEMS;
+    uint8_t bytes[STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE];
+    strike_stream_header(bytes, STRIKE_SYNC_REPLY_SIZE);
+    encode_strike_sync_reply(reply, bytes + STRIKE_STREAM_OVERHEAD);
+    //Same escapes as ESP8266::send on the collectors
+    char *p = snd + sprintf(snd, "sc:send('");
+    for(int i = 0; i < (int)sizeof(bytes); i++)
+    {
+        p += sprintf(p, "\\%03d", bytes[i]);
+    }
+    strcpy(p, "')\r\n");
+    SendCMD();                                                                  //The echo and prompt go to the parser, which skips them
+}
+
+/**************************
+Noting A Strike
+***************************/
+//Summary: This function will keep the closest of the strikes received since
+// the last warning
+void NoteStrike(const StrikeEvent &strike)
+{
+    if(strikes == 0 || strike.distance_km < nearest.distance_km)
+    {
+        nearest = strike;
+    }
+    strikes++;
+}
+
+/**************************
+Warning The User
+***************************/
+//Summary: This function will write the closest new strike out to the PC
+// terminal, the uLCD and the bluetooth module, once for all the frames the
+// main loop just drained, and start the warning beeps
+void WarnUser()
+{
+    pc.printf("Message from #%d (packet %d, %lu ms), %d strikes:\n", (int)nearest.detector_id, (int)nearest.sequence, (unsigned long)nearest.time_ms, strikes);
+    pc.printf("WARNING! Lightning detected at %dkm (energy %lu)!\r\n", (int)nearest.distance_km, (unsigned long)nearest.energy);
     //Write out to the uLCD
     uLCD.cls();
-    uLCD.printf("Message from #%d:\n", (int)receivedPacket.struc.detectorID);
-    uLCD.printf("WARNING! Lightning detected at %dcm!\r\n", (int)receivedPacket.struc.distanceKM);
+    uLCD.printf("Message from #%d:\n", (int)nearest.detector_id);
+    uLCD.printf("WARNING! Lightning detected at %dkm!\r\n", (int)nearest.distance_km);
     //Write out to the bluetooth module        
-    bluetooth.printf("Message from #%d:\n", (int)receivedPacket.struc.detectorID);
-    bluetooth.printf("WARNING! Lightning detected at %dcm!\r\n", (int)receivedPacket.struc.distanceKM);
-    
+    bluetooth.printf("Message from #%d:\n", (int)nearest.detector_id);
+    bluetooth.printf("WARNING! Lightning detected at %dkm!\r\n", (int)nearest.distance_km);
+    strikes = 0;
+    //Make the speaker make a warning sound; UpdateBeep plays it out
+    speaker.period(1.0/500.0);                                                  // 500hz period
+    beepTimer.reset();
+    beepTimer.start();
+    beeping = true;
+}
+
+/**************************
+Playing The Warning Beeps
+***************************/
+//Summary: This function will beep 3 times, 0.1 s on and 0.1 s off, called
+// from the main loop every 10 ms instead of waiting out each beep
+void UpdateBeep()
+{
+    if(!beeping)
+    {
+        return;
+    }
+    int ms = beepTimer.read_ms();
+    if(ms >= 600)
+    {
+        speaker = 0.0;                                                          //Turn off audio
+        beepTimer.stop();
+        beeping = false;
+        return;
+    }
+    speaker = (ms / 100) % 2 == 0 ? 0.5 : 0.0;                                  //50% duty cycle - max volume
 }
 
 /**************************
@@ -1,9 +1,21 @@
+import binascii
 import socket
 import struct
 TCP_IP = '192.168.0.40' 
 TCP_PORT = 80      
 BUFFER_SIZE = 1024
-MESSAGE = b'\x05\x00\x00\x00'
+
+def strike_packet(detector_id, sequence, distance_km, time_ms):
+    # Version 1 of strike-packet/strike_packet.h: little-endian fields, then
+    # CRC-16/CCITT-FALSE of them (crc_hqx with seed 0xFFFF is the same CRC)
+    body = struct.pack('<BBBBI', 1, detector_id, sequence, distance_km, time_ms)
+    return body + struct.pack('<H', binascii.crc_hqx(body, 0xFFFF))
+
+def stream_frame(frame):
+    # Sync byte and frame size in front, see strike-packet/strike_stream.h
+    return bytes([0x7E, len(frame)]) + frame
+
+MESSAGE = stream_frame(strike_packet(2, 7, 14, 123456789))
 s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 s.connect((TCP_IP, TCP_PORT))
 s.send(MESSAGE)
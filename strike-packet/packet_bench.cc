@@ -0,0 +1,938 @@
+// Round-trip checks and throughput of the strike packet and batch codecs
+// and of the stream parser, a simulation of the collector's link with and
+// without batching and with escaped or raw ESP8266 transfers, and of clock
+// sync under link jitter
+//
+//   g++ -O2 -std=c++14 -isystem "../PERSONAL DEVICE/mbed" packet_bench.cc mbed_crc_host.cpp -o packet_bench
+//   ./packet_bench
+//
+// Exits non-zero if any check fails. The reference frame is what
+// personal_device_test_script_python/send_test_data.py sends.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "strike_batch.h"
+#include "strike_clock.h"
+#include "strike_packet.h"
+#include "strike_stream.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+unsigned next_random(unsigned *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+StrikeEvent random_event(unsigned *seed)
+{
+    StrikeEvent e;
+    e.detector_id = (uint8_t)next_random(seed);
+    e.sequence = (uint8_t)next_random(seed);
+    e.distance_km = (uint8_t)next_random(seed);
+    e.time_ms = (uint32_t)next_random(seed) << 16 ^ (uint32_t)next_random(seed);
+    e.energy = 0;
+    return e;
+}
+
+bool same_event(const StrikeEvent &a, const StrikeEvent &b)
+{
+    return a.detector_id == b.detector_id && a.sequence == b.sequence &&
+           a.distance_km == b.distance_km && a.time_ms == b.time_ms;
+}
+
+void check_reference()
+{
+    const uint8_t digits[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    check(strike_packet_crc(digits, sizeof(digits)) == 0x29B1, "CRC-16/CCITT-FALSE check value");
+
+    // Detector 2, sequence 7, 14 km at 123456789 ms
+    const uint8_t expected[STRIKE_PACKET_SIZE] = {0x01, 0x02, 0x07, 0x0E, 0x15, 0xCD, 0x5B, 0x07, 0x01, 0x70};
+    StrikeEvent event = {2, 7, 14, 123456789, 0};
+    uint8_t frame[STRIKE_PACKET_SIZE];
+    check(encode_strike_packet(event, frame) == STRIKE_PACKET_SIZE, "encoded size");
+    check(memcmp(frame, expected, sizeof(frame)) == 0, "reference frame bytes");
+}
+
+void check_round_trip()
+{
+    std::vector<StrikeEvent> events;
+    StrikeEvent low = {0, 0, 0, 0, 0}, high = {255, 255, 255, 0xFFFFFFFFu, 0};
+    events.push_back(low);
+    events.push_back(high);
+    unsigned seed = 1;
+    for (int k = 0; k < 100000; k++) {
+        events.push_back(random_event(&seed));
+    }
+
+    int round_trips = 0, short_rejected = 0, truncations = 0;
+    for (const StrikeEvent &e : events) {
+        uint8_t frame[STRIKE_PACKET_SIZE];
+        encode_strike_packet(e, frame);
+        StrikeEvent back = {0, 0, 0, 0, 0};
+        round_trips += decode_strike_packet(frame, sizeof(frame), &back) == STRIKE_PACKET_OK && same_event(e, back);
+        for (size_t size = 0; size < STRIKE_PACKET_SIZE; size++, truncations++) {
+            short_rejected += decode_strike_packet(frame, size, &back) == STRIKE_PACKET_SHORT;
+        }
+    }
+    check(round_trips == (int)events.size(), "round trip");
+    check(short_rejected == truncations, "truncated frames rejected");
+    printf("round trip %d/%zu, truncated frames rejected %d/%d\n",
+           round_trips, events.size(), short_rejected, truncations);
+}
+
+// A 16-bit CRC over 8 bytes catches every error of one or two bits
+void check_corruption()
+{
+    unsigned seed = 2;
+    int corrupted = 0, rejected = 0, version_flagged = 0;
+    for (int k = 0; k < 200; k++) {
+        uint8_t frame[STRIKE_PACKET_SIZE];
+        encode_strike_packet(random_event(&seed), frame);
+        const int bits = 8 * (int)STRIKE_PACKET_SIZE;
+        for (int a = 0; a < bits; a++) {
+            for (int b = a; b < bits; b++) {
+                uint8_t bad[STRIKE_PACKET_SIZE];
+                memcpy(bad, frame, sizeof(bad));
+                bad[a / 8] ^= (uint8_t)(1 << (a % 8));
+                if (b != a) {
+                    bad[b / 8] ^= (uint8_t)(1 << (b % 8));
+                }
+                StrikeEvent e;
+                StrikePacketStatus status = decode_strike_packet(bad, sizeof(bad), &e);
+                corrupted++;
+                rejected += status != STRIKE_PACKET_OK;
+                version_flagged += status == STRIKE_PACKET_BAD_VERSION;
+            }
+        }
+    }
+    check(rejected == corrupted, "one and two bit errors rejected");
+    printf("one and two bit errors rejected %d/%d (%d by the version byte)\n",
+           rejected, corrupted, version_flagged);
+}
+
+// Keeps the timed loops from being optimized away
+volatile uint32_t bench_sink;
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void bench_codec(int n)
+{
+    unsigned seed = 3;
+    std::vector<StrikeEvent> events;
+    for (int k = 0; k < n; k++) {
+        events.push_back(random_event(&seed));
+    }
+    std::vector<uint8_t> wire((size_t)n * STRIKE_PACKET_SIZE);
+    std::vector<StrikeEvent> decoded(n);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < n; k++) {
+        encode_strike_packet(events[k], &wire[(size_t)k * STRIKE_PACKET_SIZE]);
+    }
+    double encode = seconds_since(start);
+
+    int ok = 0;
+    start = std::chrono::steady_clock::now();
+    for (int k = 0; k < n; k++) {
+        ok += decode_strike_packet(&wire[(size_t)k * STRIKE_PACKET_SIZE], STRIKE_PACKET_SIZE, &decoded[k]) ==
+              STRIKE_PACKET_OK;
+    }
+    double decode = seconds_since(start);
+    bench_sink = ok + decoded[n - 1].time_ms;
+    check(ok == n, "benchmark frames decode");
+
+    printf("codec  encode %5.1f ns/packet (%6.1f MB/s)  decode %5.1f ns/packet (%6.1f MB/s)\n",
+           1E9 * encode / n, n * STRIKE_PACKET_SIZE / encode / 1E6,
+           1E9 * decode / n, n * STRIKE_PACKET_SIZE / decode / 1E6);
+    // struct DATA was 6 bytes of fields padded to 8 on the LPC1768
+    printf("size   %zu bytes per strike, 8 for the old struct DATA\n", STRIKE_PACKET_SIZE);
+}
+
+// Strikes from a storm: mostly tens to hundreds of ms apart, now and then
+// a long gap or a clock that steps back
+std::vector<StrikeEvent> random_storm(int n, unsigned *seed)
+{
+    std::vector<StrikeEvent> strikes;
+    uint32_t time_ms = next_random(seed);
+    for (int k = 0; k < n; k++) {
+        unsigned r = next_random(seed) % 100;
+        time_ms += r < 90 ? next_random(seed) % 300 : r < 98 ? next_random(seed) % 100000 : -(next_random(seed) % 5000);
+        StrikeEvent e;
+        e.detector_id = 3;
+        e.sequence = 0;
+        e.distance_km = STRIKE_DISTANCES_KM[next_random(seed) % STRIKE_DISTANCE_CODES];
+        e.time_ms = time_ms;
+        e.energy = next_random(seed) >> (next_random(seed) % 24);
+        strikes.push_back(e);
+    }
+    return strikes;
+}
+
+// Batch every strike, flushing whenever add() refuses, into one stream
+std::vector<uint8_t> batch_stream(const std::vector<StrikeEvent> &strikes, int *frames)
+{
+    StrikeBatcher batcher(3, 1000, 200);
+    std::vector<uint8_t> stream;
+    uint8_t frame[STRIKE_BATCH_MAX_SIZE];
+    *frames = 0;
+    for (const StrikeEvent &e : strikes) {
+        if (!batcher.add(e.time_ms, e.distance_km, e.energy)) {
+            size_t size = batcher.flush(frame);
+            stream.insert(stream.end(), frame, frame + size);
+            ++*frames;
+            batcher.add(e.time_ms, e.distance_km, e.energy);
+        }
+    }
+    size_t size = batcher.flush(frame);
+    stream.insert(stream.end(), frame, frame + size);
+    ++*frames;
+    return stream;
+}
+
+void check_batch()
+{
+    unsigned seed = 4;
+    int mismatches = 0, energy_outside = 0;
+    for (uint32_t energy = 0; energy < (1u << 22); energy++) {
+        uint32_t back = strike_energy_value(strike_energy_code(energy));
+        mismatches += back > energy;
+        energy_outside += energy - back > energy / 128;
+    }
+    check(mismatches == 0 && energy_outside == 0, "energy code within 1/128 below");
+    int distances = 0;
+    for (int code = 0; code < STRIKE_DISTANCE_CODES; code++) {
+        distances += (int)strike_distance_code(STRIKE_DISTANCES_KM[code]) == code;
+    }
+    check(distances == STRIKE_DISTANCE_CODES, "every AS3935 distance has its own code");
+
+    std::vector<StrikeEvent> strikes = random_storm(200000, &seed);
+    int frames = 0;
+    std::vector<uint8_t> stream = batch_stream(strikes, &frames);
+
+    // Walk the stream frame by frame, as the personal device would
+    size_t at = 0, next = 0, largest = 0;
+    int decoded = 0, same = 0, frames_ok = 0, truncations = 0, short_rejected = 0;
+    while (at < stream.size()) {
+        StrikeBatchView view;
+        size_t frame_size = 0;
+        if (decode_strike_batch(&stream[at], stream.size() - at, &view, &frame_size) != STRIKE_PACKET_OK) {
+            break;
+        }
+        frames_ok++;
+        largest = std::max(largest, frame_size);
+        for (size_t size = 0; size < frame_size; size++, truncations++) {
+            StrikeBatchView ignored;
+            short_rejected += decode_strike_batch(&stream[at], size, &ignored) == STRIKE_PACKET_SHORT;
+        }
+        StrikeBatchReader reader(view);
+        StrikeEvent e;
+        while (reader.next(&e) && next < strikes.size()) {
+            const StrikeEvent &sent = strikes[next++];
+            decoded++;
+            same += e.time_ms == sent.time_ms && e.distance_km == sent.distance_km &&
+                    e.energy == strike_energy_value(strike_energy_code(sent.energy)) && e.detector_id == 3;
+        }
+        at += frame_size;
+    }
+    check(frames_ok == frames && at == stream.size(), "batch stream decodes frame by frame");
+    check(decoded == (int)strikes.size() && same == decoded, "batch round trip");
+    check(largest <= STRIKE_BATCH_MAX_SIZE, "frames fit one send line");
+    check(short_rejected == truncations, "truncated batches wait for more bytes");
+    printf("batch  %d strikes in %d frames (%.2f bytes per strike, largest frame %zu), round trip %d/%d, "
+           "truncated frames %d/%d\n",
+           (int)strikes.size(), frames, (double)stream.size() / strikes.size(), largest, same, decoded,
+           short_rejected, truncations);
+
+    // Single and double bit errors in whole frames
+    int corrupted = 0, rejected = 0;
+    at = 0;
+    for (int f = 0; f < 100; f++) {
+        StrikeBatchView view;
+        size_t frame_size = 0;
+        decode_strike_batch(&stream[at], stream.size() - at, &view, &frame_size);
+        std::vector<uint8_t> bad(stream.begin() + at, stream.begin() + at + frame_size);
+        const int bits = 8 * (int)frame_size;
+        for (int a = 0; a < bits; a++) {
+            for (int b = a; b < bits; b += 7) {
+                bad[a / 8] ^= (uint8_t)(1 << (a % 8));
+                if (b != a) {
+                    bad[b / 8] ^= (uint8_t)(1 << (b % 8));
+                }
+                corrupted++;
+                // Exactly the frame's bytes: a flip that lengthens it must not read past them
+                rejected += decode_strike_batch(bad.data(), bad.size(), &view) != STRIKE_PACKET_OK;
+                bad[a / 8] ^= (uint8_t)(1 << (a % 8));
+                if (b != a) {
+                    bad[b / 8] ^= (uint8_t)(1 << (b % 8));
+                }
+            }
+        }
+        at += frame_size;
+    }
+    check(rejected == corrupted, "one and two bit errors in batches rejected");
+    printf("batch  one and two bit errors rejected %d/%d\n", rejected, corrupted);
+}
+
+void bench_batch_codec(int n)
+{
+    unsigned seed = 5;
+    std::vector<StrikeEvent> strikes = random_storm(n, &seed);
+    int frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> stream = batch_stream(strikes, &frames);
+    double encode = seconds_since(start);
+
+    uint32_t sum = 0;
+    int decoded = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t at = 0; at < stream.size();) {
+        StrikeBatchView view;
+        size_t frame_size = 0;
+        if (decode_strike_batch(&stream[at], stream.size() - at, &view, &frame_size) != STRIKE_PACKET_OK) {
+            break;
+        }
+        StrikeBatchReader reader(view);
+        StrikeEvent e;
+        while (reader.next(&e)) {
+            sum += e.time_ms + e.energy;
+            decoded++;
+        }
+        at += frame_size;
+    }
+    double decode = seconds_since(start);
+    bench_sink = sum;
+    check(decoded == n, "benchmark batches decode");
+
+    printf("batch  encode %5.1f ns/strike (%6.1f MB/s)  decode %5.1f ns/strike (%6.1f MB/s)\n",
+           1E9 * encode / n, stream.size() / encode / 1E6, 1E9 * decode / n, stream.size() / decode / 1E6);
+}
+
+/*
+ * The collector's ESP8266 link: ESP8266::send writes each line of up to
+ * ESP_MAX_LINE payload bytes as cs('\ddd...')\r\n at 9600 baud (10 bits a
+ * character), then waits for the Lua prompt. The prompt wait is the one
+ * number not derived from the code, so it is a parameter.
+ */
+struct LinkModel
+{
+    double prompt_ms;       // Lua execute + c:send until the prompt comes back
+    bool raw;               // ESP8266::setRawMode: cb(n) and the bytes instead of cs('\ddd...')
+
+    // Lua round trip of a short command without a send (cb, cr, crb)
+    static constexpr double command_ms = 5;
+
+    static double uart_ms(size_t chars) { return chars * 10 * 1E3 / 9600; }
+
+    static size_t digits(size_t n) { return n >= 100 ? 3 : n >= 10 ? 2 : 1; }
+
+    // Payload bytes per command, ESP_MAX_LINE or ESP_MAX_RAW in ESP8266.h
+    size_t per_command() const { return raw ? 255 : 62; }
+
+    size_t commands(size_t bytes) const { return (bytes + per_command() - 1) / per_command(); }
+
+    // Characters to the ESP8266 for a send: cs('\ddd...') per line, or
+    // cb(n) and then the bytes
+    size_t chars(size_t bytes) const
+    {
+        size_t total = 0;
+        for (size_t left = bytes; left > 0;) {
+            size_t n = std::min(left, per_command());
+            total += raw ? 3 + digits(n) + 1 + 2 + n : 4 + 4 * n + 2 + 2;
+            left -= n;
+        }
+        return total;
+    }
+
+    // Characters back for a send: the interpreter echoes command lines and
+    // prompts after them; the bytes cb(n) takes are not echoed, and their
+    // send is answered with '>'
+    size_t echo_chars(size_t bytes) const
+    {
+        return raw ? chars(bytes) - bytes + 3 * commands(bytes) : chars(bytes) + 2 * commands(bytes);
+    }
+
+    double send_ms(size_t bytes) const
+    {
+        // Echoes come back while the next characters go out
+        return uart_ms(chars(bytes)) + (prompt_ms + (raw ? command_ms : 0)) * commands(bytes);
+    }
+
+    // Characters to the ESP8266 to read bytes it holds: cr(n) or crb(n)
+    size_t recv_chars_out(size_t bytes) const { return (raw ? 4 : 3) + digits(bytes) + 1 + 2; }
+
+    // Characters back: the echo, the bytes escaped or after their count, the prompt
+    size_t recv_chars_back(size_t bytes) const
+    {
+        size_t payload = raw ? digits(bytes) + 1 + bytes : 4 * bytes + 2;
+        return recv_chars_out(bytes) + payload + 2;
+    }
+
+    double recv_ms(size_t bytes) const
+    {
+        return uart_ms(recv_chars_back(bytes)) + command_ms;
+    }
+
+    // ESP8266::readable: ca() out, then its echo, the count and the prompt back
+    static double available_ms(size_t waiting)
+    {
+        return uart_ms(6 + 6 + digits(waiting) + 2 + 2) + command_ms;
+    }
+};
+
+struct LinkResult
+{
+    int strikes;
+    int delivered;
+    double mean_latency_ms;
+    double max_latency_ms;
+    double wire_chars;
+};
+
+std::vector<double> poisson_arrivals(double rate, double seconds, unsigned seed)
+{
+    std::vector<double> t;
+    double now = 0;
+    while (true) {
+        double u = (next_random(&seed) + 0.5) / 16777216.0;
+        now += -std::log(u) / rate * 1E3;
+        if (now >= seconds * 1E3) {
+            return t;
+        }
+        t.push_back(now);
+    }
+}
+
+// The old firmware: LightningDetected sends a packet from the interrupt,
+// so strikes during a send wait for it (one pending edge) or are lost
+LinkResult simulate_per_strike(const std::vector<double> &arrivals, const LinkModel &link)
+{
+    LinkResult r = {(int)arrivals.size(), 0, 0, 0, 0};
+    double busy_until = 0;
+    bool pending = false;
+    double pending_at = 0;
+    auto deliver = [&](double arrived, double start) {
+        busy_until = start + link.send_ms(STRIKE_PACKET_SIZE);
+        double latency = busy_until - arrived;
+        r.delivered++;
+        r.mean_latency_ms += latency;
+        r.max_latency_ms = std::max(r.max_latency_ms, latency);
+        r.wire_chars += link.chars(STRIKE_PACKET_SIZE);
+    };
+    for (double t : arrivals) {
+        if (pending && busy_until <= t) {
+            deliver(pending_at, busy_until);
+            pending = false;
+        }
+        if (busy_until <= t) {
+            deliver(t, t);
+        } else if (!pending) {
+            pending = true;
+            pending_at = t;
+        }
+    }
+    if (pending) {
+        deliver(pending_at, busy_until);
+    }
+    r.mean_latency_ms /= std::max(1, r.delivered);
+    return r;
+}
+
+// The batching firmware, with the real StrikeBatcher and the main loop
+// polling every 10 ms; frames go out behind the stream header
+LinkResult simulate_batched(const std::vector<double> &arrivals, const LinkModel &link)
+{
+    LinkResult r = {(int)arrivals.size(), 0, 0, 0, 0};
+    StrikeBatcher batcher(1, 1000, 200);
+    uint8_t frame[STRIKE_BATCH_MAX_SIZE];
+    size_t frame_size = 0;
+    std::vector<double> batched, in_frame;     // arrival times of the strikes in each
+    double sending_until = -1;
+    size_t next = 0;
+
+    auto isr = [&](double t) {
+        uint32_t ms = (uint32_t)t;
+        if (!batcher.add(ms, 14, 1000)) {
+            if (frame_size != 0) {
+                return;     // dropped
+            }
+            frame_size = batcher.flush(frame);
+            in_frame.swap(batched);
+            batched.clear();
+            batcher.add(ms, 14, 1000);
+        }
+        batched.push_back(t);
+    };
+
+    for (double now = 0; next < arrivals.size() || batcher.size() > 0 || frame_size > 0; now += 10) {
+        // Strikes up to now, interleaved with the send in progress
+        while (next < arrivals.size() && arrivals[next] <= now) {
+            if (sending_until >= 0 && sending_until <= arrivals[next]) {
+                for (double a : in_frame) {
+                    r.mean_latency_ms += sending_until - a;
+                    r.max_latency_ms = std::max(r.max_latency_ms, sending_until - a);
+                }
+                r.delivered += (int)in_frame.size();
+                in_frame.clear();
+                frame_size = 0;
+                sending_until = -1;
+            }
+            isr(arrivals[next++]);
+        }
+        if (sending_until >= 0) {
+            if (sending_until > now) {
+                continue;
+            }
+            for (double a : in_frame) {
+                r.mean_latency_ms += sending_until - a;
+                r.max_latency_ms = std::max(r.max_latency_ms, sending_until - a);
+            }
+            r.delivered += (int)in_frame.size();
+            in_frame.clear();
+            frame_size = 0;
+            sending_until = -1;
+        }
+        if (frame_size == 0 && (batcher.due((uint32_t)now) || (next == arrivals.size() && batcher.size() > 0))) {
+            frame_size = batcher.flush(frame);
+            in_frame.swap(batched);
+            batched.clear();
+        }
+        if (frame_size > 0) {
+            sending_until = now + link.send_ms(STRIKE_STREAM_OVERHEAD + frame_size);
+            r.wire_chars += link.chars(STRIKE_STREAM_OVERHEAD + frame_size);
+        }
+    }
+    r.mean_latency_ms /= std::max(1, r.delivered);
+    return r;
+}
+
+void bench_link(const LinkModel &link)
+{
+    printf("link   %s, %.0f ms prompt: a packet takes %.0f ms to send, a full batch %.0f ms\n",
+           link.raw ? "raw" : "escaped", link.prompt_ms, link.send_ms(STRIKE_PACKET_SIZE),
+           link.send_ms(STRIKE_STREAM_OVERHEAD + STRIKE_BATCH_MAX_SIZE));
+    const double rates[] = {1, 5, 10, 15, 20, 40};
+    for (double rate : rates) {
+        std::vector<double> arrivals = poisson_arrivals(rate, 600, 7);
+        LinkResult a = simulate_per_strike(arrivals, link);
+        LinkResult b = simulate_batched(arrivals, link);
+        printf("  %4.0f strikes/s  per strike: %5.1f%% delivered, latency %6.0f ms mean %6.0f max, %4.1f chars/strike"
+               "  batched: %5.1f%% delivered, latency %4.0f ms mean %5.0f max, %4.1f chars/strike\n",
+               rate, 100.0 * a.delivered / a.strikes, a.mean_latency_ms, a.max_latency_ms, a.wire_chars / a.delivered,
+               100.0 * b.delivered / b.strikes, b.mean_latency_ms, b.max_latency_ms, b.wire_chars / b.delivered);
+    }
+}
+
+// Characters each way on the collector's UART and time per transfer,
+// escaped against raw, for the payloads the firmware moves and larger
+void bench_transfer(double prompt_ms)
+{
+    LinkModel escaped = {prompt_ms, false}, raw = {prompt_ms, true};
+    printf("esp    %.0f ms prompt after c:send, %.0f ms for a short command; chars to/from the ESP8266 and ms\n",
+           prompt_ms, LinkModel::command_ms);
+    const size_t sizes[] = {STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REQUEST_SIZE, STRIKE_STREAM_OVERHEAD + STRIKE_PACKET_SIZE,
+                            STRIKE_STREAM_OVERHEAD + STRIKE_BATCH_MAX_SIZE, 255, 1024};
+    for (size_t n : sizes) {
+        printf("  send %4zu bytes  escaped %4zu/%4zu chars %6.0f ms  raw %4zu/%3zu chars %5.0f ms  %4.1fx fewer chars, %4.1fx faster\n",
+               n, escaped.chars(n), escaped.echo_chars(n), escaped.send_ms(n), raw.chars(n), raw.echo_chars(n), raw.send_ms(n),
+               (double)(escaped.chars(n) + escaped.echo_chars(n)) / (raw.chars(n) + raw.echo_chars(n)),
+               escaped.send_ms(n) / raw.send_ms(n));
+    }
+    const size_t received[] = {STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE, 255};
+    for (size_t n : received) {
+        printf("  recv %4zu bytes  escaped %4zu/%4zu chars %6.0f ms  raw %4zu/%3zu chars %5.0f ms  %4.1fx fewer chars, %4.1fx faster\n",
+               n, escaped.recv_chars_out(n), escaped.recv_chars_back(n), escaped.recv_ms(n), raw.recv_chars_out(n),
+               raw.recv_chars_back(n), raw.recv_ms(n),
+               (double)(escaped.recv_chars_out(n) + escaped.recv_chars_back(n)) / (raw.recv_chars_out(n) + raw.recv_chars_back(n)),
+               escaped.recv_ms(n) / raw.recv_ms(n));
+    }
+}
+
+typedef std::vector<uint8_t> Bytes;
+
+// Genuine frames, single packets and batches, as the collector sends them
+std::vector<Bytes> random_frames(int n, unsigned *seed)
+{
+    std::vector<Bytes> frames;
+    std::vector<StrikeEvent> strikes = random_storm(20 * n, seed);
+    StrikeBatcher batcher(5, 1000, 200);
+    size_t next = 0;
+    while ((int)frames.size() < n) {
+        Bytes f(STRIKE_BATCH_MAX_SIZE);
+        if (next_random(seed) % 4 == 0) {
+            f.resize(encode_strike_packet(random_event(seed), f.data()));
+        } else {
+            int count = 1 + next_random(seed) % 20;
+            for (int k = 0; k < count; k++, next++) {
+                if (!batcher.add(strikes[next].time_ms, strikes[next].distance_km, strikes[next].energy)) {
+                    break;
+                }
+            }
+            f.resize(batcher.flush(f.data()));
+        }
+        frames.push_back(f);
+    }
+    return frames;
+}
+
+// Bytes that are not a frame: noise with sync bytes in it, a frame cut
+// short, a frame with a flipped bit, a stray newline
+Bytes random_junk(const std::vector<Bytes> &frames, unsigned *seed)
+{
+    Bytes junk;
+    switch (next_random(seed) % 4) {
+    case 0:
+        for (unsigned k = 0, n = next_random(seed) % 40; k < n; k++) {
+            junk.push_back(next_random(seed) % 5 == 0 ? STRIKE_STREAM_SYNC : (uint8_t)next_random(seed));
+        }
+        break;
+    case 1:
+    case 2: {
+        const Bytes &f = frames[next_random(seed) % frames.size()];
+        junk.resize(STRIKE_STREAM_OVERHEAD);
+        strike_stream_header(junk.data(), f.size());
+        junk.insert(junk.end(), f.begin(), f.end());
+        if (next_random(seed) % 2) {
+            junk.resize(STRIKE_STREAM_OVERHEAD + next_random(seed) % f.size());
+        } else {
+            size_t bit = next_random(seed) % (8 * f.size());
+            junk[STRIKE_STREAM_OVERHEAD + bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        }
+        break;
+    }
+    default:
+        junk.push_back('\n');
+    }
+    return junk;
+}
+
+// Frames with junk between them, fed in pieces of random size
+void check_stream()
+{
+    unsigned seed = 6;
+    std::vector<Bytes> frames = random_frames(20000, &seed);
+    Bytes wire;
+    for (const Bytes &f : frames) {
+        if (next_random(&seed) % 3 == 0) {
+            Bytes junk = random_junk(frames, &seed);
+            wire.insert(wire.end(), junk.begin(), junk.end());
+        }
+        wire.push_back(0);
+        wire.push_back(0);
+        strike_stream_header(&wire[wire.size() - STRIKE_STREAM_OVERHEAD], f.size());
+        wire.insert(wire.end(), f.begin(), f.end());
+    }
+    StrikeStreamParser<> parser;
+    std::vector<Bytes> received;
+    for (size_t at = 0; at < wire.size();) {
+        size_t chunk = std::min(wire.size() - at, (size_t)(1 + next_random(&seed) % 100));
+        at += parser.push(&wire[at], chunk);
+        mbed::Span<const uint8_t> frame;
+        while (parser.next(&frame)) {
+            received.push_back(Bytes(frame.data(), frame.data() + frame.size()));
+        }
+    }
+
+    // Every frame in order; a junk frame that passes the CRC would show as extra
+    size_t matched = 0;
+    int extra = 0;
+    for (const Bytes &r : received) {
+        if (matched < frames.size() && r == frames[matched]) {
+            matched++;
+        } else {
+            extra++;
+        }
+    }
+    check(matched == frames.size(), "every frame found in the stream");
+    check(extra == 0, "no junk taken for a frame");
+    check(parser.overflows == 0, "parser kept up");
+    printf("stream %zu frames in %zu bytes with junk, found %zu, extra %d, skipped %u bytes, %u false syncs\n",
+           frames.size(), wire.size(), matched, extra, parser.skipped, parser.bad_frames);
+
+    // A stray sync byte with the largest size in front of the last frame
+    // gives way as soon as that frame is in, not once enough bytes follow
+    StrikeStreamParser<> stray;
+    Bytes last(STRIKE_STREAM_OVERHEAD);
+    strike_stream_header(last.data(), STRIKE_STREAM_MAX_FRAME);
+    last.push_back(0);
+    last.push_back(0);
+    strike_stream_header(&last[last.size() - STRIKE_STREAM_OVERHEAD], frames.back().size());
+    last.insert(last.end(), frames.back().begin(), frames.back().end());
+    stray.push(last.data(), last.size());
+    mbed::Span<const uint8_t> frame;
+    check(stray.next(&frame) && Bytes(frame.data(), frame.data() + frame.size()) == frames.back(),
+          "stray sync byte does not hold back the frame behind it");
+
+    // A full buffer drops bytes instead of overwriting the frame handed out
+    StrikeStreamParser<> full;
+    Bytes burst(2 * 256, STRIKE_STREAM_SYNC);
+    size_t taken = full.push(burst.data(), burst.size());
+    check(taken == 256 && full.overflows == 1, "full buffer drops bytes");
+}
+
+void bench_stream(int n, bool junk)
+{
+    unsigned seed = 7;
+    std::vector<Bytes> frames = random_frames(n, &seed);
+    Bytes wire;
+    for (const Bytes &f : frames) {
+        if (junk && next_random(&seed) % 10 == 0) {
+            Bytes j = random_junk(frames, &seed);
+            wire.insert(wire.end(), j.begin(), j.end());
+        }
+        wire.push_back(STRIKE_STREAM_SYNC);
+        wire.push_back((uint8_t)f.size());
+        wire.insert(wire.end(), f.begin(), f.end());
+    }
+
+    StrikeStreamParser<> parser;
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t at = 0; at < wire.size();) {
+        at += parser.push(&wire[at], std::min(wire.size() - at, (size_t)64));
+        mbed::Span<const uint8_t> frame;
+        while (parser.next(&frame)) {
+            sum += frame[0] + frame.size();
+        }
+    }
+    double seconds = seconds_since(start);
+    bench_sink = sum;
+    printf("stream %-9s %5.1f MB/s, %5.2f M frames/s\n", junk ? "with junk" : "clean",
+           wire.size() / seconds / 1E6, parser.frames / seconds / 1E6);
+}
+
+// Exchanges with exactly known clocks
+void check_clock()
+{
+    uint8_t request[STRIKE_SYNC_REQUEST_SIZE], reply_bytes[STRIKE_SYNC_REPLY_SIZE];
+    encode_strike_sync_request(9, 200, request);
+    uint8_t id = 0, sequence = 0;
+    check(decode_strike_sync_request(request, sizeof(request), &id, &sequence) == STRIKE_PACKET_OK &&
+          id == 9 && sequence == 200, "sync request round trip");
+    StrikeSyncReply reply = {9, 200, 0x89ABCDEF, 0x01234567}, decoded;
+    encode_strike_sync_reply(reply, reply_bytes);
+    check(decode_strike_sync_reply(reply_bytes, sizeof(reply_bytes), &decoded) == STRIKE_PACKET_OK &&
+          decoded.detector_id == 9 && decoded.sequence == 200 && decoded.receive_ms == reply.receive_ms &&
+          decoded.send_ms == reply.send_ms, "sync reply round trip");
+    int rejected = 0, flips = 0;
+    for (size_t bit = 0; bit < 8 * sizeof(reply_bytes); bit++, flips++) {
+        reply_bytes[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+        rejected += decode_strike_sync_reply(reply_bytes, sizeof(reply_bytes), &decoded) != STRIKE_PACKET_OK;
+        reply_bytes[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    check(rejected == flips, "sync reply bit errors rejected");
+    check(decode_strike_sync_request(reply_bytes, sizeof(reply_bytes), &id, &sequence) ==
+          STRIKE_PACKET_BAD_VERSION, "reply is not a request");
+
+    // Symmetric 10 ms trips, a clock 100 ppm fast and 20 days behind, so
+    // the offset is far beyond a float's 24 bits
+    const double drift = 100E-6, behind_ms = 20 * 86400E3;
+    auto local = [&](double t) { return (uint32_t)(int64_t)std::floor((t - behind_ms) * (1 + drift)); };
+    auto common = [](double t) { return (uint32_t)(int64_t)std::floor(t); };
+    StrikeClock clock;
+    check(!clock.synchronized() && clock.to_common(1234) == 1234, "unsynchronized clock passes through");
+    check(!clock.add_exchange(1000, 4000, 5000, 1010), "negative round trip rejected");
+    check(!clock.synchronized(), "rejected exchange not taken in");
+    double worst = 0, worst_settled = 0;
+    for (int k = 0; k < 450; k++) {
+        double t = 30 * 86400E3 + k * 16000.0;
+        clock.add_exchange(local(t), common(t + 10), common(t + 12), local(t + 22));
+        for (double u = t + 30; u < t + 16000; u += 997) {
+            double error = std::fabs((double)(int32_t)(clock.to_common(local(u)) - common(u)));
+            worst = std::max(worst, error);
+            if (k >= 120) {
+                worst_settled = std::max(worst_settled, error);
+            }
+        }
+    }
+    check(clock.synchronized() && clock.exchanges() == STRIKE_CLOCK_WINDOW, "window fills");
+    check(worst <= 4, "offset off by no more than the drift before it is known");
+    check(worst_settled <= 2, "offset within the ms rounding of the stamps once the drift is known");
+    check(std::fabs(clock.drift_rate() + drift) < 5E-6, "drift recovered");
+    printf("clock  exact trips: worst error %.0f ms, %.0f ms once the drift is known, drift %.1f ppm (true %.1f)\n",
+           worst, worst_settled,
+           -1E6 * clock.drift_rate(), 1E6 * drift);
+}
+
+// The firmware's exchange, in ms of true time (the personal device's
+// clock). The fixed parts come from the 9600 baud UARTs: t1 is read once
+// the ESP8266's prompt is back, the request reaches the personal device
+// through uart.write, and t3 is when the reply's Lua line is through. The
+// collector then polls as SyncClock does, in raw mode: a ca() round trip
+// until something is waiting, then crb(32) for up to 32 bytes, whatever
+// was left in cm first
+struct SyncModel
+{
+    double jitter_ms;       // mean of the exponential delay each way on the WiFi
+    double poll_ms;         // between exchanges
+    double drift;           // collector clock rate error
+    double out_ms;          // t1 to the request's arrival, less jitter
+    double back_ms;         // t3 to the reply in the collector ESP8266, less jitter
+    size_t backlog;         // bytes left in cm when the request goes out
+    double loss;            // probability a frame is lost each way
+};
+
+struct SyncResult
+{
+    double mean_ms;         // mean error of synchronized timestamps
+    double rms_ms;
+    double p99_ms;          // 99th percentile of the absolute error
+    double max_ms;
+    double drift_error_ppm;
+    int lost;               // exchanges without a reply
+};
+
+SyncResult simulate_sync(const SyncModel &m, const StrikeClock &initial, unsigned seed)
+{
+    double boot_ms = 4000 + next_random(&seed) % 30000;
+    auto local = [&](double t) { return (uint32_t)(int64_t)std::floor((t - boot_ms) * (1 + m.drift)); };
+    auto uniform = [&]() { return (next_random(&seed) + 0.5) / 16777216.0; };
+    auto jitter = [&]() { return -std::log(uniform()) * m.jitter_ms; };
+    StrikeClock clock = initial;
+    std::vector<double> errors;
+    SyncResult r = {0, 0, 0, 0, 0, 0};
+
+    // Four exchanges a second apart before the detector is armed, then
+    // one every poll_ms for two hours, with strikes checked in between
+    double t = boot_ms + 5000;
+    for (int k = 0; t < boot_ms + 2 * 3600E3; k++) {
+        double next = t + (k < 4 ? 1000 : m.poll_ms);
+        uint32_t t1 = local(t);
+        if (uniform() < m.loss || uniform() < m.loss) {
+            r.lost++;
+        } else {
+            // The personal device's main loop takes the request within 10 ms,
+            // and now and then only after 0.3 s writing out a warning
+            double taken = t + m.out_ms + jitter() + 10 * uniform() + (uniform() < 0.02 ? 300 : 0);
+            uint32_t t2 = (uint32_t)taken;
+            double line_ms = (9 + 4 * (STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE) + 4) * 10 * 1E3 / 9600;
+            uint32_t t3 = (uint32_t)(taken + line_ms);
+            double in_esp = taken + line_ms + m.back_ms + jitter();
+            // t4 is when the check before the read that completes the
+            // reply started
+            LinkModel link = {0, true};
+            size_t backlog = m.backlog, reply_left = STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE;
+            for (double at = t; at - t < 1000;) {
+                double checked = at;
+                size_t waiting = backlog + (in_esp <= at + LinkModel::uart_ms(6) ? reply_left : 0);
+                at += LinkModel::available_ms(waiting);
+                if (waiting == 0) {
+                    continue;
+                }
+                size_t n = std::min(waiting, (size_t)32);
+                at += link.recv_ms(n);
+                size_t stale = std::min(n, backlog);
+                backlog -= stale;
+                reply_left -= std::min(n - stale, reply_left);
+                if (reply_left == 0) {
+                    clock.add_exchange(t1, t2, t3, local(checked));
+                    break;
+                }
+            }
+            r.lost += reply_left > 0;
+        }
+        if (k >= 4) {
+            for (double u = t + 50 * uniform(); u < next; u += 250) {
+                errors.push_back((double)(int32_t)(clock.to_common(local(u)) - (uint32_t)u));
+            }
+        }
+        t = next;
+    }
+
+    for (double e : errors) {
+        r.mean_ms += e;
+        r.rms_ms += e * e;
+    }
+    r.mean_ms /= errors.size();
+    r.rms_ms = std::sqrt(r.rms_ms / errors.size());
+    for (double &e : errors) {
+        e = std::fabs(e);
+    }
+    std::sort(errors.begin(), errors.end());
+    r.p99_ms = errors[errors.size() * 99 / 100];
+    r.max_ms = errors.back();
+    r.drift_error_ppm = 1E6 * (-clock.drift_rate() - m.drift);
+    return r;
+}
+
+void bench_sync()
+{
+    // Offset only: the drift fit needs more span than the window ever has
+    StrikeClock fitted, offset_only(4, 2000, 0xFFFFFFFF);
+    printf("sync   collector 40 ppm fast, 2 h; error of synchronized timestamps (ms), unsynchronized they are off by the boot time\n");
+    const double jitters[] = {0, 2, 10, 50};
+    const double polls[] = {16000, 64000};
+    for (double poll : polls) {
+        for (double jitter : jitters) {
+            SyncModel m = {jitter, poll, 40E-6, 10, 4, 0, 0.02};
+            SyncResult a = simulate_sync(m, fitted, 11);
+            SyncResult b = simulate_sync(m, offset_only, 11);
+            printf("  poll %2.0f s jitter %2.0f ms  offset and drift: mean %+5.1f rms %5.1f p99 %5.1f max %5.1f, drift off by %5.1f ppm"
+                   "  offset only: rms %5.1f p99 %5.1f max %5.1f\n",
+                   poll / 1E3, jitter, a.mean_ms, a.rms_ms, a.p99_ms, a.max_ms, a.drift_error_ppm,
+                   b.rms_ms, b.p99_ms, b.max_ms);
+        }
+    }
+
+    // What SyncClock's discard() saves: replies left in cm from earlier
+    // exchanges, or ones meant for another collector, are read first and
+    // make the reply look later than it came
+    const size_t backlogs[] = {0, STRIKE_STREAM_OVERHEAD + STRIKE_SYNC_REPLY_SIZE, 208};
+    SyncResult drained = {0, 0, 0, 0, 0, 0};
+    for (size_t backlog : backlogs) {
+        SyncModel m = {2, 16000, 40E-6, 10, 4, backlog, 0.02};
+        SyncResult a = simulate_sync(m, fitted, 11);
+        printf("  poll 16 s jitter  2 ms  %3zu bytes waiting: mean %+6.1f rms %6.1f p99 %6.1f max %6.1f, %d of %d exchanges lost\n",
+               backlog, a.mean_ms, a.rms_ms, a.p99_ms, a.max_ms, a.lost, 4 + (int)(2 * 3600E3 / 16000));
+        if (backlog == 0) {
+            drained = a;
+        }
+    }
+    check(drained.rms_ms < 8 && drained.max_ms < 15, "synchronized to within 15 ms once cm is drained");
+}
+
+} // namespace
+
+int main()
+{
+    check_reference();
+    check_round_trip();
+    check_corruption();
+    check_batch();
+    check_stream();
+    check_clock();
+    bench_codec(1000000);
+    bench_batch_codec(1000000);
+    bench_stream(200000, false);
+    bench_stream(200000, true);
+    bench_link({20, false});
+    bench_link({50, false});
+    bench_link({50, true});
+    bench_transfer(20);
+    bench_transfer(50);
+    bench_sync();
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
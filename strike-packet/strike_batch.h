@@ -0,0 +1,376 @@
+#ifndef STRIKE_BATCH_H
+#define STRIKE_BATCH_H
+
+/*
+ * Several strikes from one detector in one frame
+ *
+ * Every wifi.send costs a Lua command and a prompt round trip at 9600
+ * baud, so during a storm the collector packs strikes together instead of
+ * sending a strike_packet.h frame per strike. Version 2 frames are:
+ *
+ *   offset  size  field
+ *        0     1  version (STRIKE_BATCH_VERSION)
+ *        1     1  detector id
+ *        2     1  sequence number, +1 per frame, wraps at 256
+ *        3     1  number of strikes, at least 1
+ *        4     4  time of the first strike (ms)
+ *        8        strikes, each
+ *                   varint  ms since the previous strike (not for the first)
+ *                   2       distance code in bits 0-3, energy in bits 4-14
+ *        n-2   2  CRC-16/CCITT-FALSE of bytes 0 to n-3
+ *
+ * Multi-byte fields are little-endian; the varint is LEB128 (7 bits per
+ * byte, low first, top bit set on all but the last). The distance code
+ * indexes STRIKE_DISTANCES_KM, which holds every value the AS3935 reports.
+ * The energy is a small float: values under 128 are kept exactly, larger
+ * ones keep their top 8 bits (within 1%), which covers the 21 bits the
+ * AS3935 reports. Strikes 100 ms apart take 3 bytes each, so a full frame
+ * holds 17.
+ *
+ * A frame is at most STRIKE_BATCH_MAX_SIZE bytes, so that with the
+ * strike_stream.h header it is one ESP8266 send line.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "strike_packet.h"
+
+/** Format version written to and expected in byte 0 */
+const uint8_t STRIKE_BATCH_VERSION = 2;
+
+/** Largest frame (bytes): ESP_MAX_LINE less the stream header, so a frame goes out in one Lua command */
+const size_t STRIKE_BATCH_MAX_SIZE = 60;
+
+/** Bytes before the first strike */
+const size_t STRIKE_BATCH_HEADER_SIZE = 8;
+
+/** Number of distance codes */
+const int STRIKE_DISTANCE_CODES = 16;
+
+/** Distances (km) the AS3935 reports, by code: 1 is overhead, 63 out of range */
+const uint8_t STRIKE_DISTANCES_KM[STRIKE_DISTANCE_CODES] = {
+    1, 5, 6, 8, 10, 12, 14, 17, 20, 24, 27, 31, 34, 37, 40, 63
+};
+
+/**
+ * @return code of a reported distance; values the AS3935 does not report
+ * get the code of the nearest one that it does
+ */
+inline unsigned strike_distance_code(uint8_t distance_km)
+{
+    unsigned best = 0;
+    for (int code = 1; code < STRIKE_DISTANCE_CODES; code++) {
+        int gap = (int)STRIKE_DISTANCES_KM[code] - distance_km;
+        int best_gap = (int)STRIKE_DISTANCES_KM[best] - distance_km;
+        if ((gap < 0 ? -gap : gap) < (best_gap < 0 ? -best_gap : best_gap)) {
+            best = code;
+        }
+    }
+    return best;
+}
+
+/**
+ * Energy as an 11-bit float: 4-bit exponent, 7-bit mantissa
+ *
+ * @param energy AS3935 energy, saturated at 22 bits
+ */
+inline unsigned strike_energy_code(uint32_t energy)
+{
+    if (energy < 128) {
+        return energy;
+    }
+    if (energy > 0x3FFFFF) {
+        energy = 0x3FFFFF;
+    }
+    int bits = 8;
+    while ((energy >> bits) != 0) {
+        bits++;
+    }
+    // Exponent 1 holds 8-bit values, so the leading one is implied
+    return (unsigned)(bits - 7) << 7 | ((energy >> (bits - 8)) & 0x7F);
+}
+
+/** @return the energy a code stands for, the low end of its interval */
+inline uint32_t strike_energy_value(unsigned code)
+{
+    unsigned exponent = code >> 7, mantissa = code & 0x7F;
+    return exponent == 0 ? mantissa : (uint32_t)(0x80 | mantissa) << (exponent - 1);
+}
+
+/**
+ * Collects strikes from one detector into version 2 frames
+ *
+ * add() may run in the interrupt handler and flush() in the main loop as
+ * long as the caller keeps them from overlapping. Nothing is allocated.
+ */
+class StrikeBatcher
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param detector_id id written into every frame
+     * @param max_age_ms due once the first strike is this old
+     * @param max_idle_ms due once no strike has come for this long
+     */
+    StrikeBatcher(uint8_t detector_id, uint32_t max_age_ms, uint32_t max_idle_ms)
+        : detector_id(detector_id), sequence(0), max_age_ms(max_age_ms), max_idle_ms(max_idle_ms)
+    {
+        reset();
+    }
+
+    /**
+     * Append a strike
+     *
+     * Times only need to be in order modulo 2^32: a clock that wraps or
+     * steps back costs a 5-byte varint but decodes to the same times.
+     *
+     * @param time_ms time of the strike
+     * @param distance_km distance the AS3935 reported
+     * @param energy energy the AS3935 reported
+     * @return false if the frame is full; flush and add again
+     */
+    bool add(uint32_t time_ms, uint8_t distance_km, uint32_t energy)
+    {
+        uint8_t varint[5];
+        size_t n = 0;
+        if (count > 0) {
+            uint32_t delta = time_ms - last_ms;
+            while (delta >= 0x80) {
+                varint[n++] = (uint8_t)(delta | 0x80);
+                delta >>= 7;
+            }
+            varint[n++] = (uint8_t)delta;
+        }
+        if (used + n + 2 + 2 > STRIKE_BATCH_MAX_SIZE || count == 255) {
+            return false;
+        }
+        if (count == 0) {
+            first_ms = time_ms;
+        }
+        memcpy(frame + used, varint, n);
+        used += n;
+        unsigned field = strike_distance_code(distance_km) | strike_energy_code(energy) << 4;
+        frame[used++] = (uint8_t)field;
+        frame[used++] = (uint8_t)(field >> 8);
+        last_ms = time_ms;
+        count++;
+        return true;
+    }
+
+    /**
+     * @param now_ms current time, on the clock add() was given
+     * @return true if the frame should be flushed: it has no room for a
+     * strike within 127 ms of the last, or the first strike is max_age_ms
+     * old, or the last one max_idle_ms
+     */
+    bool due(uint32_t now_ms) const
+    {
+        if (count == 0) {
+            return false;
+        }
+        return used + 1 + 2 + 2 > STRIKE_BATCH_MAX_SIZE || count == 255 ||
+               now_ms - first_ms >= max_age_ms || now_ms - last_ms >= max_idle_ms;
+    }
+
+    /** @return number of strikes waiting */
+    int size() const { return count; }
+
+    /**
+     * Finish the frame and start the next one
+     *
+     * @param out receives up to STRIKE_BATCH_MAX_SIZE bytes
+     * @return frame size (bytes), 0 if there were no strikes
+     */
+    size_t flush(uint8_t *out)
+    {
+        if (count == 0) {
+            return 0;
+        }
+        frame[0] = STRIKE_BATCH_VERSION;
+        frame[1] = detector_id;
+        frame[2] = sequence++;
+        frame[3] = count;
+        frame[4] = (uint8_t)first_ms;
+        frame[5] = (uint8_t)(first_ms >> 8);
+        frame[6] = (uint8_t)(first_ms >> 16);
+        frame[7] = (uint8_t)(first_ms >> 24);
+        uint16_t crc = strike_packet_crc(frame, used);
+        frame[used] = (uint8_t)crc;
+        frame[used + 1] = (uint8_t)(crc >> 8);
+        size_t size = used + 2;
+        memcpy(out, frame, size);
+        reset();
+        return size;
+    }
+
+private:
+    void reset()
+    {
+        used = STRIKE_BATCH_HEADER_SIZE;
+        count = 0;
+        first_ms = 0;
+        last_ms = 0;
+    }
+
+    uint8_t frame[STRIKE_BATCH_MAX_SIZE];
+    size_t used;            // bytes written, CRC excluded
+    uint8_t count;
+    uint8_t detector_id;
+    uint8_t sequence;
+    uint32_t first_ms;
+    uint32_t last_ms;
+    uint32_t max_age_ms;
+    uint32_t max_idle_ms;
+};
+
+/**
+ * A checked version 2 frame, pointing into the received bytes
+ */
+struct StrikeBatchView
+{
+    const uint8_t *strikes; // first strike's field, inside the frame
+    uint8_t detector_id;
+    uint8_t sequence;
+    uint8_t count;
+    uint32_t first_ms;
+};
+
+/**
+ * Read one LEB128 varint of up to 32 bits
+ *
+ * @return bytes consumed, 0 if it runs past end or is longer than 5 bytes
+ */
+inline size_t read_strike_varint(const uint8_t *p, const uint8_t *end, uint32_t *value)
+{
+    uint32_t v = 0;
+    for (size_t k = 0; k < 5 && p + k < end; k++) {
+        v |= (uint32_t)(p[k] & 0x7F) << (7 * k);
+        if (!(p[k] & 0x80)) {
+            *value = v;
+            return k + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Find and check a version 2 frame at the start of a buffer
+ *
+ * Nothing is copied: the view and the strikes it yields point into in,
+ * which has to outlive them.
+ *
+ * @param in received bytes, starting at the version byte
+ * @param size number of bytes available, may run past the frame
+ * @param view receives the frame, left untouched unless STRIKE_PACKET_OK
+ * @param frame_size if not null, receives the frame size whenever it is
+ * known, which is also on STRIKE_PACKET_BAD_CRC
+ * @return whether the frame was complete, of this version and intact
+ */
+inline StrikePacketStatus decode_strike_batch(const uint8_t *in, size_t size, StrikeBatchView *view,
+                                              size_t *frame_size = 0)
+{
+    if (size < STRIKE_BATCH_HEADER_SIZE) {
+        return STRIKE_PACKET_SHORT;
+    }
+    if (in[0] != STRIKE_BATCH_VERSION) {
+        return STRIKE_PACKET_BAD_VERSION;
+    }
+    if (in[3] == 0) {
+        return STRIKE_PACKET_MALFORMED;
+    }
+
+    // Walk the strikes to find the CRC. Running out of bytes means more
+    // are to come, unless there are already more than a frame can hold
+    const uint8_t *end = in + (size < STRIKE_BATCH_MAX_SIZE ? size : STRIKE_BATCH_MAX_SIZE);
+    StrikePacketStatus ran_out = size < STRIKE_BATCH_MAX_SIZE ? STRIKE_PACKET_SHORT : STRIKE_PACKET_MALFORMED;
+    const uint8_t *p = in + STRIKE_BATCH_HEADER_SIZE;
+    for (int k = 0; k < in[3]; k++) {
+        if (k > 0) {
+            uint32_t delta;
+            size_t n = read_strike_varint(p, end, &delta);
+            if (n == 0) {
+                return end - p >= 5 ? STRIKE_PACKET_MALFORMED : ran_out;
+            }
+            p += n;
+        }
+        if (end - p < 2) {
+            return ran_out;
+        }
+        if (p[1] & 0x80) {
+            return STRIKE_PACKET_MALFORMED;
+        }
+        p += 2;
+    }
+    if (end - p < 2) {
+        return ran_out;
+    }
+    size_t used = p - in;
+    if (frame_size) {
+        *frame_size = used + 2;
+    }
+    if (strike_packet_crc(in, used) != (uint16_t)(p[0] | (p[1] << 8))) {
+        return STRIKE_PACKET_BAD_CRC;
+    }
+
+    view->strikes = in + STRIKE_BATCH_HEADER_SIZE;
+    view->detector_id = in[1];
+    view->sequence = in[2];
+    view->count = in[3];
+    view->first_ms = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) |
+                     ((uint32_t)in[7] << 24);
+    return STRIKE_PACKET_OK;
+}
+
+/**
+ * Walks the strikes of a checked frame
+ *
+ *   StrikeBatchReader reader(view);
+ *   StrikeEvent strike;
+ *   while (reader.next(&strike)) { ... }
+ */
+class StrikeBatchReader
+{
+public:
+    explicit StrikeBatchReader(const StrikeBatchView &view)
+        : view(view), p(view.strikes), left(view.count), time_ms(view.first_ms)
+    {
+    }
+
+    /**
+     * @param strike receives the next strike, with the frame's detector id
+     * and sequence number
+     * @return false once every strike has been read
+     */
+    bool next(StrikeEvent *strike)
+    {
+        if (left == 0) {
+            return false;
+        }
+        if (left != view.count) {
+            // decode_strike_batch has bounded every varint already
+            uint32_t delta = 0;
+            p += read_strike_varint(p, p + 5, &delta);
+            time_ms += delta;
+        }
+        unsigned field = p[0] | p[1] << 8;
+        p += 2;
+        left--;
+        strike->detector_id = view.detector_id;
+        strike->sequence = view.sequence;
+        strike->distance_km = STRIKE_DISTANCES_KM[field & 0xF];
+        strike->time_ms = time_ms;
+        strike->energy = strike_energy_value(field >> 4);
+        return true;
+    }
+
+private:
+    StrikeBatchView view;
+    const uint8_t *p;
+    int left;
+    uint32_t time_ms;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef STRIKE_CLOCK_H
+#define STRIKE_CLOCK_H
+
+/*
+ * Clock synchronization of the collectors to the personal device
+ *
+ * Every collector's Timer starts when that board boots and runs at its own
+ * crystal's rate, so strike times from two stations cannot be compared as
+ * they are. The personal device's clock is the common timebase, and each
+ * collector keeps a StrikeClock that maps its own milliseconds onto it.
+ *
+ * The exchange is NTP's. The collector sends a request and notes when it
+ * went out (t1, its clock); the personal device answers with when the
+ * request arrived (t2) and when the answer leaves (t3, both its clock); the
+ * collector notes when the answer came in (t4, its clock). Then
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2     common minus local time
+ *   delay  = (t4 - t1) - (t3 - t2)           round trip on the link
+ *
+ * The offset is off by half the difference between the two one-way
+ * delays, so at most delay / 2. Both frames go through strike_stream.h:
+ *
+ *   request, version 3, 5 bytes    reply, version 4, 13 bytes
+ *
+ *   offset  size  field            offset  size  field
+ *        0     1  version               0     1  version
+ *        1     1  detector id           1     1  detector id
+ *        2     1  sequence              2     1  sequence of the request
+ *        3     2  CRC of bytes 0-2      3     4  t2 (ms)
+ *                                       7     4  t3 (ms)
+ *                                      11     2  CRC of bytes 0-10
+ *
+ * with the same byte order and CRC as strike_packet.h.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "strike_packet.h"
+
+/** Version byte of a request */
+const uint8_t STRIKE_SYNC_REQUEST_VERSION = 3;
+
+/** Version byte of a reply */
+const uint8_t STRIKE_SYNC_REPLY_VERSION = 4;
+
+/** Size of an encoded request (bytes) */
+const size_t STRIKE_SYNC_REQUEST_SIZE = 5;
+
+/** Size of an encoded reply (bytes) */
+const size_t STRIKE_SYNC_REPLY_SIZE = 13;
+
+/** Exchanges StrikeClock keeps */
+const int STRIKE_CLOCK_WINDOW = 8;
+
+/**
+ * The personal device's half of an exchange
+ */
+struct StrikeSyncReply
+{
+    uint8_t detector_id;
+    uint8_t sequence;       // of the request answered
+    uint32_t receive_ms;    // t2: when the request arrived
+    uint32_t send_ms;       // t3: when the reply leaves
+};
+
+/**
+ * Write a request
+ *
+ * @param out receives STRIKE_SYNC_REQUEST_SIZE bytes
+ * @return STRIKE_SYNC_REQUEST_SIZE
+ */
+inline size_t encode_strike_sync_request(uint8_t detector_id, uint8_t sequence, uint8_t *out)
+{
+    out[0] = STRIKE_SYNC_REQUEST_VERSION;
+    out[1] = detector_id;
+    out[2] = sequence;
+    uint16_t crc = strike_packet_crc(out, 3);
+    out[3] = (uint8_t)crc;
+    out[4] = (uint8_t)(crc >> 8);
+    return STRIKE_SYNC_REQUEST_SIZE;
+}
+
+/**
+ * Read and check a request
+ *
+ * @param detector_id, sequence receive the fields, untouched unless STRIKE_PACKET_OK
+ */
+inline StrikePacketStatus decode_strike_sync_request(const uint8_t *in, size_t size,
+                                                     uint8_t *detector_id, uint8_t *sequence)
+{
+    if (size < STRIKE_SYNC_REQUEST_SIZE) {
+        return STRIKE_PACKET_SHORT;
+    }
+    if (in[0] != STRIKE_SYNC_REQUEST_VERSION) {
+        return STRIKE_PACKET_BAD_VERSION;
+    }
+    if (strike_packet_crc(in, 3) != (uint16_t)(in[3] | (in[4] << 8))) {
+        return STRIKE_PACKET_BAD_CRC;
+    }
+    *detector_id = in[1];
+    *sequence = in[2];
+    return STRIKE_PACKET_OK;
+}
+
+/**
+ * Write a reply
+ *
+ * @param out receives STRIKE_SYNC_REPLY_SIZE bytes
+ * @return STRIKE_SYNC_REPLY_SIZE
+ */
+inline size_t encode_strike_sync_reply(const StrikeSyncReply &reply, uint8_t *out)
+{
+    out[0] = STRIKE_SYNC_REPLY_VERSION;
+    out[1] = reply.detector_id;
+    out[2] = reply.sequence;
+    for (int k = 0; k < 4; k++) {
+        out[3 + k] = (uint8_t)(reply.receive_ms >> (8 * k));
+        out[7 + k] = (uint8_t)(reply.send_ms >> (8 * k));
+    }
+    uint16_t crc = strike_packet_crc(out, 11);
+    out[11] = (uint8_t)crc;
+    out[12] = (uint8_t)(crc >> 8);
+    return STRIKE_SYNC_REPLY_SIZE;
+}
+
+/**
+ * Read and check a reply
+ *
+ * @param reply receives the fields, untouched unless STRIKE_PACKET_OK
+ */
+inline StrikePacketStatus decode_strike_sync_reply(const uint8_t *in, size_t size,
+                                                   StrikeSyncReply *reply)
+{
+    if (size < STRIKE_SYNC_REPLY_SIZE) {
+        return STRIKE_PACKET_SHORT;
+    }
+    if (in[0] != STRIKE_SYNC_REPLY_VERSION) {
+        return STRIKE_PACKET_BAD_VERSION;
+    }
+    if (strike_packet_crc(in, 11) != (uint16_t)(in[11] | (in[12] << 8))) {
+        return STRIKE_PACKET_BAD_CRC;
+    }
+    reply->detector_id = in[1];
+    reply->sequence = in[2];
+    reply->receive_ms = 0;
+    reply->send_ms = 0;
+    for (int k = 0; k < 4; k++) {
+        reply->receive_ms |= (uint32_t)in[3 + k] << (8 * k);
+        reply->send_ms |= (uint32_t)in[7 + k] << (8 * k);
+    }
+    return STRIKE_PACKET_OK;
+}
+
+/**
+ * Offset and drift of a collector's clock against the common timebase
+ *
+ * Keeps the last STRIKE_CLOCK_WINDOW exchanges. Like NTP's clock filter it
+ * only trusts the exchanges whose round trip is close to the shortest in
+ * the window, since an exchange's offset can be off by half its round
+ * trip. The offset is taken from the centre of the trusted exchanges. The
+ * drift is the slope from one such centre to the next at least min_span_ms
+ * later, averaged with the drift before (0 at first) so that jitter over a
+ * few minutes does not swing it by more than the crystal ever would.
+ *
+ * to_common() may run in an interrupt handler while add_exchange() runs in
+ * the main loop as long as the caller keeps them from overlapping.
+ */
+class StrikeClock
+{
+public:
+    /**
+     * Constructor
+     *
+     * @param margin_ms an exchange is trusted if its round trip is at most
+     * this much longer than the shortest
+     * @param max_delay_ms exchanges with a longer round trip are discarded
+     * @param min_span_ms trusted exchanges must span this long to fit the drift
+     * @param max_drift fits with a larger drift (ms per ms) are not taken
+     */
+    StrikeClock(uint32_t margin_ms = 4, uint32_t max_delay_ms = 2000, uint32_t min_span_ms = 300000,
+                float max_drift = 500E-6f)
+        : margin_ms(margin_ms), max_delay_ms(max_delay_ms), min_span_ms(min_span_ms),
+          max_drift(max_drift), count(0), newest(STRIKE_CLOCK_WINDOW - 1), ref_ms(0), base_ms(0),
+          intercept(0), drift(0), anchor_ms(0), anchor_base(0), anchor_offset(0),
+          drift_known(false), delay(0), synced(false)
+    {
+    }
+
+    /**
+     * Take in one exchange
+     *
+     * @param t1 request sent (local ms)
+     * @param t2 request received (common ms)
+     * @param t3 reply sent (common ms)
+     * @param t4 reply received (local ms)
+     * @return false if the round trip was negative or longer than max_delay_ms
+     */
+    bool add_exchange(uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4)
+    {
+        int32_t round_trip = (int32_t)(t4 - t1) - (int32_t)(t3 - t2);
+        if (round_trip < 0 || (uint32_t)round_trip > max_delay_ms) {
+            return false;
+        }
+        newest = (newest + 1) % STRIKE_CLOCK_WINDOW;
+        Exchange &e = window[newest];
+        e.local_ms = t1 + (t4 - t1) / 2;
+        e.forward_ms = t2 - t1;
+        e.delay_ms = (uint32_t)round_trip;
+        if (count < STRIKE_CLOCK_WINDOW) {
+            count++;
+        }
+        fit();
+        return true;
+    }
+
+    /**
+     * @param local_ms a time on the collector's clock
+     * @return the same instant on the common timebase, local_ms until the
+     * first exchange
+     */
+    uint32_t to_common(uint32_t local_ms) const
+    {
+        float correction = intercept + drift * (float)(int32_t)(local_ms - ref_ms);
+        return local_ms + (uint32_t)(base_ms + (int32_t)floorf(correction + 0.5f));
+    }
+
+    /** @return true once an exchange has been taken in */
+    bool synchronized() const { return synced; }
+
+    /** @return exchanges in the window */
+    int exchanges() const { return count; }
+
+    /** @return drift of the local clock (ms per ms, positive if it is slow) */
+    float drift_rate() const { return drift; }
+
+    /** @return shortest round trip in the window (ms) */
+    uint32_t min_delay() const { return delay; }
+
+private:
+    struct Exchange
+    {
+        uint32_t local_ms;  // midway between t1 and t4
+        uint32_t forward_ms;    // t2 - t1, the offset is this less half the round trip
+        uint32_t delay_ms;  // round trip
+    };
+
+    void fit()
+    {
+        const Exchange &ref = window[newest];
+        uint32_t shortest = ref.delay_ms;
+        for (int k = 0; k < count; k++) {
+            if (window[k].delay_ms < shortest) {
+                shortest = window[k].delay_ms;
+            }
+        }
+
+        // Offsets relative to the newest exchange's, so floats keep the
+        // sub-ms part whatever the boards' boot times
+        int32_t base = (int32_t)(ref.forward_ms - ref.delay_ms / 2);
+        float x[STRIKE_CLOCK_WINDOW], y[STRIKE_CLOCK_WINDOW];
+        float mean_x = 0, mean_y = 0;
+        int n = 0, latest = 0;
+        for (int k = 0; k < count; k++) {
+            const Exchange &e = window[k];
+            if (e.delay_ms > shortest + margin_ms) {
+                continue;
+            }
+            x[n] = (float)(int32_t)(e.local_ms - ref.local_ms);
+            y[n] = (float)(int32_t)(e.forward_ms - base) - 0.5f * e.delay_ms;
+            mean_x += x[n];
+            mean_y += y[n];
+            if (x[n] > x[latest]) {
+                latest = n;
+            }
+            n++;
+        }
+        mean_x /= n;
+        mean_y /= n;
+
+        // The trusted exchanges' centre does not depend on the drift, which
+        // is the slope from a centre at least min_span_ms before
+        uint32_t centre_ms = ref.local_ms + (int32_t)floorf(mean_x + 0.5f);
+        if (!synced) {
+            anchor_ms = centre_ms;
+            anchor_base = base;
+            anchor_offset = mean_y;
+        } else if ((int32_t)(centre_ms - anchor_ms) > 0 && centre_ms - anchor_ms >= min_span_ms) {
+            float measured = ((float)(base - anchor_base) + mean_y - anchor_offset) /
+                             (float)(centre_ms - anchor_ms);
+            if (fabsf(measured) <= max_drift) {
+                drift += (measured - drift) * 0.5f;
+                drift_known = true;
+            }
+            anchor_ms = centre_ms;
+            anchor_base = base;
+            anchor_offset = mean_y;
+        }
+        // Before the first drift the centre lags by the drift over half the
+        // window, so the latest trusted exchange is closer
+        intercept = drift_known ? mean_y - drift * mean_x : y[latest] - drift * x[latest];
+        ref_ms = ref.local_ms;
+        base_ms = base;
+        delay = shortest;
+        synced = true;
+    }
+
+    uint32_t margin_ms;
+    uint32_t max_delay_ms;
+    uint32_t min_span_ms;
+    float max_drift;
+
+    Exchange window[STRIKE_CLOCK_WINDOW];
+    int count;
+    int newest;             // index of the last exchange taken in, the window fills from 0
+
+    // Common minus local time is base_ms + intercept + drift * (local - ref_ms)
+    uint32_t ref_ms;
+    int32_t base_ms;
+    float intercept;
+    float drift;
+
+    // Centre of the trusted exchanges the drift is measured from
+    uint32_t anchor_ms;
+    int32_t anchor_base;
+    float anchor_offset;
+    bool drift_known;
+    uint32_t delay;
+    bool synced;
+};
+
+#endif
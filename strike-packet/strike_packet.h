@@ -0,0 +1,130 @@
+#ifndef STRIKE_PACKET_H
+#define STRIKE_PACKET_H
+
+/*
+ * Wire format of a strike report from a data collector to the personal
+ * device, shared by both firmware images and the host tools
+ *
+ * Every field is written byte by byte, least significant byte first, so
+ * the frame does not depend on struct padding or on the endianness of
+ * either end. Version 1 is 10 bytes:
+ *
+ *   offset  size  field
+ *        0     1  version (STRIKE_PACKET_VERSION)
+ *        1     1  detector id
+ *        2     1  sequence number, +1 per packet from a detector, wraps at 256
+ *        3     1  distance (km) as reported by the AS3935
+ *        4     4  time of the strike (ms)
+ *        8     2  CRC-16/CCITT-FALSE of bytes 0-7
+ *
+ * The CRC is computed with mbed's MbedCRC in table mode, configured to
+ * the same polynomial, seed and bit order as binascii.crc_hqx(data,
+ * 0xFFFF), so Python tools can check frames too. On the host the table
+ * and MbedCRC's assert hook come from mbed_crc_host.cpp.
+ *
+ * The firmware builds add this directory as a source directory:
+ *
+ *   mbed compile -m LPC1768 -t GCC_ARM --source . --source ../strike-packet
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "drivers/MbedCRC.h"
+
+/** Format version written to and expected in byte 0 */
+const uint8_t STRIKE_PACKET_VERSION = 1;
+
+/** Size of an encoded packet (bytes) */
+const size_t STRIKE_PACKET_SIZE = 10;
+
+/**
+ * One detection, as the collector reports it
+ */
+struct StrikeEvent
+{
+    uint8_t detector_id;
+    uint8_t sequence;       // wraps at 256, for spotting lost and repeated packets
+    uint8_t distance_km;
+    uint32_t time_ms;
+    uint32_t energy;        // AS3935 strike energy, only carried by strike_batch.h frames
+};
+
+/**
+ * Outcome of decoding a packet or a batch frame
+ */
+enum StrikePacketStatus
+{
+    STRIKE_PACKET_OK,
+    STRIKE_PACKET_SHORT,        // the frame is longer than the bytes available
+    STRIKE_PACKET_BAD_VERSION,  // written by a newer or older format
+    STRIKE_PACKET_BAD_CRC,      // corrupted on the way
+    STRIKE_PACKET_MALFORMED     // fields that no encoder writes
+};
+
+/**
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, seed 0xFFFF, no reflection, no
+ * final xor) of a buffer
+ */
+inline uint16_t strike_packet_crc(const uint8_t *data, size_t size)
+{
+    // The explicit configuration keeps the CRC table driven and avoids the
+    // default constructor, which only the mbed library defines
+    mbed::MbedCRC<POLY_16BIT_CCITT, 16> crc(0xFFFF, 0, false, false);
+    uint32_t value = 0;
+    crc.compute(const_cast<uint8_t *>(data), size, &value);
+    return (uint16_t)value;
+}
+
+/**
+ * Write a packet
+ *
+ * @param event the detection
+ * @param out receives STRIKE_PACKET_SIZE bytes
+ * @return STRIKE_PACKET_SIZE
+ */
+inline size_t encode_strike_packet(const StrikeEvent &event, uint8_t *out)
+{
+    out[0] = STRIKE_PACKET_VERSION;
+    out[1] = event.detector_id;
+    out[2] = event.sequence;
+    out[3] = event.distance_km;
+    out[4] = (uint8_t)event.time_ms;
+    out[5] = (uint8_t)(event.time_ms >> 8);
+    out[6] = (uint8_t)(event.time_ms >> 16);
+    out[7] = (uint8_t)(event.time_ms >> 24);
+    uint16_t crc = strike_packet_crc(out, 8);
+    out[8] = (uint8_t)crc;
+    out[9] = (uint8_t)(crc >> 8);
+    return STRIKE_PACKET_SIZE;
+}
+
+/**
+ * Read and check a packet
+ *
+ * @param in received bytes, starting at the version byte
+ * @param size number of bytes available
+ * @param event receives the detection, left untouched unless STRIKE_PACKET_OK
+ * @return whether the packet was complete, of this version and intact
+ */
+inline StrikePacketStatus decode_strike_packet(const uint8_t *in, size_t size, StrikeEvent *event)
+{
+    if (size < STRIKE_PACKET_SIZE) {
+        return STRIKE_PACKET_SHORT;
+    }
+    if (in[0] != STRIKE_PACKET_VERSION) {
+        return STRIKE_PACKET_BAD_VERSION;
+    }
+    if (strike_packet_crc(in, 8) != (uint16_t)(in[8] | (in[9] << 8))) {
+        return STRIKE_PACKET_BAD_CRC;
+    }
+    event->detector_id = in[1];
+    event->sequence = in[2];
+    event->distance_km = in[3];
+    event->time_ms = (uint32_t)in[4] | ((uint32_t)in[5] << 8) | ((uint32_t)in[6] << 16) |
+                     ((uint32_t)in[7] << 24);
+    event->energy = 0;
+    return STRIKE_PACKET_OK;
+}
+
+#endif
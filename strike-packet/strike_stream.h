@@ -0,0 +1,242 @@
+#ifndef STRIKE_STREAM_H
+#define STRIKE_STREAM_H
+
+/*
+ * Framing of strike packets and batches on a byte stream
+ *
+ * The personal device's ESP8266 hands over whatever TCP delivered, in
+ * pieces of any size, with nothing marking where a frame starts. Each
+ * frame therefore goes out behind two bytes:
+ *
+ *   STRIKE_STREAM_SYNC, frame size (bytes), frame
+ *
+ * Frames (strike_packet.h and strike_batch.h) end in a CRC of the rest,
+ * so a sync byte that is really part of a frame, noise, or a frame cut
+ * short all fail the check; the parser then moves one byte past that
+ * sync byte and looks for the next one. There is no byte stuffing, so a
+ * frame is received exactly as it was sent and can be handed out in
+ * place.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "platform/Span.h"
+#include "strike_batch.h"
+#include "strike_packet.h"
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+/*
+ * Stops the compiler from moving ring accesses across an update of the
+ * head or tail index. The parser only ever runs on one core, an interrupt
+ * against the main loop, so no fence instruction is needed.
+ */
+#if __cplusplus >= 201103L
+#define STRIKE_STREAM_BARRIER() std::atomic_signal_fence(std::memory_order_seq_cst)
+#elif defined(__CC_ARM)
+#define STRIKE_STREAM_BARRIER() __memory_changed()
+#else
+#define STRIKE_STREAM_BARRIER() __asm__ volatile("" ::: "memory")
+#endif
+
+/** Byte in front of every frame */
+const uint8_t STRIKE_STREAM_SYNC = 0x7E;
+
+/** Bytes in front of every frame */
+const size_t STRIKE_STREAM_OVERHEAD = 2;
+
+/** Sizes a frame may have (bytes) */
+const size_t STRIKE_STREAM_MIN_FRAME = 3;
+const size_t STRIKE_STREAM_MAX_FRAME = STRIKE_BATCH_MAX_SIZE;
+
+/**
+ * Write the two bytes that go in front of a frame
+ *
+ * @param out receives STRIKE_STREAM_OVERHEAD bytes, the frame follows them
+ * @param frame_size size of the frame (bytes)
+ */
+inline void strike_stream_header(uint8_t *out, size_t frame_size)
+{
+    out[0] = STRIKE_STREAM_SYNC;
+    out[1] = (uint8_t)frame_size;
+}
+
+/**
+ * Cuts frames out of a byte stream without copying them
+ *
+ * push() runs in the serial interrupt and next() in the main loop; with
+ * one of each no lock is needed, as long as the ring accesses stay on
+ * their side of the index updates (STRIKE_STREAM_BARRIER). Bytes go into a ring of Capacity bytes
+ * that is stored twice over, so any Capacity bytes from the read position
+ * on are contiguous and a frame that wraps around the end of the ring can
+ * still be handed out as one Span. A stray sync byte followed by a
+ * plausible size would hold back the frames behind it until that many
+ * bytes had arrived and its CRC could be checked; instead it is given up
+ * as soon as a complete frame with a good CRC has arrived behind it. A
+ * real frame still coming in could only lose out to one that happens to
+ * sit inside it and pass the CRC, the same odds as noise passing it.
+ *
+ * @tparam Capacity bytes buffered, a power of two that holds at least two
+ * largest frames
+ */
+template <size_t Capacity = 256>
+class StrikeStreamParser
+{
+public:
+    StrikeStreamParser()
+        : frames(0), skipped(0), bad_frames(0), overflows(0), head(0), tail(0), held(0)
+    {
+        MBED_STATIC_ASSERT((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+        MBED_STATIC_ASSERT(Capacity >= 2 * (STRIKE_STREAM_OVERHEAD + STRIKE_STREAM_MAX_FRAME),
+                           "Capacity must hold two frames");
+    }
+
+    /**
+     * Append a received byte
+     *
+     * @return false if the buffer is full and the byte was dropped
+     */
+    bool push(uint8_t byte)
+    {
+        uint32_t h = head;
+        if (h - tail >= Capacity) {
+            overflows++;
+            return false;
+        }
+        STRIKE_STREAM_BARRIER();     // next() has finished with the slot
+        ring[h & (Capacity - 1)] = byte;
+        ring[(h & (Capacity - 1)) + Capacity] = byte;
+        STRIKE_STREAM_BARRIER();     // the byte is in place before next() can see it
+        head = h + 1;
+        return true;
+    }
+
+    /**
+     * Append received bytes
+     *
+     * @return bytes taken, fewer than size if the buffer filled up
+     */
+    size_t push(const uint8_t *data, size_t size)
+    {
+        size_t k = 0;
+        while (k < size && push(data[k])) {
+            k++;
+        }
+        return k;
+    }
+
+    /**
+     * Next complete frame with a good CRC
+     *
+     * The frame stays in the buffer until the next call, which releases
+     * it; the interrupt cannot overwrite it before then.
+     *
+     * @param frame receives the frame, without the sync and size bytes
+     * @return false if no complete frame has arrived yet
+     */
+    bool next(mbed::Span<const uint8_t> *frame)
+    {
+        STRIKE_STREAM_BARRIER();     // done reading the last frame before releasing it
+        tail += held;
+        held = 0;
+        while (true) {
+            uint32_t available = head - tail;
+            if (available == 0) {
+                return false;
+            }
+            STRIKE_STREAM_BARRIER();     // read the bytes only after head says they are there
+
+            // Hunt for the sync byte
+            const uint8_t *p = ring + (tail & (Capacity - 1));
+            const uint8_t *sync = (const uint8_t *)memchr(p, STRIKE_STREAM_SYNC, available);
+            if (!sync) {
+                skipped += available;
+                tail += available;
+                return false;
+            }
+            skipped += sync - p;
+            tail += sync - p;
+            available -= sync - p;
+            p = sync;
+
+            if (available < STRIKE_STREAM_OVERHEAD) {
+                return false;
+            }
+            size_t size = p[1];
+            if (size < STRIKE_STREAM_MIN_FRAME || size > STRIKE_STREAM_MAX_FRAME) {
+                reject();
+                continue;
+            }
+            if (available < STRIKE_STREAM_OVERHEAD + size) {
+                if (!frame_after(p, available)) {
+                    return false;
+                }
+                reject();
+                continue;
+            }
+            const uint8_t *f = p + STRIKE_STREAM_OVERHEAD;
+            if (!good_crc(f, size)) {
+                reject();
+                continue;
+            }
+            *frame = mbed::Span<const uint8_t>(f, size);
+            held = STRIKE_STREAM_OVERHEAD + size;
+            frames++;
+            return true;
+        }
+    }
+
+    /** @return bytes waiting, including a frame handed out */
+    size_t buffered() const { return head - tail; }
+
+    uint32_t frames;        // frames handed out
+    uint32_t skipped;       // bytes before a sync byte
+    uint32_t bad_frames;    // sync bytes followed by a bad size or CRC, or a frame too soon
+    uint32_t overflows;     // bytes dropped because the buffer was full
+
+private:
+    static bool good_crc(const uint8_t *f, size_t size)
+    {
+        return strike_packet_crc(f, size - 2) == (uint16_t)(f[size - 2] | (f[size - 1] << 8));
+    }
+
+    // Whether a complete frame with a good CRC starts after the sync byte
+    // at p, within the available bytes from p on
+    static bool frame_after(const uint8_t *p, uint32_t available)
+    {
+        const uint8_t *end = p + available;
+        const uint8_t *q = p + 1;
+        while ((q = (const uint8_t *)memchr(q, STRIKE_STREAM_SYNC, end - q)) != NULL) {
+            size_t left = end - q;
+            if (left < STRIKE_STREAM_OVERHEAD) {
+                return false;
+            }
+            size_t size = q[1];
+            if (size >= STRIKE_STREAM_MIN_FRAME && size <= STRIKE_STREAM_MAX_FRAME
+                && left >= STRIKE_STREAM_OVERHEAD + size && good_crc(q + STRIKE_STREAM_OVERHEAD, size)) {
+                return true;
+            }
+            q++;
+        }
+        return false;
+    }
+
+    // Not a frame after all: look again from the byte after the sync byte
+    void reject()
+    {
+        bad_frames++;
+        skipped++;
+        tail++;
+    }
+
+    uint8_t ring[2 * Capacity];
+    volatile uint32_t head;     // bytes pushed, written only by push()
+    volatile uint32_t tail;     // bytes consumed, written only by next()
+    uint32_t held;              // size of the frame handed out, released by the next next()
+};
+
+#endif
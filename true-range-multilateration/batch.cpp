@@ -0,0 +1,318 @@
+#include "multilat.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "simd_ops.h"
+#include "solvers.h"
+#include "thread_pool.h"
+
+namespace {
+
+typedef VectorOps::V V;
+const int LANES = VectorOps::width;
+
+// Strikes per pool task; lanes are refilled within a block
+const int BATCH_BLOCK = 256;
+
+/*
+ * One point per lane with the trig the angle-sum expansions need, as
+ * PointTrig in distance_kernel.cpp.
+ */
+struct LaneTrig
+{
+    void assign(const double *lat_deg, const double *lon_deg)
+    {
+        for (int k = 0; k < LANES; k++) {
+            double lat = lat_deg[k] * PI_ON_180;
+            double lon = lon_deg[k] * PI_ON_180;
+            cos_lat[k] = std::cos(lat);
+            sin_half_lat[k] = std::sin(0.5 * lat);
+            cos_half_lat[k] = std::cos(0.5 * lat);
+            sin_half_lon[k] = std::sin(0.5 * lon);
+            cos_half_lon[k] = std::cos(0.5 * lon);
+            sin_lat[k] = 2 * sin_half_lat[k] * cos_half_lat[k];
+        }
+    }
+
+    double cos_lat[LANES], sin_lat[LANES];
+    double sin_half_lat[LANES], cos_half_lat[LANES], sin_half_lon[LANES], cos_half_lon[LANES];
+};
+
+// L1 objective of every lane's point against its own ranges (station-major, LANES per station)
+V lane_objective(const StationTable &s, const LaneTrig &p, const double *ranges)
+{
+    V sl = VectorOps::load(p.sin_half_lat), cl = VectorOps::load(p.cos_half_lat);
+    V so = VectorOps::load(p.sin_half_lon), co = VectorOps::load(p.cos_half_lon);
+    V cos_lat = VectorOps::load(p.cos_lat);
+    V sum = VectorOps::set1(0.0);
+    for (int i = 0; i < s.size(); i++) {
+        V sin_dlat = VectorOps::sub(VectorOps::mul(sl, VectorOps::set1(s.cos_half_lat[i])),
+                                    VectorOps::mul(cl, VectorOps::set1(s.sin_half_lat[i])));
+        V sin_dlon = VectorOps::sub(VectorOps::mul(so, VectorOps::set1(s.cos_half_lon[i])),
+                                    VectorOps::mul(co, VectorOps::set1(s.sin_half_lon[i])));
+        V a = VectorOps::add(VectorOps::mul(sin_dlat, sin_dlat),
+                             VectorOps::mul(VectorOps::mul(cos_lat, VectorOps::set1(s.cos_lat[i])),
+                                            VectorOps::mul(sin_dlon, sin_dlon)));
+        a = VectorOps::min(a, VectorOps::set1(1.0));
+        V d = VectorOps::mul(VectorOps::set1(2.0 * EARTH_RADIUS_KM), VectorOps::asin(VectorOps::sqrt(a)));
+        sum = VectorOps::add(sum, VectorOps::abs(VectorOps::sub(d, VectorOps::load(ranges + i * LANES))));
+    }
+    return sum;
+}
+
+/*
+ * IRLS normal equations of every lane with its own weight floor, the loop
+ * body of levenberg_marquardt with station_range_gradient's haversine gradient. sin(dlat) and sin(dlon)
+ * come from the half angles: sin(x) = 2 sin(x/2) cos(x/2).
+ */
+void lane_normal_equations(const StationTable &s, const LaneTrig &p, const double *ranges,
+                           const double *floor, double *jtj00, double *jtj01, double *jtj11,
+                           double *jtr0, double *jtr1)
+{
+    V sl = VectorOps::load(p.sin_half_lat), cl = VectorOps::load(p.cos_half_lat);
+    V so = VectorOps::load(p.sin_half_lon), co = VectorOps::load(p.cos_half_lon);
+    V cos_lat = VectorOps::load(p.cos_lat), sin_lat = VectorOps::load(p.sin_lat);
+    V zero = VectorOps::set1(0.0), one = VectorOps::set1(1.0);
+    V a00 = zero, a01 = zero, a11 = zero, b0 = zero, b1 = zero;
+    for (int i = 0; i < s.size(); i++) {
+        V ch = VectorOps::set1(s.cos_half_lat[i]), sh = VectorOps::set1(s.sin_half_lat[i]);
+        V cho = VectorOps::set1(s.cos_half_lon[i]), sho = VectorOps::set1(s.sin_half_lon[i]);
+        V station_cos_lat = VectorOps::set1(s.cos_lat[i]);
+        V sin_half_dlat = VectorOps::sub(VectorOps::mul(sl, ch), VectorOps::mul(cl, sh));
+        V cos_half_dlat = VectorOps::add(VectorOps::mul(cl, ch), VectorOps::mul(sl, sh));
+        V sin_half_dlon = VectorOps::sub(VectorOps::mul(so, cho), VectorOps::mul(co, sho));
+        V cos_half_dlon = VectorOps::add(VectorOps::mul(co, cho), VectorOps::mul(so, sho));
+        V cos_product = VectorOps::mul(station_cos_lat, cos_lat);
+        V sin_sq_dlon = VectorOps::mul(sin_half_dlon, sin_half_dlon);
+        V a = VectorOps::add(VectorOps::mul(sin_half_dlat, sin_half_dlat),
+                             VectorOps::mul(cos_product, sin_sq_dlon));
+        a = VectorOps::min(a, one);
+        V d = VectorOps::mul(VectorOps::set1(2.0 * EARTH_RADIUS_KM), VectorOps::asin(VectorOps::sqrt(a)));
+
+        // Zero gradient on top of the station or its antipode, as the scalar code
+        V denom = VectorOps::sqrt(VectorOps::mul(a, VectorOps::sub(one, a)));
+        V defined = VectorOps::greater(denom, 1E-15);
+        V scale = VectorOps::div(VectorOps::set1(EARTH_RADIUS_KM * PI_ON_180),
+                                 VectorOps::max(denom, VectorOps::set1(1E-15)));
+        V da_dlat = VectorOps::sub(VectorOps::mul(sin_half_dlat, cos_half_dlat),
+                                   VectorOps::mul(VectorOps::mul(station_cos_lat, sin_lat), sin_sq_dlon));
+        V da_dlon = VectorOps::mul(cos_product, VectorOps::mul(sin_half_dlon, cos_half_dlon));
+        V g_lat = VectorOps::blend(zero, VectorOps::mul(scale, da_dlat), defined);
+        V g_lon = VectorOps::blend(zero, VectorOps::mul(scale, da_dlon), defined);
+
+        V r = VectorOps::sub(d, VectorOps::load(ranges + i * LANES));
+        V w = VectorOps::div(one, VectorOps::max(VectorOps::abs(r), VectorOps::load(floor)));
+        V w_lat = VectorOps::mul(w, g_lat), w_lon = VectorOps::mul(w, g_lon);
+        a00 = VectorOps::add(a00, VectorOps::mul(w_lat, g_lat));
+        a01 = VectorOps::add(a01, VectorOps::mul(w_lat, g_lon));
+        a11 = VectorOps::add(a11, VectorOps::mul(w_lon, g_lon));
+        b0 = VectorOps::add(b0, VectorOps::mul(w_lat, r));
+        b1 = VectorOps::add(b1, VectorOps::mul(w_lon, r));
+    }
+    VectorOps::store(jtj00, a00);
+    VectorOps::store(jtj01, a01);
+    VectorOps::store(jtj11, a11);
+    VectorOps::store(jtr0, b0);
+    VectorOps::store(jtr1, b1);
+}
+
+enum LaneState
+{
+    LANE_EMPTY,         // no strikes left for this lane
+    LANE_START,         // candidate is the seed, not yet evaluated
+    LANE_ITERATE,       // at the top of an outer iteration: needs normal equations
+    LANE_TRIAL          // has normal equations, trying a step
+};
+
+/*
+ * levenberg_marquardt for one strike per lane. Each lane runs the same
+ * state machine as the scalar loops, so it takes the same steps; the
+ * lanes only share the passes over the stations. A lane that finishes
+ * writes its fix and takes the next strike of the block.
+ */
+void solve_block(const Multilat &multilat, const StationTable &table, const StrikeBatch &batch,
+                 int begin, int end, FixBatch *fixes)
+{
+    const int n = table.size();
+    int state[LANES], strike[LANES], evaluations[LANES], iterations[LANES];
+    bool converged[LANES];
+    double lat[LANES], lon[LANES], fx[LANES], lambda[LANES], floor[LANES], step[LANES];
+    double try_lat[LANES], try_lon[LANES], f[LANES];
+    double jtj00[LANES], jtj01[LANES], jtj11[LANES], jtr0[LANES], jtr1[LANES];
+    std::vector<double> ranges(n * LANES);      // station-major, LANES per station
+    std::vector<double> strike_ranges(n);
+    LaneTrig trig;
+
+    int next = begin;
+    auto refill = [&](int k) {
+        lat[k] = lon[k] = try_lat[k] = try_lon[k] = 0;
+        if (next == end) {
+            state[k] = LANE_EMPTY;
+            return;
+        }
+        strike[k] = next++;
+        for (int i = 0; i < n; i++) {
+            strike_ranges[i] = ranges[i * LANES + k] = batch.ranges[(size_t)i * batch.strikes + strike[k]];
+        }
+        PointLatLon start = multilat.linearized_seed ? multilat.initial_guess(strike_ranges.data()) : multilat.x0;
+        try_lat[k] = start.lat;
+        try_lon[k] = start.lon;
+        lambda[k] = 1E-3;
+        floor[k] = LM_IRLS_START;
+        evaluations[k] = 0;
+        iterations[k] = 0;
+        converged[k] = false;
+        state[k] = LANE_START;
+    };
+    auto finish = [&](int k) {
+        int s = strike[k];
+        PointLatLon location = {lat[k], lon[k]};
+        for (int i = 0; i < n; i++) {
+            strike_ranges[i] = ranges[i * LANES + k];
+        }
+        fixes->lat[s] = lat[k];
+        fixes->lon[s] = lon[k];
+        fixes->residual[s] = fx[k];
+        fixes->iterations[s] = iterations[k];
+        fixes->evaluations[s] = evaluations[k];
+        fixes->uncertainty[s] = multilat.uncertainty(location, strike_ranges.data());
+        refill(k);
+    };
+
+    for (int k = 0; k < LANES; k++) {
+        refill(k);
+    }
+    for (;;) {
+        // Outer loop test; lanes that go on need their normal equations
+        bool any_iterate = false;
+        for (int k = 0; k < LANES; k++) {
+            if (state[k] != LANE_ITERATE) {
+                continue;
+            }
+            if (converged[k] && floor[k] > LM_IRLS_FLOOR) {
+                floor[k] = std::fmax(0.1 * floor[k], LM_IRLS_FLOOR);
+                converged[k] = false;
+            }
+            if (converged[k] || iterations[k] >= multilat.max_itter || evaluations[k] >= multilat.max_itter) {
+                finish(k);
+            } else {
+                iterations[k]++;
+                any_iterate = true;
+            }
+        }
+        if (any_iterate) {
+            trig.assign(lat, lon);
+            double e00[LANES], e01[LANES], e11[LANES], r0[LANES], r1[LANES];
+            lane_normal_equations(table, trig, ranges.data(), floor, e00, e01, e11, r0, r1);
+            for (int k = 0; k < LANES; k++) {
+                if (state[k] == LANE_ITERATE) {
+                    jtj00[k] = e00[k];
+                    jtj01[k] = e01[k];
+                    jtj11[k] = e11[k];
+                    jtr0[k] = r0[k];
+                    jtr1[k] = r1[k];
+                    state[k] = LANE_TRIAL;
+                }
+            }
+        }
+
+        // Damped step for every lane that is trying one
+        bool any_evaluate = false;
+        for (int k = 0; k < LANES; k++) {
+            if (state[k] == LANE_TRIAL && evaluations[k] >= multilat.max_itter) {
+                finish(k);
+            }
+            if (state[k] == LANE_TRIAL) {
+                double mu = lambda[k] * (jtj00[k] + jtj11[k]) + 1E-12;
+                double a00 = jtj00[k] + mu;
+                double a11 = jtj11[k] + mu;
+                double det = a00 * a11 - jtj01[k] * jtj01[k];
+                double step_lat = -(a11 * jtr0[k] - jtj01[k] * jtr1[k]) / det;
+                double step_lon = -(a00 * jtr1[k] - jtj01[k] * jtr0[k]) / det;
+                step[k] = std::fmax(std::fabs(step_lat), std::fabs(step_lon));
+                if (step[k] > LM_MAX_STEP) {
+                    step_lat *= LM_MAX_STEP / step[k];
+                    step_lon *= LM_MAX_STEP / step[k];
+                    step[k] = LM_MAX_STEP;
+                }
+                try_lat[k] = lat[k] + step_lat;
+                try_lon[k] = lon[k] + step_lon;
+            }
+            any_evaluate = any_evaluate || state[k] == LANE_START || state[k] == LANE_TRIAL;
+        }
+        if (!any_evaluate) {
+            break;
+        }
+
+        trig.assign(try_lat, try_lon);
+        VectorOps::store(f, lane_objective(table, trig, ranges.data()));
+        for (int k = 0; k < LANES; k++) {
+            if (state[k] == LANE_START) {
+                lat[k] = try_lat[k];
+                lon[k] = try_lon[k];
+                fx[k] = f[k];
+                evaluations[k] = 1;
+                state[k] = LANE_ITERATE;
+            } else if (state[k] == LANE_TRIAL) {
+                evaluations[k]++;
+                if (f[k] <= fx[k]) {
+                    converged[k] = (step[k] <= multilat.xtol && fx[k] - f[k] <= LM_STALL)
+                                   || fx[k] - f[k] <= multilat.tol * 1E-3;
+                    lat[k] = try_lat[k];
+                    lon[k] = try_lon[k];
+                    fx[k] = f[k];
+                    lambda[k] = std::fmax(lambda[k] * 0.1, 1E-9);
+                    state[k] = LANE_ITERATE;
+                } else if (step[k] <= multilat.xtol) {
+                    converged[k] = true;
+                    state[k] = LANE_ITERATE;
+                } else {
+                    lambda[k] *= 10;
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+void Multilat::locate_batch(const StrikeBatch &batch, FixBatch *fixes, SolverMode mode,
+                            ThreadPool *pool) const
+{
+    const int n = number_of_stations();
+    if (batch.strikes < 0 || batch.ranges.size() != (size_t)n * batch.strikes) {
+        throw std::invalid_argument("Multilat::locate_batch: one range per station and strike required");
+    }
+    fixes->lat.resize(batch.strikes);
+    fixes->lon.resize(batch.strikes);
+    fixes->residual.resize(batch.strikes);
+    fixes->iterations.resize(batch.strikes);
+    fixes->evaluations.resize(batch.strikes);
+    fixes->uncertainty.resize(batch.strikes);
+
+    auto body = [&](int begin, int end) {
+        if (mode == SOLVER_LEVENBERG_MARQUARDT && distance_model == DISTANCE_HAVERSINE) {
+            solve_block(*this, table, batch, begin, end, fixes);
+            return;
+        }
+        std::vector<double> ranges(n);
+        for (int s = begin; s < end; s++) {
+            for (int i = 0; i < n; i++) {
+                ranges[i] = batch.ranges[(size_t)i * batch.strikes + s];
+            }
+            StrikeFix fix = locate_strike(ranges, mode);
+            fixes->lat[s] = fix.location.lat;
+            fixes->lon[s] = fix.location.lon;
+            fixes->residual[s] = fix.residual;
+            fixes->iterations[s] = fix.iterations;
+            fixes->evaluations[s] = fix.evaluations;
+            fixes->uncertainty[s] = fix.uncertainty;
+        }
+    };
+    if (pool) {
+        pool->parallel_for(0, batch.strikes, BATCH_BLOCK, body);
+    } else {
+        body(0, batch.strikes);
+    }
+}
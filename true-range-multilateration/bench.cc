@@ -0,0 +1,1168 @@
+// Throughput benchmarks for the multilateration engine
+//
+//   g++ -O2 -mavx2 -std=c++14 -pthread bench.cc multilat.cpp region.cpp robust.cpp
+//       geodesy.cpp distance_kernel.cpp thread_pool.cpp fix_cache.cpp strike_correlator.cpp
+//       station_registry.cpp warm_locator.cpp storm_cells.cpp fixed_multilat.cpp
+//       static_multilat.cpp objective_surface.cpp batch.cpp -o bench
+//   ./bench
+//
+// The accuracy checks along the way print FAILED lines and make the exit
+// status non-zero.
+//
+// Add -DMULTILAT_FLOAT to time the float build of fixed_multilat.cpp
+// instead of the integer one.
+//
+// bench_python.py times multi_algo.locate_strike on the same scenario.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "distance_kernel.h"
+#include "distance_models.h"
+#include "fix_cache.h"
+#include "fixed_multilat.h"
+#include "objective_surface.h"
+#include "static_multilat.h"
+#include "station_registry.h"
+#include "storm_cells.h"
+#include "storm_tracker.h"
+#include "strike_correlator.h"
+#include "thread_pool.h"
+#include "warm_locator.h"
+#include "multilat.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char *what)
+{
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+const std::vector<PointLatLon> campus_stations = {
+    {33.778662, -84.408694},
+    {33.769620, -84.390898},
+    {33.781994, -84.402854},
+};
+
+// Station grid from quantized_errors.py (np.arange gives 4 x 7 points)
+std::vector<PointLatLon> station_grid()
+{
+    std::vector<PointLatLon> stations;
+    for (int a = 0; a < 4; a++) {
+        for (int o = 0; o < 7; o++) {
+            stations.push_back({33.6 + 0.1 * a, -84.7 + 0.1 * o});
+        }
+    }
+    return stations;
+}
+
+// Strikes on a 0.01 degree grid around the stations, like quantized_errors.py
+std::vector<PointLatLon> strike_grid(int rows, int cols)
+{
+    std::vector<PointLatLon> strikes;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            strikes.push_back({33.5 + 0.01 * r, -84.8 + 0.01 * c});
+        }
+    }
+    return strikes;
+}
+
+std::vector<PointLatLon> random_points(int n, double lat0, double lon0, double span, unsigned seed)
+{
+    std::vector<PointLatLon> points;
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        double u = (seed >> 8) / 16777216.0;
+        seed = seed * 1103515245u + 12345u;
+        double v = (seed >> 8) / 16777216.0;
+        points.push_back({lat0 + span * (u - 0.5), lon0 + span * (v - 0.5)});
+    }
+    return points;
+}
+
+std::vector<std::vector<double>> rounded_ranges(const std::vector<PointLatLon> &stations,
+                                                const std::vector<PointLatLon> &strikes)
+{
+    std::vector<std::vector<double>> ranges;
+    for (const PointLatLon &strike : strikes) {
+        std::vector<double> r;
+        for (const PointLatLon &station : stations) {
+            r.push_back(round_to_range_points(d_haversine(station, strike)));
+        }
+        ranges.push_back(r);
+    }
+    return ranges;
+}
+
+// Keeps the timed loops from being optimized away
+volatile double bench_sink;
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void bench_solver(const char *name, const std::vector<PointLatLon> &stations,
+                  DistanceModel model, SolverMode mode, bool seeded = true)
+{
+    std::vector<PointLatLon> strikes = strike_grid(70, 80);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    Multilat multilat(stations);
+    multilat.distance_model = model;
+    multilat.linearized_seed = seeded;
+
+    long evaluations = 0;
+    long iterations = 0;
+    double error = 0;
+    double residual = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < strikes.size(); i++) {
+        StrikeFix fix = multilat.locate_strike(ranges[i], mode);
+        evaluations += fix.evaluations;
+        iterations += fix.iterations;
+        residual += fix.residual;
+        error += d_haversine(fix.location, strikes[i]);
+    }
+    double elapsed = seconds_since(start);
+
+    printf("%-20s %6zu fixes  %7.2f us/fix  %6.1f iters/fix  %6.1f evals/fix"
+           "  mean residual %.3f km  mean error %.2f km\n",
+           name, strikes.size(), 1E6 * elapsed / strikes.size(),
+           (double)iterations / strikes.size(), (double)evaluations / strikes.size(),
+           residual / strikes.size(), error / strikes.size());
+}
+
+// Levenberg-Marquardt against the Nelder-Mead baseline on the same inputs.
+// Three stations leave flat valleys at long range where the two can stop
+// at points of slightly different residual, so the gate allows a few
+// percent of fixes to come out more than slack km worse, and none by more
+// than max_excess. Many stations add kinks where either can stop a little
+// short, on a residual summed over all of them. Strikes no
+// station hears are left out of the error: every point 40 km from all the
+// stations fits their reports, and which one each solver stops at says
+// nothing about its accuracy.
+void compare_solver_modes(const std::vector<PointLatLon> &stations, DistanceModel model,
+                          double slack, double max_excess_allowed)
+{
+    std::vector<PointLatLon> strikes = strike_grid(70, 80);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    Multilat multilat(stations);
+    multilat.distance_model = model;
+
+    int worse = 0, heard = 0;
+    double max_excess = 0, nm_error = 0, lm_error = 0, nm_time = 0, lm_time = 0;
+    for (size_t i = 0; i < strikes.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        StrikeFix nm = multilat.locate_strike(ranges[i], SOLVER_NELDER_MEAD);
+        nm_time += seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        StrikeFix lm = multilat.locate_strike(ranges[i], SOLVER_LEVENBERG_MARQUARDT);
+        lm_time += seconds_since(start);
+        double excess = lm.residual - nm.residual;
+        if (excess > slack) {
+            worse++;
+        }
+        max_excess = std::fmax(max_excess, excess);
+        if (*std::min_element(ranges[i].begin(), ranges[i].end()) < as3935_range_points[0]) {
+            heard++;
+            nm_error += d_haversine(nm.location, strikes[i]);
+            lm_error += d_haversine(lm.location, strikes[i]);
+        }
+    }
+    printf("  lm vs nm: %d/%zu fixes with residual > %.2f km above nelder-mead, worst excess %.3f km,"
+           " error %.2f vs %.2f km on %d heard, %.1fx faster\n", worse, strikes.size(), slack, max_excess,
+           lm_error / heard, nm_error / heard, heard, nm_time / lm_time);
+    check(worse <= (int)strikes.size() / 20, "lm residual above nelder-mead on at most 5% of fixes");
+    check(max_excess <= max_excess_allowed, "lm residual never far above nelder-mead");
+    check(lm_error <= 1.1 * nm_error, "lm mean error within 10% of nelder-mead");
+    check(lm_time < nm_time, "lm faster than nelder-mead");
+}
+
+// Interval mode: how big the regions are and how often they contain the strike
+void bench_region(const char *name, const std::vector<PointLatLon> &stations)
+{
+    std::vector<PointLatLon> strikes = strike_grid(70, 80);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    Multilat multilat(stations);
+
+    double area = 0, error = 0;
+    long boxes = 0;
+    int contained = 0, coarsened = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < strikes.size(); i++) {
+        StrikeRegion region = multilat.locate_region(ranges[i]);
+        area += region.area;
+        boxes += region.boxes;
+        coarsened += region.resolution > 0.25;
+        error += d_haversine(region.centroid, strikes[i]);
+        contained += strikes[i].lat >= region.south_west.lat && strikes[i].lat <= region.north_east.lat
+                     && strikes[i].lon >= region.south_west.lon && strikes[i].lon <= region.north_east.lon;
+    }
+    double elapsed = seconds_since(start);
+
+    printf("%-20s %6zu fixes  %7.2f us/fix  %6.1f boxes/fix  mean area %7.1f km^2"
+           "  strike in box %5.1f%%  mean error %.2f km  %d coarsened\n",
+           name, strikes.size(), 1E6 * elapsed / strikes.size(), (double)boxes / strikes.size(),
+           area / strikes.size(), 100.0 * contained / strikes.size(), error / strikes.size(),
+           coarsened);
+}
+
+// A storm cell: strikes scattered around one point, located with and
+// without the fix cache
+void bench_fix_cache(const char *name, const std::vector<PointLatLon> &stations)
+{
+    Multilat multilat(stations);
+    FixCache cache;
+    int id = cache.add_station_set(&multilat);
+
+    auto start = std::chrono::steady_clock::now();
+    int tuples = cache.precompute(id);
+    double precompute = seconds_since(start);
+
+    std::vector<PointLatLon> strikes = random_points(20000, 33.70, -84.45, 0.1, 7);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+
+    start = std::chrono::steady_clock::now();
+    double sink = 0;
+    for (size_t i = 0; i < strikes.size(); i++) {
+        sink += multilat.locate_strike(ranges[i], SOLVER_LEVENBERG_MARQUARDT).location.lat;
+    }
+    double solve = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < strikes.size(); i++) {
+        sink += cache.locate(id, ranges[i]).location.lat;
+    }
+    double cached = seconds_since(start);
+    bench_sink = sink;
+
+    printf("%-20s precompute %d tuples in %.2f s  solve %6.2f us/fix  cached %5.2f us/fix"
+           "  hit rate %.1f%%\n",
+           name, tuples, precompute, 1E6 * solve / strikes.size(), 1E6 * cached / strikes.size(),
+           100.0 * cache.hits() / (cache.hits() + cache.misses()));
+}
+
+// Batch kernel against the scalar distance functions, near and far
+void check_distance_kernel()
+{
+    std::vector<PointLatLon> stations = random_points(301, 33.75, -84.4, 1.0, 1);
+    std::vector<PointLatLon> candidates = random_points(200, 33.75, -84.4, 2.0, 2);
+    std::vector<PointLatLon> far = random_points(200, 0, 0, 340.0, 3);
+    candidates.insert(candidates.end(), far.begin(), far.end());
+
+    StationTable table;
+    table.assign(stations);
+    std::vector<double> d(stations.size());
+    double max_hav = 0, max_equ = 0;
+    for (const PointLatLon &p : candidates) {
+        batch_haversine(table, p, d.data());
+        for (size_t i = 0; i < stations.size(); i++) {
+            max_hav = std::fmax(max_hav, std::fabs(d[i] - d_haversine(stations[i], p)));
+        }
+        batch_equirectangular(table, p, d.data());
+        for (size_t i = 0; i < stations.size(); i++) {
+            max_equ = std::fmax(max_equ, std::fabs(d[i] - d_equirectangular(stations[i], p)));
+        }
+    }
+    printf("kernel %-6s  max |batch - scalar|: haversine %.2e km, equirectangular %.2e km\n",
+           distance_kernel_isa(), max_hav, max_equ);
+}
+
+// One candidate against N stations: per-station scalar calls vs the batch kernel
+void bench_distance_kernel(int n)
+{
+    std::vector<PointLatLon> stations = random_points(n, 33.75, -84.4, 1.0, 4);
+    std::vector<PointLatLon> candidates = random_points(1024, 33.75, -84.4, 1.0, 5);
+    StationTable table;
+    table.assign(stations);
+    std::vector<double> d(n);
+    long calls = 3000000 / n + 1;
+
+    double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (long k = 0; k < calls; k++) {
+        const PointLatLon &p = candidates[k & 1023];
+        for (int i = 0; i < n; i++) {
+            d[i] = d_haversine(stations[i], p);
+        }
+        sink += d[k % n];
+    }
+    double scalar = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (long k = 0; k < calls; k++) {
+        batch_haversine(table, candidates[k & 1023], d.data());
+        sink += d[k % n];
+    }
+    double batch = seconds_since(start);
+
+    bench_sink = sink;
+    printf("haversine %3d stations  scalar %6.1f ns/station  batch %6.1f ns/station  %4.1fx\n",
+           n, 1E9 * scalar / (calls * n), 1E9 * batch / (calls * n), scalar / batch);
+}
+
+// Storm-rate reports with clock skew, delivery jitter and losses, pushed
+// through the correlator in arrival order
+void bench_correlator(double strikes_per_second)
+{
+    std::vector<PointLatLon> stations = station_grid();
+    const int strikes = 20000;
+    const long long skew = 50, jitter = 800;
+
+    struct Arrival
+    {
+        long long arrival;
+        StrikeReport report;
+        int strike;
+    };
+    std::vector<Arrival> arrivals;
+    std::vector<PointLatLon> locations = random_points(strikes, 33.75, -84.4, 0.8, 11);
+    unsigned seed = 12;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) / 16777216.0;
+    };
+    int solvable = 0;
+    for (int k = 0; k < strikes; k++) {
+        long long t = (long long)(1000.0 * k / strikes_per_second);
+        int reports = 0;
+        for (int i = 0; i < (int)stations.size(); i++) {
+            double d = d_haversine(stations[i], locations[k]);
+            if (d > 40 || next() < 0.05) {
+                continue;   // out of sensor range, or lost
+            }
+            long long stamp = t + (long long)((next() - 0.5) * skew);
+            long long arrival = stamp + (long long)(next() * jitter);
+            arrivals.push_back({arrival, {i, round_to_range_points(d), stamp}, k});
+            reports++;
+        }
+        solvable += reports >= 3;
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+                     [](const Arrival &a, const Arrival &b) { return a.arrival < b.arrival; });
+
+    // Which strike each (station, stamp) came from, to score the grouping
+    std::map<std::pair<int, long long>, int> origin;
+    for (const Arrival &a : arrivals) {
+        origin[std::make_pair(a.report.station, a.report.time)] = a.strike;
+    }
+
+    StrikeCorrelator correlator((int)stations.size(), skew, jitter + skew);
+    std::vector<StrikeJob> jobs;
+    correlator.on_job([&jobs](const StrikeJob &job) { jobs.push_back(job); });
+
+    size_t max_open = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Arrival &a : arrivals) {
+        correlator.add(a.report);
+        max_open = std::max(max_open, correlator.open_groups());
+    }
+    correlator.flush();
+    double elapsed = seconds_since(start);
+
+    int pure = 0;
+    for (const StrikeJob &job : jobs) {
+        int first = origin[std::make_pair(job.stations[0], job.times[0])];
+        bool same = true;
+        for (size_t i = 1; i < job.stations.size(); i++) {
+            same = same && origin[std::make_pair(job.stations[i], job.times[i])] == first;
+        }
+        pure += same;
+    }
+
+    printf("correlator %3.0f strikes/s  %6zu reports  %5.2f M reports/s  %5.1f%% of solvable"
+           " strikes emitted  %5.1f%% jobs from one strike  %ld late  max open %zu\n",
+           strikes_per_second, arrivals.size(), arrivals.size() / elapsed / 1E6,
+           100.0 * correlator.emitted() / solvable, 100.0 * pure / jobs.size(),
+           correlator.late(), max_open);
+}
+
+// Constant station density (one per ~15 x 15 km) over a growing area:
+// the registry's per-fix cost should not depend on the network size
+void bench_station_registry(int n)
+{
+    int side = (int)std::ceil(std::sqrt((double)n));
+    double spacing = 15 / (EARTH_RADIUS_KM * PI_ON_180);
+    std::vector<PointLatLon> jitter = random_points(n, 0, 0, spacing, 21);
+    StationRegistry registry;
+    std::vector<PointLatLon> all;
+    for (int k = 0; k < n; k++) {
+        PointLatLon p = {30 + spacing * (k / side) + jitter[k].lat,
+                         -90 + spacing * (k % side) / std::cos(30 * PI_ON_180) + jitter[k].lon};
+        registry.add(p);
+        all.push_back(p);
+    }
+
+    // Strikes inside the network, reported by every station within range
+    const int strikes = 200;
+    std::vector<PointLatLon> locations = random_points(strikes, 30 + 0.5 * spacing * side,
+                                                       -90 + 0.5 * spacing * side / std::cos(30 * PI_ON_180),
+                                                       0.8 * spacing * side, 22);
+    std::vector<StrikeJob> jobs(strikes);
+    for (int k = 0; k < strikes; k++) {
+        jobs[k].time = 0;
+        for (int i = 0; i < n; i++) {
+            double d = d_haversine(all[i], locations[k]);
+            if (d <= 40) {
+                jobs[k].stations.push_back(i);
+                jobs[k].ranges.push_back(round_to_range_points(d));
+                jobs[k].times.push_back(0);
+            }
+        }
+    }
+
+    double error = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < strikes; k++) {
+        error += d_haversine(registry.locate(jobs[k]).location, locations[k]);
+    }
+    double indexed = seconds_since(start);
+
+    // Baseline: every station in the objective, silent ones at 40 km
+    double full = 0;
+    if (n <= 1000) {
+        Multilat multilat(all);
+        std::vector<double> ranges(n);
+        start = std::chrono::steady_clock::now();
+        for (int k = 0; k < strikes; k++) {
+            std::fill(ranges.begin(), ranges.end(), as3935_range_points[0]);
+            for (size_t i = 0; i < jobs[k].stations.size(); i++) {
+                ranges[jobs[k].stations[i]] = jobs[k].ranges[i];
+            }
+            bench_sink = multilat.locate_strike(ranges, SOLVER_LEVENBERG_MARQUARDT).location.lat;
+        }
+        full = seconds_since(start);
+    }
+
+    char baseline[32] = "      skipped";
+    if (full > 0) {
+        snprintf(baseline, sizeof(baseline), "%7.1f us/fix", 1E6 * full / strikes);
+    }
+    printf("registry %5d stations  indexed %7.1f us/fix  all stations %s  mean error %.2f km\n",
+           n, 1E6 * indexed / strikes, baseline, error / strikes);
+}
+
+// Two storm cells drifting past the stations, strikes alternating between
+// them, located cold and with per-cell warm starts
+void bench_warm_locator(const char *name, const std::vector<PointLatLon> &stations,
+                        SolverMode mode)
+{
+    StationRegistry registry;
+    for (const PointLatLon &s : stations) {
+        registry.add(s);
+    }
+
+    const int strikes = 4000;
+    std::vector<PointLatLon> scatter = random_points(strikes, 0, 0, 0.03, 31);
+    std::vector<PointLatLon> locations(strikes);
+    std::vector<StrikeJob> jobs(strikes);
+    for (int k = 0; k < strikes; k++) {
+        // 30 km/h eastward at 5 strikes per second, cells 25 km apart
+        double drift = 30.0 * k / 5 / 3600 / (EARTH_RADIUS_KM * PI_ON_180);
+        double lat = k % 2 ? 33.65 : 33.85;
+        locations[k] = {lat + scatter[k].lat, -84.65 + drift + scatter[k].lon};
+        jobs[k].time = 200 * k;
+        for (int i = 0; i < (int)stations.size(); i++) {
+            double d = d_haversine(stations[i], locations[k]);
+            if (d <= 40) {
+                jobs[k].stations.push_back(i);
+                jobs[k].ranges.push_back(round_to_range_points(d));
+                jobs[k].times.push_back(jobs[k].time);
+            }
+        }
+    }
+
+    // Best of a few passes, the two paths differ by less than the noise
+    // of a single one
+    const int passes = 3;
+    long cold_evals = 0;
+    double cold_error = 0;
+    double cold = HUGE_VAL;
+    for (int pass = 0; pass < passes; pass++) {
+        cold_evals = 0;
+        cold_error = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < strikes; k++) {
+            StrikeFix fix = registry.locate(jobs[k], mode);
+            cold_evals += fix.evaluations;
+            cold_error += d_haversine(fix.location, locations[k]);
+        }
+        cold = std::fmin(cold, seconds_since(start));
+    }
+
+    long warm_evals = 0;
+    double warm_error = 0;
+    double warm = HUGE_VAL;
+    WarmLocator locator(&registry, mode);
+    for (int pass = 0; pass < passes; pass++) {
+        locator = WarmLocator(&registry, mode);
+        warm_evals = 0;
+        warm_error = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < strikes; k++) {
+            StrikeFix fix = locator.locate(jobs[k]);
+            warm_evals += fix.evaluations;
+            warm_error += d_haversine(fix.location, locations[k]);
+        }
+        warm = std::fmin(warm, seconds_since(start));
+    }
+
+    printf("%-10s cold %6.1f evals/fix %6.2f us/fix error %.2f km  warm %6.1f evals/fix"
+           " %6.2f us/fix error %.2f km  (%ld warm, %ld cold, %ld fallbacks)\n",
+           name, (double)cold_evals / strikes, 1E6 * cold / strikes, cold_error / strikes,
+           (double)warm_evals / strikes, 1E6 * warm / strikes, warm_error / strikes,
+           locator.warm_solves(), locator.cold_solves(), locator.fallbacks());
+    check(warm_error <= 1.1 * cold_error, "warm-started fixes are no less accurate than cold ones");
+    check(warm_evals <= cold_evals, "warm starts take no more evaluations than cold ones");
+}
+
+// An hour of strikes from storms 60 km apart drifting east at 40 km/h,
+// plus scattered strikes, clustered over a 10 minute window
+void bench_storm_cells(int storms, double strikes_per_minute)
+{
+    const long long window = 10 * 60 * 1000;
+    const int strikes = (int)(storms * strikes_per_minute * 60);
+    std::vector<PointLatLon> scatter = random_points(strikes, 0, 0, 0.1, 41);
+    std::vector<PointLatLon> background = random_points(strikes, 33.5, -84.0, 3.0, 43);
+
+    StormCellClusterer clusterer(5.0, 4, window);
+    size_t peak = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < strikes; k++) {
+        long long time = (long long)(k * 60000.0 / (storms * strikes_per_minute));
+        PointLatLon location;
+        if (k % 10 == 9) {
+            location = background[k];
+        } else {
+            double drift = 40.0 * time / 3600000.0 / (EARTH_RADIUS_KM * PI_ON_180);
+            location = {33.5 + 0.6 * (k % storms) + scatter[k].lat, -84.0 + drift + scatter[k].lon};
+        }
+        clusterer.insert(location, time);
+        peak = std::max(peak, clusterer.strikes());
+    }
+    double elapsed = seconds_since(start);
+
+    std::vector<StormCell> cells = clusterer.cells();
+    double rate = 0, extent = 0;
+    for (const StormCell &cell : cells) {
+        rate += cell.flash_rate;
+        extent += cell.extent;
+    }
+    printf("storms %2d at %4.0f/min  %6.2f us/strike  %2zu cells  mean rate %5.1f/min"
+           "  mean extent %5.1f km  peak %zu strikes kept\n",
+           storms, strikes_per_minute, 1E6 * elapsed / strikes, cells.size(),
+           cells.empty() ? 0 : rate / cells.size(), cells.empty() ? 0 : extent / cells.size(), peak);
+}
+
+// The same storm at 45 degrees, clustered fresh and after a strike far
+// south: cells and extents must not depend on where the first strike was
+void check_storm_cells_latitude()
+{
+    std::vector<PointLatLon> scatter = random_points(400, 45.0, -90.0, 0.1, 47);
+    double extents[2] = {0, 0};
+    size_t counts[2] = {0, 0};
+    for (int run = 0; run < 2; run++) {
+        StormCellClusterer clusterer(5.0, 4, 10 * 60 * 1000);
+        if (run == 1) {
+            clusterer.insert({33.0, -84.0}, 0);
+        }
+        for (size_t k = 0; k < scatter.size(); k++) {
+            clusterer.insert(scatter[k], 1000 + (long long)k * 1000);
+        }
+        for (const StormCell &cell : clusterer.cells()) {
+            if (cell.centroid.lat > 40) {
+                extents[run] += cell.extent;
+                counts[run]++;
+            }
+        }
+    }
+    printf("storms at 45 deg: %zu cells, extent %.2f km; after a strike at 33 deg: %zu cells, extent %.2f km\n",
+           counts[0], extents[0], counts[1], extents[1]);
+    check(counts[0] == counts[1] && std::fabs(extents[0] - extents[1]) <= 1E-6 * extents[0],
+          "storm cells independent of the first strike's latitude");
+}
+
+// Storm cells on straight tracks at 20-60 km/h, each heading for a point
+// it passes at a known miss distance. Strikes scatter 5 km around the cell
+// centre, one every 6 s per cell, for 40 minutes.
+template <typename Real>
+void bench_storm_tracker(const char *name, int tracks)
+{
+    const int steps = 400;
+    const long long interval = 6000;
+    std::vector<PointLatLon> params = random_points(tracks, 0.5, 0.5, 1.0, 51);
+    std::vector<PointLatLon> scatter = random_points(tracks * steps, 0, 0, 0.09, 53);
+    const PointLatLon user = {33.78, -84.40};
+    const double km_per_deg = EARTH_RADIUS_KM * PI_ON_180;
+    const double km_per_deg_lon = km_per_deg * std::cos(user.lat * PI_ON_180);
+
+    std::vector<StormTracker<Real>> trackers(tracks);
+    std::vector<double> vx(tracks), vy(tracks), miss(tracks), eta(tracks);
+    std::vector<double> x0(tracks), y0(tracks);
+    for (int t = 0; t < tracks; t++) {
+        double speed = 20 + 40 * params[t].lat;
+        double heading = 2 * M_PI * params[t].lon;
+        vx[t] = speed * std::cos(heading);
+        vy[t] = speed * std::sin(heading);
+        // Closest approach an hour after the start, 0-20 km to the side
+        miss[t] = 20 * params[t].lat;
+        eta[t] = 1.0;
+        x0[t] = -vx[t] * eta[t] - miss[t] * std::sin(heading);
+        y0[t] = -vy[t] * eta[t] + miss[t] * std::cos(heading);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int k = 0; k < steps; k++) {
+        double hours = k * interval / 3600000.0;
+        for (int t = 0; t < tracks; t++) {
+            const PointLatLon &d = scatter[(size_t)k * tracks + t];
+            PointLatLon fix = {user.lat + (y0[t] + vy[t] * hours) / km_per_deg + d.lat,
+                               user.lon + (x0[t] + vx[t] * hours) / km_per_deg_lon + d.lon};
+            trackers[t].update(fix, k * interval);
+        }
+    }
+    double elapsed = seconds_since(start);
+
+    double speed_error = 0, miss_error = 0, eta_error = 0;
+    double elapsed_hours = (steps - 1) * interval / 3600000.0;
+    for (int t = 0; t < tracks; t++) {
+        double ex = trackers[t].velocity_east() - vx[t];
+        double ey = trackers[t].velocity_north() - vy[t];
+        speed_error += std::sqrt(ex * ex + ey * ey);
+        StormApproach approach = trackers[t].closest_approach(user);
+        miss_error += std::fabs(approach.distance - miss[t]);
+        eta_error += std::fabs(approach.eta - (eta[t] - elapsed_hours));
+    }
+    printf("%-14s %5d tracks  %5.1f ns/update  velocity error %4.1f km/h"
+           "  miss error %4.2f km  eta error %4.1f min  sigma %.2f km\n",
+           name, tracks, 1E9 * elapsed / ((double)tracks * steps), speed_error / tracks,
+           miss_error / tracks, 60 * eta_error / tracks, (double)trackers[0].position_sigma());
+}
+
+// FPU-free engine against the double-precision Nelder-Mead fix. Where
+// every station heard the strike and the stations pin it down, the fixes
+// must agree within p95_km for 95% of strikes and max_km for all; with
+// three stations the fix is ambiguous along a ring and only printed.
+void bench_fixed_multilat(const char *name, const std::vector<PointLatLon> &stations,
+                          double max_worse, double p95_km = HUGE_VAL, double max_km = HUGE_VAL)
+{
+    std::vector<PointLatLon> strikes = strike_grid(70, 80);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+
+    std::vector<PointE6> stations_e6;
+    for (const PointLatLon &s : stations) {
+        stations_e6.push_back({(int32_t)std::lround(s.lat * 1E6), (int32_t)std::lround(s.lon * 1E6)});
+    }
+    FixedMultilat fixed;
+    fixed.set_stations(stations_e6.data(), (int)stations_e6.size());
+    std::vector<std::vector<uint8_t>> ranges_km(strikes.size());
+    for (size_t i = 0; i < strikes.size(); i++) {
+        for (double r : ranges[i]) {
+            ranges_km[i].push_back((uint8_t)r);
+        }
+    }
+
+    std::vector<PointLatLon> fixes(strikes.size());
+    std::vector<double> residuals(strikes.size());
+    long evaluations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < strikes.size(); i++) {
+        FixedStrikeFix fix = fixed.locate_strike(ranges_km[i].data());
+        fixes[i] = {fix.location.lat * 1E-6, fix.location.lon * 1E-6};
+        residuals[i] = fix.residual * 1E-3;
+        evaluations += fix.evaluations;
+    }
+    double elapsed = seconds_since(start);
+
+    Multilat multilat(stations);
+    std::vector<double> gaps;
+    double fixed_error = 0, double_error = 0;
+    int worse = 0;
+    for (size_t i = 0; i < strikes.size(); i++) {
+        StrikeFix fix = multilat.locate_strike(ranges[i], SOLVER_NELDER_MEAD);
+        worse += residuals[i] > fix.residual + 0.5;
+        if (*std::max_element(ranges[i].begin(), ranges[i].end()) < 40) {
+            gaps.push_back(d_haversine(fix.location, fixes[i]));
+        }
+        fixed_error += d_haversine(fixes[i], strikes[i]);
+        double_error += d_haversine(fix.location, strikes[i]);
+    }
+    std::sort(gaps.begin(), gaps.end());
+    double mean_gap = 0;
+    for (double g : gaps) {
+        mean_gap += g;
+    }
+
+    // Only strikes every station heard have a well-defined fix to compare;
+    // elsewhere the residual says whether the search found as good a point
+    printf("%-18s %7.2f us/fix  %6.1f evals/fix  vs double (%zu heard by all): mean %.3f"
+           "  p95 %.3f  max %.3f km  residual worse by 0.5 km: %d/%zu"
+           "  error %.2f km (double %.2f km)\n",
+           name, 1E6 * elapsed / strikes.size(), (double)evaluations / strikes.size(), gaps.size(),
+           mean_gap / gaps.size(), gaps[gaps.size() * 95 / 100], gaps.back(), worse, strikes.size(),
+           fixed_error / strikes.size(), double_error / strikes.size());
+    check(gaps[gaps.size() * 95 / 100] <= p95_km, "fixed vs double p95 gap within tolerance");
+    check(gaps.back() <= max_km, "fixed vs double max gap within tolerance");
+    check(worse <= max_worse * strikes.size(), "fixed residual within 0.5 km of double");
+    check(fixed_error <= 1.03 * double_error, "fixed mean error within 3% of double");
+}
+
+// Strikes inside the 28-station grid with some stations' reports replaced
+// by a wrong bin (a disturber, or a detector with a mis-set tuning cap)
+void bench_robust(int corrupted, ThreadPool *pool)
+{
+    std::vector<PointLatLon> stations = station_grid();
+    std::vector<PointLatLon> strikes = random_points(2000, 33.75, -84.4, 0.3, 61);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    std::vector<std::vector<int>> bad(strikes.size());
+    unsigned seed = 67;
+    for (size_t k = 0; k < strikes.size(); k++) {
+        while ((int)bad[k].size() < corrupted) {
+            seed = seed * 1103515245u + 12345u;
+            int i = (seed >> 8) % stations.size();
+            if (std::find(bad[k].begin(), bad[k].end(), i) != bad[k].end()) {
+                continue;
+            }
+            // Two to six bins away from the truth
+            int bin = range_bin_index(ranges[k][i]);
+            bin = bin < AS3935_RANGE_POINTS / 2 ? bin + 2 + (seed >> 4) % 5 : bin - 2 - (seed >> 4) % 5;
+            ranges[k][i] = as3935_range_points[std::max(0, std::min(AS3935_RANGE_POINTS - 1, bin))];
+            bad[k].push_back(i);
+        }
+    }
+
+    Multilat multilat(stations);
+    double plain_error = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        StrikeFix fix = multilat.locate_strike(ranges[k], SOLVER_LEVENBERG_MARQUARDT);
+        plain_error += d_haversine(fix.location, strikes[k]);
+    }
+    double plain = seconds_since(start);
+
+    double robust_error = 0;
+    long found = 0, false_alarms = 0, subsets = 0;
+    std::vector<int> rejected;
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        StrikeFix fix = multilat.locate_robust(ranges[k], &rejected, SOLVER_LEVENBERG_MARQUARDT, pool);
+        robust_error += d_haversine(fix.location, strikes[k]);
+        subsets += fix.evaluations;
+        for (int i : rejected) {
+            if (std::find(bad[k].begin(), bad[k].end(), i) != bad[k].end()) {
+                found++;
+            } else {
+                false_alarms++;
+            }
+        }
+    }
+    double robust = seconds_since(start);
+
+    printf("robust %d bad %s  plain %6.1f us/fix error %5.2f km  robust %6.1f us/fix (%.1fx)"
+           " error %5.2f km  rejected %5.1f%% of bad, %.2f good/fix  (evals incl. subsets %.0f/fix)\n",
+           corrupted, pool ? "pool  " : "serial", 1E6 * plain / strikes.size(), plain_error / strikes.size(),
+           1E6 * robust / strikes.size(), robust / plain, robust_error / strikes.size(),
+           corrupted ? 100.0 * found / (corrupted * strikes.size()) : 100.0,
+           (double)false_alarms / strikes.size(), (double)subsets / strikes.size());
+}
+
+// StaticMultilat<N> against Multilat over the same N stations and strikes
+template <int N>
+void bench_static_multilat(SolverMode mode)
+{
+    std::vector<PointLatLon> stations = random_points(N, 33.75, -84.4, 0.3, 71 + N);
+    std::vector<PointLatLon> strikes = random_points(5000, 33.75, -84.4, 0.5, 73);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    std::vector<std::array<double, N>> fixed_ranges(strikes.size());
+    for (size_t k = 0; k < strikes.size(); k++) {
+        std::copy(ranges[k].begin(), ranges[k].end(), fixed_ranges[k].begin());
+    }
+
+    Multilat multilat(stations);
+    std::vector<PointLatLon> dynamic_fixes(strikes.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        dynamic_fixes[k] = multilat.locate_strike(ranges[k], mode).location;
+    }
+    double dynamic = seconds_since(start);
+
+    StaticMultilat<N> fixed(stations);
+    double max_gap = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        StrikeFix fix = fixed.locate_strike(fixed_ranges[k], mode);
+        bench_sink = fix.location.lat;
+        max_gap = std::fmax(max_gap, d_haversine(fix.location, dynamic_fixes[k]));
+    }
+    double templated = seconds_since(start);
+
+    printf("static N=%d %s  dynamic %6.2f us/fix  static %6.2f us/fix  %.2fx  max gap %.1e km\n",
+           N, mode == SOLVER_NELDER_MEAD ? "nm" : "lm", 1E6 * dynamic / strikes.size(),
+           1E6 * templated / strikes.size(), dynamic / templated, max_gap);
+}
+
+// Whether the error ellipse tells good fixes from bad ones, and what it costs
+void bench_uncertainty(const char *name, const std::vector<PointLatLon> &stations, SolverMode mode)
+{
+    std::vector<PointLatLon> strikes = strike_grid(70, 80);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    Multilat multilat(stations);
+
+    const double km_per_deg = EARTH_RADIUS_KM * PI_ON_180;
+    int inside = 0, calibrated = 0, tight = 0, loose = 0;
+    double tight_error = 0, loose_error = 0;
+    std::vector<PointLatLon> fixes;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        StrikeFix fix = multilat.locate_strike(ranges[k], mode);
+        fixes.push_back(fix.location);
+        const ErrorEllipse &e = fix.uncertainty;
+        double error = d_haversine(fix.location, strikes[k]);
+
+        // Mahalanobis distance of the truth, inside the 95% ellipse if <= 5.99
+        double de = (strikes[k].lon - fix.location.lon) * km_per_deg * std::cos(fix.location.lat * PI_ON_180);
+        double dn = (strikes[k].lat - fix.location.lat) * km_per_deg;
+        double det = e.cov_ee * e.cov_nn - e.cov_en * e.cov_en;
+        if (!e.lower_bound) {
+            calibrated++;
+            if (e.semi_major == HUGE_VAL
+                || (e.cov_nn * de * de - 2 * e.cov_en * de * dn + e.cov_ee * dn * dn) / det <= 5.99) {
+                inside++;
+            }
+        }
+        if (e.semi_major < 2) {
+            tight++;
+            tight_error += error;
+        } else if (e.semi_major > 5) {
+            loose++;
+            loose_error += error;
+        }
+    }
+    double solve = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        bench_sink = multilat.uncertainty(fixes[k], ranges[k].data()).semi_major;
+    }
+    double ellipse = seconds_since(start);
+
+    // Only fixes with a redundant report claim calibration (ErrorEllipse)
+    double coverage = calibrated ? (double)inside / calibrated : 1;
+    printf("%-18s truth in 95%% ellipse %5.1f%% of %3zu%% calibrated  major < 2 km: %4zu%% of fixes, error %5.2f km"
+           "  major > 5 km: %4zu%%, error %5.2f km  ellipse cost %.1f%% of the solve\n",
+           name, 100 * coverage, 100 * calibrated / strikes.size(), 100 * tight / strikes.size(),
+           tight ? tight_error / tight : 0, 100 * loose / strikes.size(), loose ? loose_error / loose : 0,
+           100 * ellipse / solve);
+    check(coverage >= 0.95, "95% error ellipse covers the truth on 95% of calibrated fixes");
+}
+
+// Largest |model - reference| (km) over station/point pairs
+template <typename Distance>
+double distance_model_error(const std::vector<PointLatLon> &from, const std::vector<PointLatLon> &to,
+                            const std::vector<long double> &reference)
+{
+    double worst = 0;
+    for (size_t k = 0; k < to.size(); k++) {
+        typename Distance::Point p = Distance::point(to[k].lat * PI_ON_180, to[k].lon * PI_ON_180);
+        double d = Distance::distance(Distance::station(from[k]), p);
+        worst = std::fmax(worst, (double)std::fabs(d - reference[k]));
+    }
+    return worst;
+}
+
+// One point against 8 stations, point terms included: ns per distance
+template <typename Distance>
+double distance_model_cost(const std::vector<PointLatLon> &stations, const std::vector<PointLatLon> &points)
+{
+    std::vector<typename Distance::Station> table;
+    for (const PointLatLon &s : stations) {
+        table.push_back(Distance::station(s));
+    }
+    double sink = 0;
+    const int rounds = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (const PointLatLon &q : points) {
+            typename Distance::Point p = Distance::point(q.lat * PI_ON_180, q.lon * PI_ON_180);
+            for (const typename Distance::Station &s : table) {
+                sink += Distance::distance(s, p);
+            }
+        }
+    }
+    bench_sink = sink;
+    return 1E9 * seconds_since(start) / ((double)rounds * points.size() * table.size());
+}
+
+template <typename Distance>
+void distance_model_fixes(const char *name, const std::vector<PointLatLon> &stations,
+                          const std::vector<PointLatLon> &strikes,
+                          const std::vector<std::vector<double>> &ranges)
+{
+    StaticMultilat<6, Distance> multilat(stations);
+    std::array<double, 6> r;
+    double error = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        std::copy(ranges[k].begin(), ranges[k].end(), r.begin());
+        error += d_haversine(multilat.locate_strike(r, SOLVER_LEVENBERG_MARQUARDT).location, strikes[k]);
+    }
+    printf("  %-16s 6 stations lm %6.2f us/fix  mean error %.3f km\n",
+           name, 1E6 * seconds_since(start) / strikes.size(), error / strikes.size());
+}
+
+// Accuracy/speed table of the StaticMultilat distance policies over 1-60 km,
+// against a long double haversine on the same sphere
+void bench_distance_models()
+{
+    std::vector<PointLatLon> stations = random_points(8, 33.75, -84.4, 0.3, 81);
+    const double ranges_km[] = {1, 2, 5, 10, 20, 40, 60};
+    printf("distance models   max |error| (m) against long double haversine\n");
+    printf("  %6s %12s %12s %12s\n", "km", "haversine", "equirect", "ecef");
+    std::vector<PointLatLon> all_points;
+    for (double range : ranges_km) {
+        // Points at exactly this range from a station, every bearing
+        std::vector<PointLatLon> from, to;
+        std::vector<long double> reference;
+        for (int k = 0; k < 2000; k++) {
+            const PointLatLon &s = stations[k % stations.size()];
+            long double bearing = 2 * M_PI * k / 2000.0L;
+            long double angle = range / EARTH_RADIUS_KM;
+            long double lat1 = s.lat * PI_ON_180, lon1 = s.lon * PI_ON_180;
+            long double lat2 = std::asin(std::sin(lat1) * std::cos(angle)
+                                         + std::cos(lat1) * std::sin(angle) * std::cos(bearing));
+            long double lon2 = lon1 + std::atan2(std::sin(bearing) * std::sin(angle) * std::cos(lat1),
+                                                 std::cos(angle) - std::sin(lat1) * std::sin(lat2));
+            PointLatLon p = {(double)(lat2 / PI_ON_180), (double)(lon2 / PI_ON_180)};
+
+            // The point was rounded to double, so measure the reference again
+            long double plat = p.lat * (long double)PI_ON_180, plon = p.lon * (long double)PI_ON_180;
+            long double sin_dlat = std::sin(0.5L * (plat - lat1)), sin_dlon = std::sin(0.5L * (plon - lon1));
+            long double a = sin_dlat * sin_dlat + std::cos(lat1) * std::cos(plat) * sin_dlon * sin_dlon;
+            reference.push_back(2 * EARTH_RADIUS_KM * std::asin(std::sqrt(a)));
+            from.push_back(s);
+            to.push_back(p);
+        }
+        all_points.insert(all_points.end(), to.begin(), to.end());
+        printf("  %6.0f %12.2e %12.2e %12.2e\n", range,
+               1E3 * distance_model_error<HaversineDistance>(from, to, reference),
+               1E3 * distance_model_error<EquirectangularDistance>(from, to, reference),
+               1E3 * distance_model_error<EcefDistance>(from, to, reference));
+    }
+    printf("  %6s %9.1f ns %9.1f ns %9.1f ns  per distance, 8 stations per point\n", "cost",
+           distance_model_cost<HaversineDistance>(stations, all_points),
+           distance_model_cost<EquirectangularDistance>(stations, all_points),
+           distance_model_cost<EcefDistance>(stations, all_points));
+
+    std::vector<PointLatLon> six(stations.begin(), stations.begin() + 6);
+    std::vector<PointLatLon> strikes = random_points(5000, 33.75, -84.4, 0.5, 83);
+    std::vector<std::vector<double>> ranges = rounded_ranges(six, strikes);
+    distance_model_fixes<HaversineDistance>("haversine", six, strikes, ranges);
+    distance_model_fixes<EquirectangularDistance>("equirectangular", six, strikes, ranges);
+    distance_model_fixes<EcefDistance>("ecef", six, strikes, ranges);
+}
+
+// Many independent LM solves: a loop over locate_strike against
+// locate_batch with one strike per lane, serial and on the pool
+void bench_batch(const char *name, const std::vector<PointLatLon> &stations, ThreadPool *pool)
+{
+    std::vector<PointLatLon> strikes = random_points(20000, 33.75, -84.4, 0.6, 91);
+    std::vector<std::vector<double>> ranges = rounded_ranges(stations, strikes);
+    Multilat multilat(stations);
+    const int n = (int)stations.size();
+    StrikeBatch batch = {(int)strikes.size(), std::vector<double>((size_t)n * strikes.size())};
+    for (size_t k = 0; k < strikes.size(); k++) {
+        for (int i = 0; i < n; i++) {
+            batch.ranges[(size_t)i * strikes.size() + k] = ranges[k][i];
+        }
+    }
+
+    std::vector<StrikeFix> loop(strikes.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < strikes.size(); k++) {
+        loop[k] = multilat.locate_strike(ranges[k], SOLVER_LEVENBERG_MARQUARDT);
+    }
+    double looped = seconds_since(start);
+
+    FixBatch serial, pooled;
+    start = std::chrono::steady_clock::now();
+    multilat.locate_batch(batch, &serial);
+    double lanes = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    multilat.locate_batch(batch, &pooled, SOLVER_LEVENBERG_MARQUARDT, pool);
+    double threaded = seconds_since(start);
+
+    double max_gap = 0;
+    int same_evaluations = 0;
+    for (size_t k = 0; k < strikes.size(); k++) {
+        PointLatLon a = {serial.lat[k], serial.lon[k]}, b = {pooled.lat[k], pooled.lon[k]};
+        max_gap = std::fmax(max_gap, d_haversine(a, loop[k].location));
+        max_gap = std::fmax(max_gap, d_haversine(a, b));
+        same_evaluations += serial.evaluations[k] == loop[k].evaluations;
+    }
+    printf("%-18s loop %6.2f us/fix  batch %6.2f us/fix (%4.2fx)  %d threads %6.2f us/fix (%4.2fx)"
+           "  max gap %.1e km, same path %.1f%%\n",
+           name, 1E6 * looped / strikes.size(), 1E6 * lanes / strikes.size(), looped / lanes,
+           pool->size(), 1E6 * threaded / strikes.size(), looped / threaded, max_gap,
+           100.0 * same_evaluations / strikes.size());
+}
+
+// Objective heatmap: per-cell calls, as multi_algo.py's map, against the
+// tiled rasterizer on one thread and on the pool
+void bench_objective_surface(const char *name, const std::vector<PointLatLon> &stations,
+                             DistanceModel model, ThreadPool *pool)
+{
+    Multilat multilat(stations);
+    multilat.distance_model = model;
+    StationTable table;
+    table.assign(stations);
+    PointLatLon strike = {33.641154, -84.435819};
+    std::vector<double> ranges;
+    for (const PointLatLon &s : stations) {
+        ranges.push_back(round_to_range_points(d_haversine(s, strike)));
+    }
+
+    RasterGrid grid = {{33.3, -85.0}, 0.001, 0.001, 700, 1000};
+    size_t cells = (size_t)grid.rows * grid.cols;
+    std::vector<float> per_cell(cells), tiled(cells), threaded(cells);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < grid.rows; r++) {
+        for (int c = 0; c < grid.cols; c++) {
+            PointLatLon p = {grid.origin.lat + r * grid.step_lat, grid.origin.lon + c * grid.step_lon};
+            per_cell[(size_t)r * grid.cols + c] = (float)multilat.objective(p, ranges.data());
+        }
+    }
+    double scalar = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    rasterize_objective(table, model, ranges.data(), grid, tiled.data());
+    double one = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    rasterize_objective(table, model, ranges.data(), grid, threaded.data(), pool);
+    double many = seconds_since(start);
+
+    double max_diff = 0;
+    for (size_t k = 0; k < cells; k++) {
+        max_diff = std::fmax(max_diff, std::fabs(tiled[k] - per_cell[k]) / std::fmax(1.0, per_cell[k]));
+        max_diff = std::fmax(max_diff, std::fabs(threaded[k] - tiled[k]));
+    }
+    printf("%-18s %zu cells  per cell %6.1f ns  tiled %5.1f ns (%4.1fx)  %d threads %5.1f ns (%4.1fx)"
+           "  max rel diff %.1e\n",
+           name, cells, 1E9 * scalar / cells, 1E9 * one / cells, scalar / one,
+           pool->size(), 1E9 * many / cells, scalar / many, max_diff);
+}
+
+} // namespace
+
+int main()
+{
+    check_distance_kernel();
+    bench_distance_kernel(3);
+    bench_distance_kernel(30);
+    bench_distance_kernel(300);
+    bench_solver("nm haversine x0", campus_stations, DISTANCE_HAVERSINE, SOLVER_NELDER_MEAD, false);
+    bench_solver("nm haversine", campus_stations, DISTANCE_HAVERSINE, SOLVER_NELDER_MEAD);
+    bench_solver("lm haversine x0", campus_stations, DISTANCE_HAVERSINE, SOLVER_LEVENBERG_MARQUARDT, false);
+    bench_solver("lm haversine", campus_stations, DISTANCE_HAVERSINE, SOLVER_LEVENBERG_MARQUARDT);
+    compare_solver_modes(campus_stations, DISTANCE_HAVERSINE, 0.01, 1.5);
+    bench_region("interval", campus_stations);
+    bench_solver("nm equirect", campus_stations, DISTANCE_EQUIRECTANGULAR, SOLVER_NELDER_MEAD);
+    bench_solver("lm equirect", campus_stations, DISTANCE_EQUIRECTANGULAR, SOLVER_LEVENBERG_MARQUARDT);
+    compare_solver_modes(campus_stations, DISTANCE_EQUIRECTANGULAR, 0.01, 1.5);
+
+    std::vector<PointLatLon> grid = station_grid();
+    bench_solver("nm 28 stations x0", grid, DISTANCE_HAVERSINE, SOLVER_NELDER_MEAD, false);
+    bench_solver("nm 28 stations", grid, DISTANCE_HAVERSINE, SOLVER_NELDER_MEAD);
+    bench_solver("lm 28 stations x0", grid, DISTANCE_HAVERSINE, SOLVER_LEVENBERG_MARQUARDT, false);
+    bench_solver("lm 28 stations", grid, DISTANCE_HAVERSINE, SOLVER_LEVENBERG_MARQUARDT);
+    compare_solver_modes(grid, DISTANCE_HAVERSINE, 0.1, 5);
+    compare_solver_modes(grid, DISTANCE_EQUIRECTANGULAR, 0.1, 5);
+    bench_region("interval 28 stations", grid);
+
+    bench_fix_cache("cache 3 stations", campus_stations);
+    bench_fix_cache("cache 28 stations", grid);
+
+    bench_correlator(1);
+    bench_correlator(5);
+    bench_correlator(10);
+
+    bench_station_registry(10);
+    bench_station_registry(100);
+    bench_station_registry(1000);
+    bench_station_registry(10000);
+
+    bench_warm_locator("warm nm 3", campus_stations, SOLVER_NELDER_MEAD);
+    bench_warm_locator("warm lm 3", campus_stations, SOLVER_LEVENBERG_MARQUARDT);
+    bench_warm_locator("warm nm 28", grid, SOLVER_NELDER_MEAD);
+    bench_warm_locator("warm lm 28", grid, SOLVER_LEVENBERG_MARQUARDT);
+
+    check_storm_cells_latitude();
+    bench_storm_cells(1, 10);
+    bench_storm_cells(4, 30);
+    bench_storm_cells(4, 300);
+
+    bench_storm_tracker<double>("tracker double", 10);
+    bench_storm_tracker<double>("tracker double", 5000);
+    bench_storm_tracker<float>("tracker float", 5000);
+
+    std::vector<PointLatLon> grid16;
+    for (const PointLatLon &s : grid) {
+        if (s.lon < -84.35) {
+            grid16.push_back(s);
+        }
+    }
+    bench_uncertainty("ellipse lm 3", campus_stations, SOLVER_LEVENBERG_MARQUARDT);
+    bench_uncertainty("ellipse lm 28", grid, SOLVER_LEVENBERG_MARQUARDT);
+    bench_uncertainty("ellipse nm 28", grid, SOLVER_NELDER_MEAD);
+
+    bench_static_multilat<3>(SOLVER_NELDER_MEAD);
+    bench_static_multilat<3>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_static_multilat<4>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_static_multilat<5>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_static_multilat<6>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_static_multilat<7>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_static_multilat<8>(SOLVER_NELDER_MEAD);
+    bench_static_multilat<8>(SOLVER_LEVENBERG_MARQUARDT);
+    bench_distance_models();
+
+    ThreadPool pool;
+    bench_robust(0, nullptr);
+    bench_robust(1, nullptr);
+    bench_robust(3, nullptr);
+    bench_robust(3, &pool);
+
+    bench_batch("batch lm 3", campus_stations, &pool);
+    bench_batch("batch lm 28", grid, &pool);
+
+    bench_objective_surface("surface 3", campus_stations, DISTANCE_HAVERSINE, &pool);
+    bench_objective_surface("surface 28", grid, DISTANCE_HAVERSINE, &pool);
+    bench_objective_surface("surface 28 equirect", grid, DISTANCE_EQUIRECTANGULAR, &pool);
+
+#ifdef MULTILAT_FLOAT
+    bench_fixed_multilat("float 3 stations", campus_stations, 0.001);
+    bench_fixed_multilat("float 16 stations", grid16, 0.02, 0.1, 1.0);
+#else
+    bench_fixed_multilat("fixed 3 stations", campus_stations, 0.001);
+    bench_fixed_multilat("fixed 16 stations", grid16, 0.02, 0.1, 1.0);
+#endif
+
+    if (failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,21 @@
+# Times multi_algo.locate_strike on the scenario used by bench.cc
+import time
+
+from multi_algo import LatLonPoint, d_haversine, round_to_range_points, locate_strike
+
+station_locations = [LatLonPoint(lat=33.778662, lon=-84.408694),
+                     LatLonPoint(lat=33.769620, lon=-84.390898),
+                     LatLonPoint(lat=33.781994, lon=-84.402854)]
+
+strikes = [LatLonPoint(33.5 + 0.01 * r, -84.8 + 0.01 * c) for r in range(70) for c in range(80)]
+strikes = strikes[::20]  # a subset is enough to get a stable rate
+
+start = time.perf_counter()
+error = 0
+for strike in strikes:
+    ranges = [round_to_range_points(d_haversine(s, strike)) for s in station_locations]
+    ans = locate_strike(station_locations, ranges)
+    error += d_haversine(ans, strike)
+elapsed = time.perf_counter() - start
+
+print(f"locate_strike   {len(strikes):6d} fixes  {len(strikes) / elapsed:9.0f} fixes/s  mean error {error / len(strikes):.2f} km")
@@ -0,0 +1,42 @@
+// Same scenario as the __main__ block of multi_algo.py, without the plots
+
+#include <cstdio>
+#include <vector>
+
+#include "multilat.h"
+
+int main()
+{
+    std::vector<PointLatLon> station_locations = {
+        {33.778662, -84.408694},    // 935 apartment
+        {33.769620, -84.390898},    // nav east apartment
+        {33.781994, -84.402854},    // center street house
+    };
+    PointLatLon strike_location = {33.641154, -84.435819};  // Bobby Jones Golf Course
+    printf("Strike Location Exact: (%f, %f)\n", strike_location.lat, strike_location.lon);
+
+    std::vector<double> station_ranges_haversine;
+    std::vector<double> station_ranges_rounded;
+    for (const PointLatLon &station : station_locations) {
+        double range = d_haversine(station, strike_location);
+        station_ranges_haversine.push_back(range);
+        station_ranges_rounded.push_back(round_to_range_points(range));
+    }
+    printf("Station Ranges Exact: [%f, %f, %f]\n", station_ranges_haversine[0],
+           station_ranges_haversine[1], station_ranges_haversine[2]);
+
+    Multilat multilat(station_locations);
+    StrikeFix ans = multilat.locate_strike(station_ranges_rounded);
+    printf("Predicted Strike Location: (%f, %f)\n", ans.location.lat, ans.location.lon);
+    printf("Residual: %f km, %d iterations, %d evaluations\n", ans.residual,
+           ans.iterations, ans.evaluations);
+    printf("Predicted Strike Location Error: %f\n", d_haversine(ans.location, strike_location));
+    printf("Error Ellipse (1 sigma): %.2f x %.2f km, major axis at %.0f deg\n",
+           ans.uncertainty.semi_major, ans.uncertainty.semi_minor, ans.uncertainty.orientation);
+
+    StrikeFix lm = multilat.locate_strike(station_ranges_rounded, SOLVER_LEVENBERG_MARQUARDT);
+    printf("Levenberg-Marquardt: (%f, %f), residual %f km, %d evaluations, error %f\n",
+           lm.location.lat, lm.location.lon, lm.residual, lm.evaluations,
+           d_haversine(lm.location, strike_location));
+    return 0;
+}
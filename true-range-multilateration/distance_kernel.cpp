@@ -0,0 +1,270 @@
+#include "distance_kernel.h"
+
+#include <cmath>
+
+#include "simd_ops.h"
+
+void StationTable::assign(const std::vector<PointLatLon> &station_locations)
+{
+    size_t n = station_locations.size();
+    lat_rad.resize(n);
+    lon_rad.resize(n);
+    cos_lat.resize(n);
+    sin_half_lat.resize(n);
+    cos_half_lat.resize(n);
+    sin_half_lon.resize(n);
+    cos_half_lon.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        lat_rad[i] = station_locations[i].lat * PI_ON_180;
+        lon_rad[i] = station_locations[i].lon * PI_ON_180;
+        cos_lat[i] = std::cos(lat_rad[i]);
+        sin_half_lat[i] = std::sin(0.5 * lat_rad[i]);
+        cos_half_lat[i] = std::cos(0.5 * lat_rad[i]);
+        sin_half_lon[i] = std::sin(0.5 * lon_rad[i]);
+        cos_half_lon[i] = std::cos(0.5 * lon_rad[i]);
+    }
+}
+
+namespace {
+
+/*
+ * Per-point quantities shared by every station. The angle-sum identities
+ * turn sin((p - s) / 2) into sin(p/2) cos(s/2) - cos(p/2) sin(s/2), and
+ * cos((p + s) / 2) into cos(p/2) cos(s/2) - sin(p/2) sin(s/2).
+ */
+struct PointTrig
+{
+    explicit PointTrig(const PointLatLon &point)
+    {
+        lat = point.lat * PI_ON_180;
+        lon = point.lon * PI_ON_180;
+        cos_lat = std::cos(lat);
+        sin_half_lat = std::sin(0.5 * lat);
+        cos_half_lat = std::cos(0.5 * lat);
+        sin_half_lon = std::sin(0.5 * lon);
+        cos_half_lon = std::cos(0.5 * lon);
+    }
+
+    double lat, lon, cos_lat;
+    double sin_half_lat, cos_half_lat, sin_half_lon, cos_half_lon;
+};
+
+/*
+ * Running sums of the reweighted normal equations, one per vector lane
+ */
+template <typename Ops>
+struct NormalSums
+{
+    typedef typename Ops::V V;
+
+    NormalSums() : a00(Ops::set1(0.0)), a01(a00), a11(a00), b0(a00), b1(a00) {}
+
+    // Adds stations with range errors r and gradients g, weighted by 1 / max(|r|, floor)
+    void add(V r, V g_lat, V g_lon, double floor)
+    {
+        V w = Ops::div(Ops::set1(1.0), Ops::max(Ops::abs(r), Ops::set1(floor)));
+        V w_lat = Ops::mul(w, g_lat), w_lon = Ops::mul(w, g_lon);
+        a00 = Ops::add(a00, Ops::mul(w_lat, g_lat));
+        a01 = Ops::add(a01, Ops::mul(w_lat, g_lon));
+        a11 = Ops::add(a11, Ops::mul(w_lon, g_lon));
+        b0 = Ops::add(b0, Ops::mul(w_lat, r));
+        b1 = Ops::add(b1, Ops::mul(w_lon, r));
+    }
+
+    void sum_into(double *jtj, double *jtr) const
+    {
+        jtj[0] += Ops::hsum(a00);
+        jtj[1] += Ops::hsum(a01);
+        jtj[2] += Ops::hsum(a11);
+        jtr[0] += Ops::hsum(b0);
+        jtr[1] += Ops::hsum(b1);
+    }
+
+    V a00, a01, a11, b0, b1;
+};
+
+/*
+ * Haversine distance and its gradient w.r.t. the point in km per degree,
+ * as station_range_gradient (solvers.h). sin(dlat) and sin(dlon) come from
+ * the half angles: sin(x) = 2 sin(x/2) cos(x/2).
+ */
+template <typename Ops>
+typename Ops::V haversine_gradient_block(const StationTable &s, const PointTrig &p, int i,
+                                         typename Ops::V *g_lat, typename Ops::V *g_lon)
+{
+    typedef typename Ops::V V;
+    V sl = Ops::set1(p.sin_half_lat), cl = Ops::set1(p.cos_half_lat);
+    V so = Ops::set1(p.sin_half_lon), co = Ops::set1(p.cos_half_lon);
+    V sh = Ops::load(&s.sin_half_lat[i]), ch = Ops::load(&s.cos_half_lat[i]);
+    V sho = Ops::load(&s.sin_half_lon[i]), cho = Ops::load(&s.cos_half_lon[i]);
+    V station_cos_lat = Ops::load(&s.cos_lat[i]);
+    V zero = Ops::set1(0.0), one = Ops::set1(1.0);
+
+    V sin_half_dlat = Ops::sub(Ops::mul(sl, ch), Ops::mul(cl, sh));
+    V cos_half_dlat = Ops::add(Ops::mul(cl, ch), Ops::mul(sl, sh));
+    V sin_half_dlon = Ops::sub(Ops::mul(so, cho), Ops::mul(co, sho));
+    V cos_half_dlon = Ops::add(Ops::mul(co, cho), Ops::mul(so, sho));
+    V cos_product = Ops::mul(station_cos_lat, Ops::set1(p.cos_lat));
+    V sin_sq_dlon = Ops::mul(sin_half_dlon, sin_half_dlon);
+    V a = Ops::add(Ops::mul(sin_half_dlat, sin_half_dlat), Ops::mul(cos_product, sin_sq_dlon));
+    a = Ops::min(a, one);
+    V d = Ops::mul(Ops::set1(2.0 * EARTH_RADIUS_KM), Ops::asin(Ops::sqrt(a)));
+
+    // Zero gradient on top of the station or its antipode, as the scalar code
+    V denom = Ops::sqrt(Ops::mul(a, Ops::sub(one, a)));
+    V defined = Ops::greater(denom, 1E-15);
+    V scale = Ops::div(Ops::set1(EARTH_RADIUS_KM * PI_ON_180), Ops::max(denom, Ops::set1(1E-15)));
+    V sin_lat = Ops::set1(2 * p.sin_half_lat * p.cos_half_lat);
+    V da_dlat = Ops::sub(Ops::mul(sin_half_dlat, cos_half_dlat),
+                         Ops::mul(Ops::mul(station_cos_lat, sin_lat), sin_sq_dlon));
+    V da_dlon = Ops::mul(cos_product, Ops::mul(sin_half_dlon, cos_half_dlon));
+    *g_lat = Ops::blend(zero, Ops::mul(scale, da_dlat), defined);
+    *g_lon = Ops::blend(zero, Ops::mul(scale, da_dlon), defined);
+    return d;
+}
+
+/*
+ * Equirectangular distance and its gradient, as station_range_gradient;
+ * the cosine and sine of the mean latitude come from the half angles
+ */
+template <typename Ops>
+typename Ops::V equirectangular_gradient_block(const StationTable &s, const PointTrig &p, int i,
+                                               typename Ops::V *g_lat, typename Ops::V *g_lon)
+{
+    typedef typename Ops::V V;
+    V sh = Ops::load(&s.sin_half_lat[i]), ch = Ops::load(&s.cos_half_lat[i]);
+    V cos_mid = Ops::sub(Ops::mul(Ops::set1(p.cos_half_lat), ch), Ops::mul(Ops::set1(p.sin_half_lat), sh));
+    V sin_mid = Ops::add(Ops::mul(Ops::set1(p.sin_half_lat), ch), Ops::mul(Ops::set1(p.cos_half_lat), sh));
+    V dlon = Ops::sub(Ops::set1(p.lon), Ops::load(&s.lon_rad[i]));
+    V x = Ops::mul(dlon, cos_mid);
+    V y = Ops::sub(Ops::set1(p.lat), Ops::load(&s.lat_rad[i]));
+    V norm = Ops::sqrt(Ops::add(Ops::mul(x, x), Ops::mul(y, y)));
+
+    // Zero distance and gradient on top of the station, as the scalar code
+    V zero = Ops::set1(0.0);
+    V defined = Ops::greater(norm, 1E-12);
+    V scale = Ops::div(Ops::set1(EARTH_RADIUS_KM * PI_ON_180), Ops::max(norm, Ops::set1(1E-12)));
+    V d_lat = Ops::sub(y, Ops::mul(Ops::mul(Ops::set1(0.5), x), Ops::mul(dlon, sin_mid)));
+    *g_lat = Ops::blend(zero, Ops::mul(scale, d_lat), defined);
+    *g_lon = Ops::blend(zero, Ops::mul(scale, Ops::mul(x, cos_mid)), defined);
+    return Ops::blend(zero, Ops::mul(Ops::set1(EARTH_RADIUS_KM), norm), defined);
+}
+
+template <typename Ops>
+typename Ops::V haversine_block(const StationTable &s, const PointTrig &p, int i)
+{
+    typedef typename Ops::V V;
+    V sin_dlat = Ops::sub(Ops::mul(Ops::set1(p.sin_half_lat), Ops::load(&s.cos_half_lat[i])),
+                          Ops::mul(Ops::set1(p.cos_half_lat), Ops::load(&s.sin_half_lat[i])));
+    V sin_dlon = Ops::sub(Ops::mul(Ops::set1(p.sin_half_lon), Ops::load(&s.cos_half_lon[i])),
+                          Ops::mul(Ops::set1(p.cos_half_lon), Ops::load(&s.sin_half_lon[i])));
+    V a = Ops::add(Ops::mul(sin_dlat, sin_dlat),
+                   Ops::mul(Ops::mul(Ops::set1(p.cos_lat), Ops::load(&s.cos_lat[i])),
+                            Ops::mul(sin_dlon, sin_dlon)));
+    a = Ops::min(a, Ops::set1(1.0));
+    return Ops::mul(Ops::set1(2.0 * EARTH_RADIUS_KM), Ops::asin(Ops::sqrt(a)));
+}
+
+template <typename Ops>
+typename Ops::V equirectangular_block(const StationTable &s, const PointTrig &p, int i)
+{
+    typedef typename Ops::V V;
+    V cos_mid = Ops::sub(Ops::mul(Ops::set1(p.cos_half_lat), Ops::load(&s.cos_half_lat[i])),
+                         Ops::mul(Ops::set1(p.sin_half_lat), Ops::load(&s.sin_half_lat[i])));
+    V x = Ops::mul(Ops::sub(Ops::set1(p.lon), Ops::load(&s.lon_rad[i])), cos_mid);
+    V y = Ops::sub(Ops::set1(p.lat), Ops::load(&s.lat_rad[i]));
+    return Ops::mul(Ops::set1(EARTH_RADIUS_KM), Ops::sqrt(Ops::add(Ops::mul(x, x), Ops::mul(y, y))));
+}
+
+template <typename Ops, typename Block>
+int distances_with(const StationTable &s, const PointTrig &p, int i, double *out, Block block)
+{
+    for (; i + Ops::width <= s.size(); i += Ops::width) {
+        Ops::store(out + i, block(s, p, i));
+    }
+    return i;
+}
+
+template <typename Ops, typename Block>
+int l1_with(const StationTable &s, const PointTrig &p, int i, const double *ranges,
+            double *sum, Block block)
+{
+    typename Ops::V acc = Ops::set1(0.0);
+    for (; i + Ops::width <= s.size(); i += Ops::width) {
+        acc = Ops::add(acc, Ops::abs(Ops::sub(block(s, p, i), Ops::load(ranges + i))));
+    }
+    *sum += Ops::hsum(acc);
+    return i;
+}
+
+template <typename Ops, typename Block>
+int normal_equations_with(const StationTable &s, const PointTrig &p, int i, const double *ranges,
+                          double floor, double *jtj, double *jtr, Block block)
+{
+    NormalSums<Ops> sums;
+    for (; i + Ops::width <= s.size(); i += Ops::width) {
+        typename Ops::V g_lat, g_lon;
+        typename Ops::V d = block(s, p, i, &g_lat, &g_lon);
+        sums.add(Ops::sub(d, Ops::load(ranges + i)), g_lat, g_lon, floor);
+    }
+    sums.sum_into(jtj, jtr);
+    return i;
+}
+
+} // namespace
+
+void batch_haversine(const StationTable &stations, const PointLatLon &point, double *distances)
+{
+    PointTrig p(point);
+    int i = distances_with<VectorOps>(stations, p, 0, distances, haversine_block<VectorOps>);
+    distances_with<ScalarOps>(stations, p, i, distances, haversine_block<ScalarOps>);
+}
+
+void batch_equirectangular(const StationTable &stations, const PointLatLon &point, double *distances)
+{
+    PointTrig p(point);
+    int i = distances_with<VectorOps>(stations, p, 0, distances, equirectangular_block<VectorOps>);
+    distances_with<ScalarOps>(stations, p, i, distances, equirectangular_block<ScalarOps>);
+}
+
+double batch_l1_objective(const StationTable &stations, DistanceModel model,
+                          const PointLatLon &point, const double *station_ranges)
+{
+    PointTrig p(point);
+    double sum = 0;
+    int i;
+    if (model == DISTANCE_EQUIRECTANGULAR) {
+        i = l1_with<VectorOps>(stations, p, 0, station_ranges, &sum, equirectangular_block<VectorOps>);
+        l1_with<ScalarOps>(stations, p, i, station_ranges, &sum, equirectangular_block<ScalarOps>);
+    } else {
+        i = l1_with<VectorOps>(stations, p, 0, station_ranges, &sum, haversine_block<VectorOps>);
+        l1_with<ScalarOps>(stations, p, i, station_ranges, &sum, haversine_block<ScalarOps>);
+    }
+    return sum;
+}
+
+void batch_l1_normal_equations(const StationTable &stations, DistanceModel model,
+                               const PointLatLon &point, const double *station_ranges,
+                               double irls_floor, double *jtj, double *jtr)
+{
+    PointTrig p(point);
+    jtj[0] = jtj[1] = jtj[2] = 0;
+    jtr[0] = jtr[1] = 0;
+    int i;
+    if (model == DISTANCE_EQUIRECTANGULAR) {
+        i = normal_equations_with<VectorOps>(stations, p, 0, station_ranges, irls_floor, jtj, jtr,
+                                             equirectangular_gradient_block<VectorOps>);
+        normal_equations_with<ScalarOps>(stations, p, i, station_ranges, irls_floor, jtj, jtr,
+                                         equirectangular_gradient_block<ScalarOps>);
+    } else {
+        i = normal_equations_with<VectorOps>(stations, p, 0, station_ranges, irls_floor, jtj, jtr,
+                                             haversine_gradient_block<VectorOps>);
+        normal_equations_with<ScalarOps>(stations, p, i, station_ranges, irls_floor, jtj, jtr,
+                                         haversine_gradient_block<ScalarOps>);
+    }
+}
+
+const char *distance_kernel_isa()
+{
+    return kernel_isa;
+}
@@ -0,0 +1,98 @@
+#ifndef DISTANCE_KERNEL_H
+#define DISTANCE_KERNEL_H
+
+#include <vector>
+
+#include "geodesy.h"
+
+/**
+ * Station set in structure-of-arrays layout for the batch distance kernels
+ *
+ * Besides the coordinates in radians it keeps the sine and cosine of the
+ * half angles, so the kernels can expand sin((lat - lat_i) / 2) and
+ * cos((lat + lat_i) / 2) with the angle-sum identities and evaluate every
+ * station with multiplies, adds and one square root.
+ */
+class StationTable
+{
+public:
+    /**
+    * Replace the stations in the table
+    */
+    void assign(const std::vector<PointLatLon> &station_locations);
+
+    /**
+    * @return number of stations
+    */
+    int size() const { return (int)lat_rad.size(); }
+
+    std::vector<double> lat_rad;
+    std::vector<double> lon_rad;
+    std::vector<double> cos_lat;
+    std::vector<double> sin_half_lat;
+    std::vector<double> cos_half_lat;
+    std::vector<double> sin_half_lon;
+    std::vector<double> cos_half_lon;
+};
+
+/**
+ * Haversine distance from one point to every station in a table
+ *
+ * Matches d_haversine to within 1E-9 km (relative 1E-12) for any pair of points.
+ *
+ * @param stations station table
+ * @param point candidate point
+ * @param distances receives stations.size() distances (km)
+ */
+void batch_haversine(const StationTable &stations, const PointLatLon &point, double *distances);
+
+/**
+ * Equirectangular distance from one point to every station in a table
+ *
+ * Matches d_equirectangular to within 1E-9 km (relative 1E-12).
+ *
+ * @param stations station table
+ * @param point candidate point
+ * @param distances receives stations.size() distances (km)
+ */
+void batch_equirectangular(const StationTable &stations, const PointLatLon &point, double *distances);
+
+/**
+ * Sum over stations of |distance(station, point) - range|, without
+ * materializing the distances
+ *
+ * @param stations station table
+ * @param model distance model
+ * @param point candidate point
+ * @param station_ranges one range (km) per station
+ * @return L1 objective (km)
+ */
+double batch_l1_objective(const StationTable &stations, DistanceModel model,
+                          const PointLatLon &point, const double *station_ranges);
+
+/**
+ * Normal equations of one reweighted least-squares step on the L1
+ * objective at a point, the per-iteration work of levenberg_marquardt
+ * (solvers.h)
+ *
+ * Station i enters with its range error r_i, its range gradient g_i (km
+ * per degree, zero on top of the station) and weight 1 / max(|r_i|, irls_floor).
+ *
+ * @param stations station table
+ * @param model distance model
+ * @param point point the step is taken from
+ * @param station_ranges one range (km) per station
+ * @param irls_floor smallest |r_i| (km) a weight is taken at
+ * @param jtj receives sum w_i g_i g_i^T as {lat lat, lat lon, lon lon}
+ * @param jtr receives sum w_i g_i r_i as {lat, lon}
+ */
+void batch_l1_normal_equations(const StationTable &stations, DistanceModel model,
+                               const PointLatLon &point, const double *station_ranges,
+                               double irls_floor, double *jtj, double *jtr);
+
+/**
+ * @return instruction set the kernels were built for ("avx2", "sse2" or "scalar")
+ */
+const char *distance_kernel_isa();
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef DISTANCE_MODELS_H
+#define DISTANCE_MODELS_H
+
+#include <cmath>
+
+#include "geodesy.h"
+#include "solvers.h"
+
+/*
+ * Distance models as compile-time policies for StaticMultilat
+ *
+ * Each model splits the work into what depends on the station alone
+ * (Station, built once per station set), what depends on the candidate
+ * point alone (Point, built once per objective evaluation) and the
+ * per-pair cost in distance(). gradient() returns the distance too, with
+ * the gradient w.r.t. the point in km per degree, as station_range_gradient.
+ * Points are built from radians, which is what the solvers work in.
+ *
+ * bench.cc prints an accuracy/speed table over 1-60 km against a long
+ * double haversine. Around Atlanta the equirectangular error grows from
+ * under a micrometre at 1 km to 0.16 m at 60 km, ECEF stays under 15 um
+ * and haversine under 3 nm. All three are far inside the AS3935 bins, so
+ * the choice is about speed.
+ */
+
+/** Coordinates in radians with the half-angle trig the haversine needs */
+struct HalfAngleTrig
+{
+    HalfAngleTrig() {}
+
+    HalfAngleTrig(double lat_rad, double lon_rad)
+        : lat(lat_rad), lon(lon_rad), cos_lat(std::cos(lat)),
+          sin_half_lat(std::sin(0.5 * lat)), cos_half_lat(std::cos(0.5 * lat)),
+          sin_half_lon(std::sin(0.5 * lon)), cos_half_lon(std::cos(0.5 * lon))
+    {
+    }
+
+    double lat, lon, cos_lat;
+    double sin_half_lat, cos_half_lat, sin_half_lon, cos_half_lon;
+};
+
+/**
+ * Great-circle distance by the haversine formula, as d_haversine
+ *
+ * sin((p - s) / 2) is expanded with the angle-sum identity, so a pair costs
+ * multiplies, one square root and one asin.
+ */
+struct HaversineDistance
+{
+    typedef HalfAngleTrig Station;
+    typedef HalfAngleTrig Point;
+
+    /** Model Multilat uses for the same distances */
+    static const DistanceModel runtime_model = DISTANCE_HAVERSINE;
+
+    static Station station(const PointLatLon &s) { return Station(s.lat * PI_ON_180, s.lon * PI_ON_180); }
+    static Point point(double lat, double lon) { return Point(lat, lon); }
+
+    static double distance(const Station &s, const Point &p)
+    {
+        double sin_dlat = p.sin_half_lat * s.cos_half_lat - p.cos_half_lat * s.sin_half_lat;
+        double sin_dlon = p.sin_half_lon * s.cos_half_lon - p.cos_half_lon * s.sin_half_lon;
+        double a = std::fmin(sin_dlat * sin_dlat + p.cos_lat * s.cos_lat * sin_dlon * sin_dlon, 1.0);
+        return 2.0 * EARTH_RADIUS_KM * std::asin(std::sqrt(a));
+    }
+
+    static double gradient(const Station &s, const Point &p, double *d_dlat, double *d_dlon)
+    {
+        return station_range_gradient(DISTANCE_HAVERSINE, s.lat, s.lon, s.cos_lat,
+                                      p.lat, p.lon, p.cos_lat, d_dlat, d_dlon);
+    }
+};
+
+/**
+ * Equirectangular approximation, as d_equirectangular
+ *
+ * Cheapest per pair (no inverse trig), but it treats the patch between
+ * the two points as flat.
+ */
+struct EquirectangularDistance
+{
+    typedef HalfAngleTrig Station;
+    typedef HalfAngleTrig Point;
+
+    static const DistanceModel runtime_model = DISTANCE_EQUIRECTANGULAR;
+
+    static Station station(const PointLatLon &s) { return Station(s.lat * PI_ON_180, s.lon * PI_ON_180); }
+    static Point point(double lat, double lon) { return Point(lat, lon); }
+
+    static double distance(const Station &s, const Point &p)
+    {
+        // cos((p + s) / 2) by the angle-sum identity
+        double cos_mid = p.cos_half_lat * s.cos_half_lat - p.sin_half_lat * s.sin_half_lat;
+        double x = (p.lon - s.lon) * cos_mid;
+        double y = p.lat - s.lat;
+        return EARTH_RADIUS_KM * std::sqrt(x * x + y * y);
+    }
+
+    static double gradient(const Station &s, const Point &p, double *d_dlat, double *d_dlon)
+    {
+        return station_range_gradient(DISTANCE_EQUIRECTANGULAR, s.lat, s.lon, s.cos_lat,
+                                      p.lat, p.lon, p.cos_lat, d_dlat, d_dlon);
+    }
+};
+
+/**
+ * Great-circle distance from earth-centred unit vectors
+ *
+ * Stations and points are turned into unit vectors once, after which a
+ * pair is one dot product and one acos. Same sphere as the haversine, but
+ * acos loses digits near zero angle: the error is about R * 1E-16 / angle,
+ * some 15 um at 1 km.
+ */
+struct EcefDistance
+{
+    struct Station
+    {
+        Station() {}
+
+        Station(double lat, double lon)
+        {
+            x = std::cos(lat) * std::cos(lon);
+            y = std::cos(lat) * std::sin(lon);
+            z = std::sin(lat);
+        }
+
+        double x, y, z;
+    };
+
+    struct Point
+    {
+        Point(double lat, double lon)
+        {
+            sin_lat = std::sin(lat);
+            cos_lat = std::cos(lat);
+            sin_lon = std::sin(lon);
+            cos_lon = std::cos(lon);
+            x = cos_lat * cos_lon;
+            y = cos_lat * sin_lon;
+            z = sin_lat;
+        }
+
+        double x, y, z;
+        double sin_lat, cos_lat, sin_lon, cos_lon;  // for the gradient
+    };
+
+    /** Same sphere, so Multilat's haversine gives the same distances */
+    static const DistanceModel runtime_model = DISTANCE_HAVERSINE;
+
+    static Station station(const PointLatLon &s) { return Station(s.lat * PI_ON_180, s.lon * PI_ON_180); }
+    static Point point(double lat, double lon) { return Point(lat, lon); }
+
+    static double distance(const Station &s, const Point &p)
+    {
+        double dot = s.x * p.x + s.y * p.y + s.z * p.z;
+        return EARTH_RADIUS_KM * std::acos(std::fmax(-1.0, std::fmin(dot, 1.0)));
+    }
+
+    static double gradient(const Station &s, const Point &p, double *d_dlat, double *d_dlon)
+    {
+        double dot = std::fmax(-1.0, std::fmin(s.x * p.x + s.y * p.y + s.z * p.z, 1.0));
+        double angle = std::acos(dot);
+
+        // d(angle)/d(dot) = -1 / sin(angle); undefined on top of the station or its antipode
+        double sin_angle = std::sin(angle);
+        if (sin_angle < 1E-15) {
+            *d_dlat = 0;
+            *d_dlon = 0;
+            return EARTH_RADIUS_KM * angle;
+        }
+        double ddot_dlat = p.cos_lat * s.z - p.sin_lat * (s.x * p.cos_lon + s.y * p.sin_lon);
+        double ddot_dlon = p.cos_lat * (s.y * p.cos_lon - s.x * p.sin_lon);
+        double scale = -EARTH_RADIUS_KM * PI_ON_180 / sin_angle;
+        *d_dlat = scale * ddot_dlat;
+        *d_dlon = scale * ddot_dlon;
+        return EARTH_RADIUS_KM * angle;
+    }
+};
+
+#endif
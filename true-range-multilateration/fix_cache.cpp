@@ -0,0 +1,125 @@
+#include "fix_cache.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+FixCache::FixCache(size_t max_entries)
+    : max_entries(max_entries), hit_count(0), miss_count(0)
+{
+}
+
+int FixCache::add_station_set(const Multilat *multilat)
+{
+    if (multilat->number_of_stations() > FIX_CACHE_MAX_STATIONS) {
+        throw std::invalid_argument("FixCache::add_station_set: too many stations for the key");
+    }
+    station_sets.push_back(multilat);
+    return (int)station_sets.size() - 1;
+}
+
+const Multilat &FixCache::station_set_at(int station_set, const char *caller) const
+{
+    if (station_set < 0 || station_set >= (int)station_sets.size()) {
+        throw std::invalid_argument(std::string(caller) + ": unknown station set");
+    }
+    return *station_sets[station_set];
+}
+
+FixCache::Key FixCache::make_key(int station_set, SolverMode mode,
+                                 const std::vector<double> &station_ranges)
+{
+    Key key = {};
+    key.words[0] = (uint64_t)(uint32_t)station_set | (uint64_t)mode << 32;
+    for (size_t i = 0; i < station_ranges.size(); i++) {
+        key.words[1 + i / 16] |= (uint64_t)range_bin_index(station_ranges[i]) << (4 * (i % 16));
+    }
+    return key;
+}
+
+size_t FixCache::KeyHash::operator()(const Key &key) const
+{
+    // splitmix64 finalizer over the words, chained
+    uint64_t h = 0;
+    for (size_t i = 0; i < sizeof(key.words) / sizeof(key.words[0]); i++) {
+        h ^= key.words[i] + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBull;
+        h ^= h >> 31;
+    }
+    return (size_t)h;
+}
+
+StrikeFix FixCache::locate(int station_set, const std::vector<double> &station_ranges,
+                           SolverMode mode)
+{
+    const Multilat &multilat = station_set_at(station_set, "FixCache::locate");
+    if ((int)station_ranges.size() != multilat.number_of_stations()) {
+        throw std::invalid_argument("FixCache::locate: one range per station required");
+    }
+    Key key = make_key(station_set, mode, station_ranges);
+    std::unordered_map<Key, StrikeFix, KeyHash>::const_iterator found = fixes.find(key);
+    if (found != fixes.end()) {
+        hit_count++;
+        return found->second;
+    }
+
+    miss_count++;
+    // Solve on the snapped ranges so the stored fix does not depend on
+    // which exact report of the tuple arrived first
+    std::vector<double> snapped(station_ranges.size());
+    for (size_t i = 0; i < station_ranges.size(); i++) {
+        snapped[i] = round_to_range_points(station_ranges[i]);
+    }
+    StrikeFix fix = multilat.locate_strike(snapped, mode);
+    if (fixes.size() < max_entries) {
+        fixes.emplace(key, fix);
+    }
+    return fix;
+}
+
+int FixCache::precompute(int station_set, SolverMode mode, double step)
+{
+    const Multilat &multilat = station_set_at(station_set, "FixCache::precompute");
+    const int n = multilat.number_of_stations();
+    if (n == 0 || step <= 0) {
+        return 0;
+    }
+
+    // Beyond this far from every station all reports are the farthest bin
+    double lo, reach;
+    range_bin_interval(as3935_range_points[1], &lo, &reach);
+
+    PointLatLon sw = multilat.station(0), ne = multilat.station(0);
+    for (int i = 1; i < n; i++) {
+        sw.lat = std::fmin(sw.lat, multilat.station(i).lat);
+        sw.lon = std::fmin(sw.lon, multilat.station(i).lon);
+        ne.lat = std::fmax(ne.lat, multilat.station(i).lat);
+        ne.lon = std::fmax(ne.lon, multilat.station(i).lon);
+    }
+    double km_per_deg_lat = EARTH_RADIUS_KM * PI_ON_180;
+    double km_per_deg_lon = km_per_deg_lat * std::cos(0.5 * (sw.lat + ne.lat) * PI_ON_180);
+    double dlat = step / km_per_deg_lat, dlon = step / km_per_deg_lon;
+    sw.lat -= reach / km_per_deg_lat;
+    sw.lon -= reach / km_per_deg_lon;
+    ne.lat += reach / km_per_deg_lat;
+    ne.lon += reach / km_per_deg_lon;
+
+    size_t before = fixes.size();
+    std::vector<double> ranges(n);
+    for (double lat = sw.lat; lat <= ne.lat; lat += dlat) {
+        for (double lon = sw.lon; lon <= ne.lon && fixes.size() < max_entries; lon += dlon) {
+            PointLatLon strike = {lat, lon};
+            for (int i = 0; i < n; i++) {
+                ranges[i] = round_to_range_points(d_haversine(multilat.station(i), strike));
+            }
+            Key key = make_key(station_set, mode, ranges);
+            if (fixes.find(key) == fixes.end()) {
+                fixes.emplace(key, multilat.locate_strike(ranges, mode));
+            }
+        }
+    }
+    return (int)(fixes.size() - before);
+}
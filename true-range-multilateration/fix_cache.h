@@ -0,0 +1,107 @@
+#ifndef FIX_CACHE_H
+#define FIX_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "multilat.h"
+
+/** Most stations a set registered with FixCache may have */
+const int FIX_CACHE_MAX_STATIONS = 48;
+
+/**
+ * Memoized fixes for quantized range reports
+ *
+ * The AS3935 only reports 15 distinct ranges, so for a fixed station set
+ * the reports that can occur are a small finite set. Fixes are stored
+ * under (station set id, solver mode, bin index per station), packed four
+ * bits per station into a fixed-size key, so repeated reports from an
+ * active cell become a hash lookup instead of a solve, without allocating.
+ *
+ * Not thread-safe; give each thread its own cache or guard it externally.
+ */
+class FixCache
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param max_entries fixes kept before new ones are solved but not stored
+    */
+    explicit FixCache(size_t max_entries = 1 << 20);
+
+    /**
+    * Register a station set
+    *
+    * The cache keeps a pointer, so the Multilat must outlive it and must
+    * not have its stations replaced while registered. Sets of more than
+    * FIX_CACHE_MAX_STATIONS stations throw std::invalid_argument.
+    *
+    * @return station set id for locate()
+    */
+    int add_station_set(const Multilat *multilat);
+
+    /**
+    * Fix for a report set, solving and storing it on a miss
+    *
+    * @param station_set id from add_station_set; an unknown id or a
+    * range count that does not match the set throws std::invalid_argument
+    * @param station_ranges one reported range (km) per station
+    * @param mode solver used on a miss
+    */
+    StrikeFix locate(int station_set, const std::vector<double> &station_ranges,
+                     SolverMode mode = SOLVER_LEVENBERG_MARQUARDT);
+
+    /**
+    * Solve every bin tuple a noise-free strike can produce
+    *
+    * Sweeps strike positions on a grid around the stations, out to where
+    * every station reports the farthest bin, and solves each new tuple.
+    *
+    * @param station_set id from add_station_set
+    * @param mode solver used for the tuples
+    * @param step grid spacing (km)
+    * @return number of tuples added
+    */
+    int precompute(int station_set, SolverMode mode = SOLVER_LEVENBERG_MARQUARDT,
+                   double step = 0.25);
+
+    size_t size() const { return fixes.size(); }
+    long hits() const { return hit_count; }
+    long misses() const { return miss_count; }
+
+private:
+    // Station set id and mode in word 0, then 4-bit bin indices
+    struct Key
+    {
+        uint64_t words[1 + FIX_CACHE_MAX_STATIONS / 16];
+
+        bool operator==(const Key &other) const
+        {
+            for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                if (words[i] != other.words[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const;
+    };
+
+    const Multilat &station_set_at(int station_set, const char *caller) const;
+    static Key make_key(int station_set, SolverMode mode, const std::vector<double> &station_ranges);
+
+    std::vector<const Multilat *> station_sets;
+    std::unordered_map<Key, StrikeFix, KeyHash> fixes;
+    size_t max_entries;
+    long hit_count;
+    long miss_count;
+};
+
+#endif
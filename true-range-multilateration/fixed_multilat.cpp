@@ -0,0 +1,338 @@
+#include "fixed_multilat.h"
+
+#ifdef MULTILAT_FLOAT
+#include <math.h>
+#endif
+
+namespace {
+
+// Metres per microdegree of latitude on the 6371 km sphere, Q8.24
+const int64_t M_PER_UDEG_LAT_Q24 = 1865541;
+// Microdegrees per metre of latitude, Q16.16
+const int32_t UDEG_PER_M_LAT_Q16 = 589379;
+
+// The seed's normal equations are solved in 16 m units with the inverse
+// scaled by 2^32, which keeps every product inside 64 bits for stations
+// up to 100 km from their centroid
+const int32_t SEED_UNIT = 16;
+const local_sum_t SEED_SCALE = (local_sum_t)4294967296LL;
+
+// Rotation by 30 degrees in Q15, for sampling the ring of candidate fixes
+const int32_t COS_30_Q15 = 28378;
+const int32_t SIN_30_Q15 = 16384;
+const int RING_SAMPLES = 12;
+const local_sum_t RING_MARGIN = 200;   // m of L1 residual
+
+// cos(0..90 degrees) in Q15; linear interpolation between whole degrees is
+// good to 4E-5, a few metres over the sensor range
+const uint16_t cos_table[91] = {
+    32768, 32763, 32748, 32723, 32688, 32643, 32588, 32524, 32449, 32365, 32270, 32166, 32052,
+    31928, 31795, 31651, 31499, 31336, 31164, 30983, 30792, 30592, 30382, 30163, 29935, 29698,
+    29452, 29197, 28932, 28660, 28378, 28088, 27789, 27482, 27166, 26842, 26510, 26170, 25822,
+    25466, 25102, 24730, 24351, 23965, 23571, 23170, 22763, 22348, 21926, 21498, 21063, 20622,
+    20174, 19720, 19261, 18795, 18324, 17847, 17364, 16877, 16384, 15886, 15384, 14876, 14365,
+    13848, 13328, 12803, 12275, 11743, 11207, 10668, 10126, 9580, 9032, 8481, 7927, 7371,
+    6813, 6252, 5690, 5126, 4560, 3993, 3425, 2856, 2286, 1715, 1144, 572, 0
+};
+
+int32_t cos_q15(int32_t lat_e6)
+{
+    int32_t a = lat_e6 < 0 ? -lat_e6 : lat_e6;
+    int32_t degree = a / 1000000;
+    if (degree >= 90) {
+        return 0;
+    }
+    int32_t frac = a % 1000000;
+    int32_t c0 = cos_table[degree], c1 = cos_table[degree + 1];
+    return c0 + (c1 - c0) * frac / 1000000;
+}
+
+#ifdef MULTILAT_FLOAT
+local_coord_t distance(local_coord_t dx, local_coord_t dy)
+{
+    return sqrtf(dx * dx + dy * dy);
+}
+
+local_coord_t huber_quadratic(local_coord_t e, local_coord_t smoothing)
+{
+    return e * e / (2 * smoothing);
+}
+#else
+// Bit-by-bit square root; distances under 65 km stay in 32-bit registers
+uint32_t isqrt32(uint32_t value)
+{
+    uint32_t result = 0;
+    uint32_t bit = (uint32_t)1 << ((31 - __builtin_clz(value)) & ~1);
+    while (bit) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+uint32_t isqrt64(uint64_t value)
+{
+    if (value <= 0xFFFFFFFFu) {
+        return value ? isqrt32((uint32_t)value) : 0;
+    }
+    // Start at the highest even bit at or below the top set bit
+    uint64_t result = 0;
+    uint64_t bit = (uint64_t)1 << ((63 - __builtin_clzll(value)) & ~1);
+    while (bit) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+local_coord_t distance(local_coord_t dx, local_coord_t dy)
+{
+    return (local_coord_t)isqrt64((uint64_t)((int64_t)dx * dx + (int64_t)dy * dy));
+}
+
+// e < smoothing <= 16384 m, so this is a 32-bit divide
+local_coord_t huber_quadratic(local_coord_t e, local_coord_t smoothing)
+{
+    return (local_coord_t)((uint32_t)(e * e) / (uint32_t)(2 * smoothing));
+}
+#endif
+
+local_coord_t magnitude(local_coord_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+} // namespace
+
+FixedMultilat::FixedMultilat()
+    : min_step(16), max_evaluations(1000), count(0), seed_degenerate(true), spread(0)
+{
+    origin.lat = 0;
+    origin.lon = 0;
+    m_per_udeg_lon_q24 = (int32_t)M_PER_UDEG_LAT_Q24;
+    udeg_per_m_lat_q16 = UDEG_PER_M_LAT_Q16;
+    udeg_per_m_lon_q16 = UDEG_PER_M_LAT_Q16;
+}
+
+bool FixedMultilat::set_stations(const PointE6 *stations, int n)
+{
+    if (n < 1 || n > FIXED_MULTILAT_MAX_STATIONS) {
+        return false;
+    }
+    count = n;
+
+    int64_t sum_lat = 0, sum_lon = 0;
+    for (int i = 0; i < n; i++) {
+        sum_lat += stations[i].lat;
+        sum_lon += stations[i].lon;
+    }
+    origin.lat = (int32_t)(sum_lat / n);
+    origin.lon = (int32_t)(sum_lon / n);
+
+    int32_t c = cos_q15(origin.lat);
+    if (c < 1) {
+        c = 1;
+    }
+    m_per_udeg_lon_q24 = (int32_t)((M_PER_UDEG_LAT_Q24 * c) >> 15);
+    udeg_per_m_lon_q16 = (int32_t)(((int64_t)UDEG_PER_M_LAT_Q16 << 15) / c);
+
+    for (int i = 0; i < n; i++) {
+        x[i] = (local_coord_t)(((int64_t)(stations[i].lon - origin.lon) * m_per_udeg_lon_q24) >> 24);
+        y[i] = (local_coord_t)(((int64_t)(stations[i].lat - origin.lat) * M_PER_UDEG_LAT_Q24) >> 24);
+    }
+
+    local_sum_t mean_sq = 0;
+    local_sum_t a00 = 0, a01 = 0, a11 = 0;
+    spread = 0;
+    for (int i = 0; i < n; i++) {
+        local_sum_t u = x[i] / SEED_UNIT, v = y[i] / SEED_UNIT;
+        norm_sq[i] = u * u + v * v;
+        mean_sq += norm_sq[i];
+        a00 += u * u;
+        a01 += u * v;
+        a11 += v * v;
+        local_coord_t d = distance(x[i], y[i]);
+        spread = d > spread ? d : spread;
+    }
+    mean_sq /= n;
+    for (int i = 0; i < n; i++) {
+        norm_sq[i] -= mean_sq;
+    }
+    local_sum_t det = a00 * a11 - a01 * a01;
+    local_sum_t trace = a00 + a11;
+    seed_degenerate = n < 3 || det <= trace * trace / 1000000 || det <= 0;
+    if (!seed_degenerate) {
+        seed_inverse[0] = a11 * SEED_SCALE / det;
+        seed_inverse[1] = -a01 * SEED_SCALE / det;
+        seed_inverse[2] = a00 * SEED_SCALE / det;
+    }
+    return true;
+}
+
+local_sum_t FixedMultilat::objective(local_coord_t px, local_coord_t py, const local_coord_t *ranges,
+                                     local_coord_t smoothing) const
+{
+    local_sum_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        local_coord_t e = magnitude(distance(px - x[i], py - y[i]) - ranges[i]);
+        // Huber: quadratic within smoothing of the range circle, so the
+        // creases of the L1 objective become valleys the search can follow
+        if (e < smoothing) {
+            sum += huber_quadratic(e, smoothing) + smoothing / 2;
+        } else {
+            sum += e;
+        }
+    }
+    return sum;
+}
+
+PointE6 FixedMultilat::to_e6(local_coord_t px, local_coord_t py) const
+{
+    PointE6 p;
+    p.lat = origin.lat + (int32_t)(((int64_t)py * udeg_per_m_lat_q16) >> 16);
+    p.lon = origin.lon + (int32_t)(((int64_t)px * udeg_per_m_lon_q16) >> 16);
+    return p;
+}
+
+void FixedMultilat::seed(const uint8_t *ranges_km, local_coord_t *px, local_coord_t *py) const
+{
+    // Same linearization as Multilat::initial_guess: subtracting the mean
+    // of |p - s_i|^2 = r_i^2 leaves 2 s_i . p = (|s_i|^2 - mean) - (r_i^2 - mean)
+    local_sum_t mean_range_sq = 0;
+    int max_range = 0;
+    for (int i = 0; i < count; i++) {
+        local_sum_t r = (local_sum_t)ranges_km[i] * (1000 / SEED_UNIT);
+        mean_range_sq += r * r;
+        max_range = ranges_km[i] > max_range ? ranges_km[i] : max_range;
+    }
+    mean_range_sq /= count;
+
+    if (!seed_degenerate) {
+        local_sum_t atb0 = 0, atb1 = 0;
+        for (int i = 0; i < count; i++) {
+            local_sum_t r = (local_sum_t)ranges_km[i] * (1000 / SEED_UNIT);
+            local_sum_t b = norm_sq[i] - (r * r - mean_range_sq);
+            atb0 += x[i] / SEED_UNIT * b;
+            atb1 += y[i] / SEED_UNIT * b;
+        }
+        // p = (sum s_i s_i^T)^-1 sum s_i b_i / 2, back in metres
+        local_coord_t sx = (local_coord_t)((seed_inverse[0] * atb0 + seed_inverse[1] * atb1)
+                                           / SEED_SCALE * (SEED_UNIT / 2));
+        local_coord_t sy = (local_coord_t)((seed_inverse[1] * atb0 + seed_inverse[2] * atb1)
+                                           / SEED_SCALE * (SEED_UNIT / 2));
+        if (distance(sx, sy) <= max_range * 1000 + spread) {
+            *px = sx;
+            *py = sy;
+            return;
+        }
+    }
+
+    // Otherwise the stations' centroid pulled toward the ones that heard
+    // the strike closest
+    local_sum_t sum_x = 0, sum_y = 0;
+    int32_t sum_w = 0;
+    for (int i = 0; i < count; i++) {
+        int32_t w = 64 / (ranges_km[i] + 1);
+        sum_x += (local_sum_t)x[i] * w;
+        sum_y += (local_sum_t)y[i] * w;
+        sum_w += w;
+    }
+    *px = (local_coord_t)(sum_x / sum_w);
+    *py = (local_coord_t)(sum_y / sum_w);
+}
+
+local_sum_t FixedMultilat::search(local_coord_t *ppx, local_coord_t *ppy, const local_coord_t *ranges,
+                                  local_coord_t step, int *evaluations) const
+{
+    local_coord_t px = *ppx, py = *ppy;
+    static const int8_t dir_x[8] = {1, 0, -1, 0, 1, -1, -1, 1};
+    static const int8_t dir_y[8] = {0, 1, 0, -1, 1, 1, -1, -1};
+    local_sum_t best = objective(px, py, ranges, step);
+    (*evaluations)++;
+    int last = 0;
+    while (step >= min_step && *evaluations < max_evaluations) {
+        local_coord_t diagonal = step * 181 / 256;
+        bool moved = false;
+        for (int k = 0; k < 8; k++) {
+            int d = (last + k) & 7;
+            local_coord_t s = d < 4 ? step : diagonal;
+            local_coord_t cx = px + dir_x[d] * s;
+            local_coord_t cy = py + dir_y[d] * s;
+            local_sum_t f = objective(cx, cy, ranges, step);
+            (*evaluations)++;
+            if (f < best) {
+                best = f;
+                px = cx;
+                py = cy;
+                last = d;
+                moved = true;
+                break;
+            }
+        }
+        if (!moved) {
+            step = step / 2;
+            best = objective(px, py, ranges, step);
+            (*evaluations)++;
+        }
+    }
+    *ppx = px;
+    *ppy = py;
+    return objective(px, py, ranges, 0);
+}
+
+FixedStrikeFix FixedMultilat::locate_strike(const uint8_t *ranges_km) const
+{
+    local_coord_t ranges[FIXED_MULTILAT_MAX_STATIONS];
+    for (int i = 0; i < count; i++) {
+        ranges[i] = (local_coord_t)(ranges_km[i] * 1000);
+    }
+    local_coord_t px, py;
+    seed(ranges_km, &px, &py);
+    int evaluations = 0;
+    local_sum_t best = search(&px, &py, ranges, 16384, &evaluations);
+    // Stations close together relative to the range see the strike on a
+    // ring about their centroid, and the objective has several minima
+    // around it; the search stops in whichever the seed falls toward.
+    // Sample the ring every 30 degrees and search again from the best
+    // sample; move only if that clearly beats the fix, since between
+    // minima that tie the first is as good a guess as the other
+    local_coord_t rx = px, ry = py, bx = px, by = py;
+    local_sum_t ring_best = best;
+    for (int k = 1; k < RING_SAMPLES; k++) {
+        local_coord_t turned = (local_coord_t)(((local_sum_t)rx * COS_30_Q15
+                                                - (local_sum_t)ry * SIN_30_Q15) / 32768);
+        ry = (local_coord_t)(((local_sum_t)rx * SIN_30_Q15 + (local_sum_t)ry * COS_30_Q15) / 32768);
+        rx = turned;
+        local_sum_t f = objective(rx, ry, ranges, 0);
+        evaluations++;
+        if (f < ring_best) {
+            ring_best = f;
+            bx = rx;
+            by = ry;
+        }
+    }
+    if (ring_best < best) {
+        local_sum_t f = search(&bx, &by, ranges, 16384, &evaluations);
+        if (f + RING_MARGIN < best) {
+            best = f;
+            px = bx;
+            py = by;
+        }
+    }
+
+    FixedStrikeFix fix;
+    fix.location = to_e6(px, py);
+    fix.residual = (int32_t)best;
+    fix.evaluations = evaluations;
+    return fix;
+}
@@ -0,0 +1,30 @@
+#include "geodesy.h"
+
+#include <cmath>
+
+double d_haversine(const PointLatLon &point_a, const PointLatLon &point_b)
+{
+    double lat1 = point_a.lat * PI_ON_180;
+    double lat2 = point_b.lat * PI_ON_180;
+
+    double lon1 = point_a.lon * PI_ON_180;
+    double lon2 = point_b.lon * PI_ON_180;
+
+    double sin_dlat = std::sin(0.5 * (lat2 - lat1));
+    double sin_dlon = std::sin(0.5 * (lon2 - lon1));
+    double a = sin_dlat * sin_dlat + std::cos(lat1) * std::cos(lat2) * sin_dlon * sin_dlon;
+    return EARTH_RADIUS_KM * 2.0 * std::asin(std::sqrt(a));
+}
+
+double d_equirectangular(const PointLatLon &point_a, const PointLatLon &point_b)
+{
+    double lat1 = point_a.lat * PI_ON_180;
+    double lat2 = point_b.lat * PI_ON_180;
+
+    double lon1 = point_a.lon * PI_ON_180;
+    double lon2 = point_b.lon * PI_ON_180;
+
+    double x = (lon2 - lon1) * std::cos(0.5 * (lat2 + lat1));
+    double y = lat2 - lat1;
+    return EARTH_RADIUS_KM * std::sqrt(x * x + y * y);
+}
@@ -0,0 +1,40 @@
+#ifndef GEODESY_H
+#define GEODESY_H
+
+/**
+ * A point on the earth in decimal degrees
+ */
+struct PointLatLon
+{
+    double lat;
+    double lon;
+};
+
+/** Mean earth radius (km) used by every distance model */
+const double EARTH_RADIUS_KM = 6371.0;
+const double PI_ON_180 = 0.017453292519943295;
+
+/**
+ * Great-circle distance between two points
+ *
+ * @return distance in km
+ */
+double d_haversine(const PointLatLon &point_a, const PointLatLon &point_b);
+
+/**
+ * Equirectangular approximation of the distance between two points
+ *
+ * @return distance in km
+ */
+double d_equirectangular(const PointLatLon &point_a, const PointLatLon &point_b);
+
+/**
+ * Distance model used by the objective
+ */
+enum DistanceModel
+{
+    DISTANCE_HAVERSINE,
+    DISTANCE_EQUIRECTANGULAR
+};
+
+#endif
@@ -0,0 +1,252 @@
+// Seeded Monte Carlo benchmark of localization accuracy and throughput.
+//
+//   g++ -O2 -mavx2 -std=c++14 -o monte_carlo monte_carlo.cc multilat.cpp
+//       region.cpp geodesy.cpp distance_kernel.cpp
+//   ./monte_carlo [--seed 1] [--strikes 10000] [--layout campus|grid|random:N]
+//                 [--margin 30] [--noise 0] [--missing 0] [--exact] [--out file]
+//
+// Strikes are drawn uniformly over the stations' bounding box widened by
+// --margin km. Each station measures the haversine range plus Gaussian
+// noise (--noise km, standard deviation), snapped to the AS3935 bins unless
+// --exact is given. Ranges past 40 km are reported as 40, as the registry
+// does for silent stations. With probability --missing a report is lost
+// and the station is left out of that solve; fixes with fewer than three
+// reports count as failed.
+//
+// Every solver mode runs on the same scenarios. Output is CSV, one row per
+// mode, so runs with the same arguments diff cleanly: everything except
+// the timing columns is a pure function of the arguments.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "multilat.h"
+
+namespace {
+
+// splitmix64: the same stream on every platform and standard library,
+// unlike the std:: distributions
+struct Random
+{
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform on [0, 1)
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // Standard normal by Box-Muller
+    double normal()
+    {
+        double u = 1.0 - uniform();
+        double v = uniform();
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(2 * M_PI * v);
+    }
+
+    uint64_t state;
+};
+
+struct Scenario
+{
+    PointLatLon strike;
+    std::vector<int> stations;      // stations whose report arrived
+    std::vector<double> ranges;
+};
+
+struct ModeResult
+{
+    const char *name;
+    SolverMode mode;
+    std::vector<double> errors;
+    int failed;
+    long iterations;
+    long evaluations;
+    double seconds;
+};
+
+void usage()
+{
+    fprintf(stderr, "usage: monte_carlo [--seed n] [--strikes n] [--layout campus|grid|random:N]\n"
+                    "                   [--margin km] [--noise km] [--missing p] [--exact] [--out file]\n");
+    exit(1);
+}
+
+std::vector<PointLatLon> make_layout(const char *layout, Random *random)
+{
+    std::vector<PointLatLon> stations;
+    if (!strcmp(layout, "campus")) {
+        // multi_algo.py
+        stations = {{33.778662, -84.408694}, {33.769620, -84.390898}, {33.781994, -84.402854}};
+    } else if (!strcmp(layout, "grid")) {
+        // quantized_errors.py
+        for (int a = 0; a < 4; a++) {
+            for (int o = 0; o < 7; o++) {
+                stations.push_back({33.6 + 0.1 * a, -84.7 + 0.1 * o});
+            }
+        }
+    } else if (!strncmp(layout, "random:", 7)) {
+        // Scattered over the same area as the grid
+        int n = atoi(layout + 7);
+        if (n < 3) {
+            usage();
+        }
+        for (int i = 0; i < n; i++) {
+            double lat = 33.6 + 0.3 * random->uniform();
+            stations.push_back({lat, -84.7 + 0.6 * random->uniform()});
+        }
+    } else {
+        usage();
+    }
+    return stations;
+}
+
+double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty()) {
+        return NAN;
+    }
+    size_t k = (size_t)std::min<double>(sorted.size() - 1, std::floor(p * sorted.size()));
+    return sorted[k];
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    uint64_t seed = 1;
+    int strikes = 10000;
+    const char *layout = "grid";
+    double margin = 30;
+    double noise = 0;
+    double missing = 0;
+    bool quantize = true;
+    const char *out = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--strikes") && i + 1 < argc) {
+            strikes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+            layout = argv[++i];
+        } else if (!strcmp(argv[i], "--margin") && i + 1 < argc) {
+            margin = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--noise") && i + 1 < argc) {
+            noise = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--missing") && i + 1 < argc) {
+            missing = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--exact")) {
+            quantize = false;
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (strikes <= 0 || noise < 0 || missing < 0 || missing > 1) {
+        usage();
+    }
+
+    Random random(seed);
+    std::vector<PointLatLon> stations = make_layout(layout, &random);
+
+    PointLatLon south_west = stations[0], north_east = stations[0];
+    for (const PointLatLon &s : stations) {
+        south_west = {std::fmin(south_west.lat, s.lat), std::fmin(south_west.lon, s.lon)};
+        north_east = {std::fmax(north_east.lat, s.lat), std::fmax(north_east.lon, s.lon)};
+    }
+    double dlat = margin / (EARTH_RADIUS_KM * PI_ON_180);
+    double dlon = dlat / std::cos(0.5 * (south_west.lat + north_east.lat) * PI_ON_180);
+
+    std::vector<Scenario> scenarios(strikes);
+    for (Scenario &scenario : scenarios) {
+        scenario.strike = {south_west.lat - dlat + (north_east.lat - south_west.lat + 2 * dlat) * random.uniform(),
+                           south_west.lon - dlon + (north_east.lon - south_west.lon + 2 * dlon) * random.uniform()};
+        for (int i = 0; i < (int)stations.size(); i++) {
+            // Draw every variate whether or not it is used, so changing one
+            // option does not reshuffle the rest of the stream
+            double jitter = noise * random.normal();
+            bool lost = random.uniform() < missing;
+            if (lost) {
+                continue;
+            }
+            double range = std::fmax(0.0, d_haversine(stations[i], scenario.strike) + jitter);
+            range = std::fmin(range, as3935_range_points[0]);
+            scenario.stations.push_back(i);
+            scenario.ranges.push_back(quantize ? round_to_range_points(range) : range);
+        }
+    }
+
+    std::vector<ModeResult> results = {
+        {"nelder_mead", SOLVER_NELDER_MEAD, {}, 0, 0, 0, 0},
+        {"levenberg_marquardt", SOLVER_LEVENBERG_MARQUARDT, {}, 0, 0, 0, 0},
+        {"interval", SOLVER_INTERVAL, {}, 0, 0, 0, 0},
+    };
+    Multilat all(stations);
+    Multilat partial(stations);
+    std::vector<PointLatLon> subset;
+    for (ModeResult &result : results) {
+        auto start = std::chrono::steady_clock::now();
+        for (const Scenario &scenario : scenarios) {
+            if (scenario.stations.size() < 3) {
+                result.failed++;
+                continue;
+            }
+            const Multilat *multilat = &all;
+            if (scenario.stations.size() < stations.size()) {
+                subset.clear();
+                for (int i : scenario.stations) {
+                    subset.push_back(stations[i]);
+                }
+                partial.set_stations(subset);
+                multilat = &partial;
+            }
+            StrikeFix fix = multilat->locate_strike(scenario.ranges, result.mode);
+            result.iterations += fix.iterations;
+            result.evaluations += fix.evaluations;
+            result.errors.push_back(d_haversine(fix.location, scenario.strike));
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(result.errors.begin(), result.errors.end());
+    }
+
+    FILE *f = out ? fopen(out, "w") : stdout;
+    if (!f) {
+        fprintf(stderr, "could not write %s\n", out);
+        return 1;
+    }
+    fprintf(f, "# seed=%llu strikes=%d layout=%s stations=%zu margin=%g noise=%g missing=%g quantize=%d\n",
+            (unsigned long long)seed, strikes, layout, stations.size(), margin, noise, missing, quantize);
+    fprintf(f, "mode,fixes,failed,mean_km,p50_km,p90_km,p95_km,p99_km,max_km,"
+               "iterations_per_fix,evaluations_per_fix,fixes_per_second\n");
+    for (const ModeResult &result : results) {
+        size_t n = result.errors.size();
+        double mean = 0;
+        for (double e : result.errors) {
+            mean += e;
+        }
+        fprintf(f, "%s,%zu,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.2f,%.0f\n",
+                result.name, n, result.failed, n ? mean / n : NAN,
+                percentile(result.errors, 0.50), percentile(result.errors, 0.90),
+                percentile(result.errors, 0.95), percentile(result.errors, 0.99),
+                n ? result.errors.back() : NAN,
+                n ? (double)result.iterations / n : NAN, n ? (double)result.evaluations / n : NAN,
+                n / result.seconds);
+    }
+    if (out) {
+        fclose(f);
+    }
+    return 0;
+}
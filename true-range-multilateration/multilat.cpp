@@ -1,23 +1,214 @@
-typedef struct PointLatLon
-{
-    float lat;
-    int lon;
+#include "multilat.h"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "solvers.h"
+
+const double as3935_range_points[AS3935_RANGE_POINTS] = {
+    40, 37, 34, 31, 27, 24, 20, 17, 14, 12, 10, 8, 6, 5, 0
 };
 
-typedef void (*functiontype)();
+double round_to_range_points(double range)
+{
+    return as3935_range_points[range_bin_index(range)];
+}
+
+int range_bin_index(double range)
+{
+    // First minimum wins on ties, like list.index(min(deltas)) in Python
+    int best = 0;
+    double best_delta = std::fabs(range - as3935_range_points[0]);
+    for (int i = 1; i < AS3935_RANGE_POINTS; i++) {
+        double delta = std::fabs(range - as3935_range_points[i]);
+        if (delta < best_delta) {
+            best_delta = delta;
+            best = i;
+        }
+    }
+    return best;
+}
 
-class Multilat
+void range_bin_interval(double reported, double *lo, double *hi)
 {
-public:
-    int number_of_stations;
-    PointLatLon station_locations[number_of_stations];
+    int i = range_bin_index(reported);
+    *hi = i == 0 ? HUGE_VAL : 0.5 * (as3935_range_points[i] + as3935_range_points[i - 1]);
+    *lo = i == AS3935_RANGE_POINTS - 1 ? 0 : 0.5 * (as3935_range_points[i] + as3935_range_points[i + 1]);
+}
 
-    PointLatLon x0 = {0, 0};
-    float tol = 1E-6;
-    int max_itter = 1000;
+double range_bin_sigma(double reported)
+{
+    double lo, hi;
+    range_bin_interval(reported, &lo, &hi);
+    return hi == HUGE_VAL ? HUGE_VAL : (hi - lo) / std::sqrt(12.0);
+}
 
+ErrorEllipse error_ellipse(double info_ee, double info_en, double info_nn)
+{
+    ErrorEllipse e;
+    e.lower_bound = false;
+    double det = info_ee * info_nn - info_en * info_en;
+    double trace = info_ee + info_nn;
+    if (!(det > 1E-12 * trace * trace) || trace <= 0) {
+        e.cov_ee = e.cov_nn = HUGE_VAL;
+        e.cov_en = 0;
+        e.semi_major = HUGE_VAL;
+        // Only the dominant eigenvector of the information matrix is
+        // determined; the major axis runs across it
+        e.semi_minor = trace > 0 ? 1 / std::sqrt(trace) : HUGE_VAL;
+        double determined = 0.5 * std::atan2(2 * info_en, info_ee - info_nn) / PI_ON_180;
+        e.orientation = std::fmod(360 - determined, 180);
+        return e;
+    }
+    e.cov_ee = info_nn / det;
+    e.cov_en = -info_en / det;
+    e.cov_nn = info_ee / det;
 
+    double mean = 0.5 * (e.cov_ee + e.cov_nn);
+    double half_diff = std::sqrt(0.25 * (e.cov_ee - e.cov_nn) * (e.cov_ee - e.cov_nn) + e.cov_en * e.cov_en);
+    e.semi_major = std::sqrt(mean + half_diff);
+    e.semi_minor = std::sqrt(std::fmax(mean - half_diff, 0.0));
+    // Major axis angle from east is atan2(2 cov_en, cov_ee - cov_nn) / 2
+    double from_east = 0.5 * std::atan2(2 * e.cov_en, e.cov_ee - e.cov_nn) / PI_ON_180;
+    e.orientation = std::fmod(90 - from_east + 180, 180);
+    return e;
+}
 
 
-    PointLatLon locate_strike(void);
-};
+Multilat::Multilat()
+    : distance_model(DISTANCE_HAVERSINE), linearized_seed(true), seed_step(0.05),
+      search_radius(100),
+      x0{-33.0, -80.0}, tol(1E-6), xtol(1E-4), max_itter(5000),
+      inlier_slack(2.0), max_subsets(256),
+      plane{{0, 0}, 0, 0, {0, 0, 0}, 0, true}
+{
+}
+
+Multilat::Multilat(const std::vector<PointLatLon> &station_locations)
+    : Multilat()
+{
+    set_stations(station_locations);
+}
+
+void Multilat::set_stations(const std::vector<PointLatLon> &station_locations)
+{
+    this->station_locations = station_locations;
+    table.assign(station_locations);
+
+    const size_t n = station_locations.size();
+    east.resize(n);
+    north.resize(n);
+    norm_sq.resize(n);
+    project_stations(station_locations.data(), (int)n, &plane, east.data(), north.data(),
+                     norm_sq.data());
+}
+
+PointLatLon Multilat::initial_guess(const double *station_ranges) const
+{
+    return linearized_guess(plane, east.data(), north.data(), norm_sq.data(), number_of_stations(),
+                            station_ranges);
+}
+
+int Multilat::number_of_stations() const
+{
+    return (int)station_locations.size();
+}
+
+const PointLatLon &Multilat::station(int i) const
+{
+    return station_locations[i];
+}
+
+double Multilat::objective(const PointLatLon &guess, const double *station_ranges) const
+{
+    return batch_l1_objective(table, distance_model, guess, station_ranges);
+}
+
+double Multilat::range_gradient(int i, double lat, double lon, double cos_lat,
+                                double *d_dlat, double *d_dlon) const
+{
+    return station_range_gradient(distance_model, table.lat_rad[i], table.lon_rad[i], table.cos_lat[i],
+                                  lat, lon, cos_lat, d_dlat, d_dlon);
+}
+
+ErrorEllipse Multilat::uncertainty(const PointLatLon &location, const double *station_ranges) const
+{
+    double lat = location.lat * PI_ON_180;
+    double lon = location.lon * PI_ON_180;
+    double cos_lat = std::cos(lat);
+    auto gradient = [this, lat, lon, cos_lat](int i, double *g_lat, double *g_lon) {
+        return range_gradient(i, lat, lon, cos_lat, g_lat, g_lon);
+    };
+    return bin_uncertainty(location, number_of_stations(), station_ranges, gradient);
+}
+
+WarmStart Multilat::cold_start(const std::vector<double> &station_ranges) const
+{
+    WarmStart state = {x0, 0, 1E-3};
+    if (linearized_seed && station_ranges.size() == station_locations.size()) {
+        state.location = initial_guess(station_ranges.data());
+        state.step = seed_step;
+    }
+    return state;
+}
+
+StrikeFix Multilat::locate_strike(const std::vector<double> &station_ranges,
+                                  SolverMode mode) const
+{
+    WarmStart state = cold_start(station_ranges);
+    return solve(station_ranges, mode, &state);
+}
+
+StrikeFix Multilat::locate_strike(const std::vector<double> &station_ranges, SolverMode mode,
+                                  const WarmStart &warm, WarmStart *next) const
+{
+    WarmStart state = warm;
+    StrikeFix fix = solve(station_ranges, mode, &state);
+    if (next) {
+        // Never hand on a scale below what the next strike's bins can resolve
+        state.location = fix.location;
+        state.step = std::fmax(state.step, 0.1 * seed_step);
+        *next = state;
+    }
+    return fix;
+}
+
+StrikeFix Multilat::solve(const std::vector<double> &station_ranges, SolverMode mode,
+                          WarmStart *state) const
+{
+    if (station_ranges.size() != station_locations.size()) {
+        throw std::invalid_argument("Multilat::locate_strike: one range per station required");
+    }
+    StrikeFix fix;
+    if (mode == SOLVER_LEVENBERG_MARQUARDT) {
+        fix = solve_levenberg_marquardt(station_ranges.data(), state->location, &state->lambda);
+    } else if (mode == SOLVER_INTERVAL) {
+        StrikeRegion region = locate_region(station_ranges);
+        fix.location = region.centroid;
+        fix.residual = objective(region.centroid, station_ranges.data());
+        fix.iterations = region.boxes;
+        fix.evaluations = 1;
+    } else {
+        fix = solve_nelder_mead(station_ranges.data(), state->location, &state->step);
+    }
+    fix.uncertainty = uncertainty(fix.location, station_ranges.data());
+    return fix;
+}
+
+StrikeFix Multilat::solve_nelder_mead(const double *station_ranges, PointLatLon start,
+                                      double *step) const
+{
+    auto f = [this, station_ranges](const PointLatLon &p) { return objective(p, station_ranges); };
+    return nelder_mead(f, start, step, xtol, tol, max_itter);
+}
+
+StrikeFix Multilat::solve_levenberg_marquardt(const double *station_ranges,
+                                              PointLatLon start, double *damping) const
+{
+    auto f = [this, station_ranges](const PointLatLon &p) { return objective(p, station_ranges); };
+    auto normal_equations = [this, station_ranges](const PointLatLon &x, double floor,
+                                                   double *jtj, double *jtr) {
+        batch_l1_normal_equations(table, distance_model, x, station_ranges, floor, jtj, jtr);
+    };
+    return levenberg_marquardt(f, normal_equations, start, damping, xtol, tol, max_itter);
+}
@@ -0,0 +1,377 @@
+#ifndef MULTILAT_H
+#define MULTILAT_H
+
+#include <vector>
+
+#include "geodesy.h"
+#include "distance_kernel.h"
+
+class ThreadPool;
+
+/** Number of distinct ranges the AS3935 can report */
+const int AS3935_RANGE_POINTS = 15;
+
+/** Ranges (km) the AS3935 can report, farthest first */
+extern const double as3935_range_points[AS3935_RANGE_POINTS];
+
+/**
+ * Snap a range to the nearest value the AS3935 can report
+ *
+ * @param range exact range (km)
+ * @return the closest entry of as3935_range_points
+ */
+double round_to_range_points(double range);
+
+/**
+ * @return index into as3935_range_points of the value a range snaps to
+ */
+int range_bin_index(double range);
+
+/**
+ * Ranges that the AS3935 would report as a given value
+ *
+ * The edges are halfway to the neighbouring values; the farthest bin has
+ * no upper edge because everything beyond it is reported as 40 km.
+ *
+ * @param reported reported range (km), snapped to the nearest bin first
+ * @param lo, hi receive the interval (km), hi may be HUGE_VAL
+ */
+void range_bin_interval(double reported, double *lo, double *hi);
+
+/**
+ * Optimizer used by Multilat::locate_strike
+ */
+enum SolverMode
+{
+    SOLVER_NELDER_MEAD,         // derivative-free, same as multi_algo.py
+    SOLVER_LEVENBERG_MARQUARDT, // IRLS on the L1 objective with an analytic Jacobian
+    SOLVER_INTERVAL             // centroid of the region consistent with the range bins
+};
+
+/**
+ * Standard deviation of the range error a reported bin implies
+ *
+ * The range is taken as uniform over the bin, so this is the bin width
+ * over sqrt(12). The farthest bin only bounds the range from below and
+ * gets HUGE_VAL.
+ *
+ * @param reported reported range (km)
+ * @return standard deviation (km)
+ */
+double range_bin_sigma(double reported);
+
+/**
+ * Factor applied to the covariance of Multilat::uncertainty
+ *
+ * Nearby stations see the same strike through the same bin edges, so
+ * their range errors are correlated and the bins carry less information
+ * than independent errors would. On the 28-station grid the truth falls
+ * in the nominal 95% ellipse on about 40% of fixes without it and 97%
+ * with it (bench_uncertainty).
+ */
+const double RANGE_BIN_COVARIANCE_INFLATION = 3.0;
+
+/**
+ * 1-sigma uncertainty of a fix in the local east/north plane
+ *
+ * Calibrated only when at least four stations report a bounded range. With
+ * three (the campus deployment) nothing is left over to tell the fix from
+ * its mirror across the stations, the linearization misses that, and the
+ * ellipse is only a lower bound on the error: lower_bound is set then.
+ */
+struct ErrorEllipse
+{
+    double cov_ee;          // covariance (km^2)
+    double cov_en;
+    double cov_nn;
+    double semi_major;      // km, HUGE_VAL if the fix is unconstrained along some direction
+    double semi_minor;      // km
+    double orientation;     // degrees clockwise from north of the major axis
+    bool lower_bound;       // fewer than four bounded reports, see above
+};
+
+/**
+ * Covariance and ellipse from the information matrix sum(g g^T / sigma^2)
+ * over stations, g being the range gradient in km per km east/north
+ */
+ErrorEllipse error_ellipse(double info_ee, double info_en, double info_nn);
+
+/**
+ * Result of one localization
+ */
+struct StrikeFix
+{
+    PointLatLon location;   // predicted strike location
+    double residual;        // value of the L1 objective at location (km)
+    int iterations;         // solver iterations
+    int evaluations;        // objective function evaluations
+    ErrorEllipse uncertainty;   // from the range gradients at location and the bin widths
+};
+
+/**
+ * East-north plane around the centroid of a station set, with the parts of
+ * the linearized seed that depend only on the geometry (solvers.h)
+ */
+struct LocalPlane
+{
+    PointLatLon centroid;
+    double km_per_deg_lat;
+    double km_per_deg_lon;
+    double seed_inverse[3];     // (A^T A)^-1 as {00, 01, 11}
+    double station_spread;      // farthest station from the centroid (km)
+    bool seed_degenerate;
+};
+
+/**
+ * Solver state carried from one fix to the next
+ *
+ * Successive strikes from one storm cell land close together, so the last
+ * fix and the scale the solver ended at are a better start than a cold
+ * seed.
+ */
+struct WarmStart
+{
+    PointLatLon location;   // where to start
+    double step;            // Nelder-Mead simplex size (degrees)
+    double lambda;          // Levenberg-Marquardt damping
+};
+
+/**
+ * Region consistent with a set of quantized range reports
+ */
+struct StrikeRegion
+{
+    PointLatLon centroid;   // area-weighted centre of the region
+    PointLatLon south_west; // bounding box
+    PointLatLon north_east;
+    double area;            // km^2
+    double slack;           // km the bins had to be widened by to intersect
+    int boxes;              // boxes visited by the subdivision
+    double resolution;      // km box edge reached, coarser than asked for if the region was too large
+};
+
+/**
+ * Range reports of many strikes against one station set
+ *
+ * Station-major, so one station's ranges for consecutive strikes are
+ * contiguous.
+ */
+struct StrikeBatch
+{
+    int strikes;
+    std::vector<double> ranges;     // ranges[station * strikes + strike] (km)
+};
+
+/**
+ * Fixes for a StrikeBatch, each array indexed by strike
+ */
+struct FixBatch
+{
+    std::vector<double> lat;
+    std::vector<double> lon;
+    std::vector<double> residual;
+    std::vector<int> iterations;
+    std::vector<int> evaluations;
+    std::vector<ErrorEllipse> uncertainty;
+};
+
+/**
+ * True-range multilateration of a lightning strike
+ *
+ * Minimizes the sum over stations of |distance(station, strike) - range|.
+ * The default haversine model with Nelder-Mead is the same objective and
+ * solver as multi_algo.py.
+ */
+class Multilat
+{
+public:
+    Multilat();
+
+    /**
+    * Constructor
+    *
+    * @param station_locations locations of the detection stations
+    */
+    explicit Multilat(const std::vector<PointLatLon> &station_locations);
+
+    /**
+    * Replace the station set
+    *
+    * @param station_locations locations of the detection stations
+    */
+    void set_stations(const std::vector<PointLatLon> &station_locations);
+
+    /**
+    * @return number of stations in the set
+    */
+    int number_of_stations() const;
+
+    /**
+    * @return location of station i
+    */
+    const PointLatLon &station(int i) const;
+
+    /**
+    * L1 objective: sum of absolute range errors for a strike guess
+    *
+    * @param guess candidate strike location
+    * @param station_ranges one range (km) per station
+    * @return sum of absolute errors (km)
+    */
+    double objective(const PointLatLon &guess, const double *station_ranges) const;
+
+    /**
+    * Closed-form starting point for the refinement solvers
+    *
+    * Projects the stations into a local east-north plane around their
+    * centroid and solves the linearized range equations by least squares.
+    * Falls back to the centroid when the stations are (nearly) collinear
+    * or the solution lands farther out than any reported range allows.
+    *
+    * @param station_ranges one range (km) per station
+    * @return starting point
+    */
+    PointLatLon initial_guess(const double *station_ranges) const;
+
+    /**
+    * Uncertainty of a fix from the range gradients at the fix and the
+    * widths of the reported bins (Gauss-Newton covariance), widened by the
+    * reduced chi-square of the misfit when the reports disagree by more
+    * than their bins allow. Costs about one objective evaluation; every
+    * locate_ call fills it in.
+    *
+    * @param location the fix
+    * @param station_ranges one reported range (km) per station
+    */
+    ErrorEllipse uncertainty(const PointLatLon &location, const double *station_ranges) const;
+
+    /**
+    * Intersect the annuli of the reported range bins
+    *
+    * Branch-and-bound over boxes in the local east-north plane: a box is
+    * dropped as soon as one station's annulus misses it, kept whole once it
+    * lies inside every annulus and split otherwise, down to the resolution.
+    * If the bins do not intersect (noisy reports) they are widened until
+    * they do. Boxes on the boundary are kept, so the region is an outer
+    * bound. A region that needs more than 65536 boxes at this resolution is
+    * resolved again at twice the box edge, as often as it takes; the edge
+    * reached is returned in StrikeRegion::resolution.
+    *
+    * @param station_ranges one reported range (km) per station
+    * @param resolution smallest box edge (km); anything but a positive
+    * value throws std::invalid_argument
+    * @return the feasible region
+    */
+    StrikeRegion locate_region(const std::vector<double> &station_ranges,
+                               double resolution = 0.25) const;
+
+    /**
+    * State a fix without a previous one starts from: initial_guess() when
+    * linearized_seed is on, x0 otherwise
+    *
+    * @param station_ranges one range (km) per station, in station order
+    * @return starting point and scale
+    */
+    WarmStart cold_start(const std::vector<double> &station_ranges) const;
+
+    /**
+    * Locate a strike from the ranges reported by every station
+    *
+    * @param station_ranges one range (km) per station, in station order
+    * @param mode optimizer to use for this fix
+    * @return the fix and its residual
+    */
+    StrikeFix locate_strike(const std::vector<double> &station_ranges,
+                            SolverMode mode = SOLVER_NELDER_MEAD) const;
+
+    /**
+    * Locate a strike starting from the state a previous solve ended in
+    *
+    * @param station_ranges one range (km) per station, in station order
+    * @param mode optimizer to use for this fix
+    * @param warm where to start and at what scale
+    * @param next if not null, receives the state to warm-start the next fix
+    * @return the fix and its residual
+    */
+    StrikeFix locate_strike(const std::vector<double> &station_ranges, SolverMode mode,
+                            const WarmStart &warm, WarmStart *next = nullptr) const;
+
+    /**
+    * Locate a strike while rejecting stations whose reports disagree
+    *
+    * RANSAC over three-station subsets: each subset is trilaterated in the
+    * local plane and scored by how many stations' range bins (widened by
+    * inlier_slack) contain the result. Sampling stops once the best
+    * consensus makes a better one unlikely, and the fix is refined on its
+    * inliers only. Stations reporting the farthest bin are scored but never
+    * sampled, since "40 km" only bounds the range from below.
+    *
+    * @param station_ranges one range (km) per station, in station order
+    * @param rejected if not null, receives the indices of rejected stations
+    * @param mode optimizer for the refinement
+    * @param pool if not null, subsets are scored on it in parallel
+    * @return the refined fix; evaluations include the subset scoring
+    */
+    StrikeFix locate_robust(const std::vector<double> &station_ranges, std::vector<int> *rejected,
+                            SolverMode mode = SOLVER_LEVENBERG_MARQUARDT,
+                            ThreadPool *pool = nullptr) const;
+
+    /**
+    * Locate many strikes against this station set
+    *
+    * Levenberg-Marquardt with the haversine model runs one strike per
+    * vector lane: the stations are looped over once per step for all
+    * lanes, and a lane that finishes is refilled with the next strike.
+    * Strikes are cut into blocks for the pool. The fixes match
+    * locate_strike up to rounding. Other modes and models loop over
+    * locate_strike, still on the pool.
+    *
+    * @param batch ranges of every strike, number_of_stations() per strike
+    * @param fixes receives one fix per strike
+    * @param mode optimizer to use
+    * @param pool if not null, blocks are solved on it in parallel
+    */
+    void locate_batch(const StrikeBatch &batch, FixBatch *fixes,
+                      SolverMode mode = SOLVER_LEVENBERG_MARQUARDT, ThreadPool *pool = nullptr) const;
+
+    DistanceModel distance_model;
+    bool linearized_seed;   // start from initial_guess() instead of x0
+    double seed_step;       // Nelder-Mead simplex size (degrees) around a seed
+    double search_radius;   // km around the stations searched by locate_region
+    PointLatLon x0;         // initial guess when linearized_seed is off
+    double tol;             // absolute objective tolerance (km)
+    double xtol;            // absolute location tolerance (degrees)
+    int max_itter;          // iteration and evaluation limit
+    double inlier_slack;    // km a station may miss its bin by and still count as an inlier
+    int max_subsets;        // subsets locate_robust tries at most
+
+private:
+    /**
+    * Distance from station i to a point and its gradient w.r.t. the point
+    *
+    * @param lat, lon point in radians
+    * @param cos_lat cosine of lat
+    * @param d_dlat, d_dlon receive the gradient in km per degree
+    * @return distance (km)
+    */
+    double range_gradient(int i, double lat, double lon, double cos_lat,
+                          double *d_dlat, double *d_dlon) const;
+
+    StrikeFix solve(const std::vector<double> &station_ranges, SolverMode mode,
+                    WarmStart *state) const;
+    StrikeFix solve_nelder_mead(const double *station_ranges, PointLatLon start,
+                                double *step) const;
+    StrikeFix solve_levenberg_marquardt(const double *station_ranges, PointLatLon start,
+                                        double *damping) const;
+
+    std::vector<PointLatLon> station_locations;
+    StationTable table;
+
+    // Local plane around the station centroid for the linearized seed
+    LocalPlane plane;
+    std::vector<double> east;           // km, relative to the mean station position
+    std::vector<double> north;
+    std::vector<double> norm_sq;        // east^2 + north^2 minus its mean
+};
+
+#endif
@@ -0,0 +1,220 @@
+#include "objective_surface.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "simd_ops.h"
+#include "thread_pool.h"
+
+namespace {
+
+// A tile's column trig and one row's station terms stay in L1 for the
+// whole tile; 16 rows per tile keeps tiles plentiful for stealing
+const int TILE_ROWS = 16;
+const int TILE_COLS = 256;
+
+// Longitude terms of every column, shared by all rows
+struct ColumnTrig
+{
+    std::vector<double> lon_rad;
+    std::vector<double> sin_half_lon;
+    std::vector<double> cos_half_lon;
+};
+
+/*
+ * Station terms that only depend on the row's latitude. Haversine keeps
+ * sin^2((lat - lat_i) / 2) and cos(lat) cos(lat_i); equirectangular keeps
+ * cos((lat + lat_i) / 2) and lat - lat_i. Both are formed exactly as
+ * distance_kernel.cpp forms them, so each cell matches batch_l1_objective.
+ */
+struct RowTerms
+{
+    void assign(const StationTable &s, DistanceModel model, double lat_deg)
+    {
+        double lat = lat_deg * PI_ON_180;
+        double c = std::cos(lat);
+        double sl = std::sin(0.5 * lat), cl = std::cos(0.5 * lat);
+        int n = s.size();
+        first.resize(n);
+        second.resize(n);
+        for (int i = 0; i < n; i++) {
+            if (model == DISTANCE_EQUIRECTANGULAR) {
+                first[i] = cl * s.cos_half_lat[i] - sl * s.sin_half_lat[i];
+                second[i] = lat - s.lat_rad[i];
+            } else {
+                double sin_dlat = sl * s.cos_half_lat[i] - cl * s.sin_half_lat[i];
+                first[i] = sin_dlat * sin_dlat;
+                second[i] = c * s.cos_lat[i];
+            }
+        }
+    }
+
+    std::vector<double> first;
+    std::vector<double> second;
+};
+
+template <typename Ops>
+void store_floats(float *out, typename Ops::V v)
+{
+    double lanes[Ops::width];
+    Ops::store(lanes, v);
+    for (int k = 0; k < Ops::width; k++) {
+        out[k] = (float)lanes[k];
+    }
+}
+
+// The raster is float, so the vector asin can stop its series early
+const int SURFACE_ASIN_TERMS = 6;
+
+template <typename Ops>
+struct SurfaceAsin
+{
+    static typename Ops::V apply(typename Ops::V y) { return vector_asin<Ops, SURFACE_ASIN_TERMS>(y); }
+};
+
+template <>
+struct SurfaceAsin<ScalarOps>
+{
+    static double apply(double y) { return std::asin(y); }
+};
+
+template <typename Ops>
+int haversine_row(const StationTable &s, const RowTerms &t, const ColumnTrig &col,
+                  const double *ranges, int c, int end, float *out)
+{
+    typedef typename Ops::V V;
+    for (; c + Ops::width <= end; c += Ops::width) {
+        V so = Ops::load(&col.sin_half_lon[c]);
+        V co = Ops::load(&col.cos_half_lon[c]);
+        V acc = Ops::set1(0.0);
+        for (int i = 0; i < s.size(); i++) {
+            V sin_dlon = Ops::sub(Ops::mul(so, Ops::set1(s.cos_half_lon[i])),
+                                  Ops::mul(co, Ops::set1(s.sin_half_lon[i])));
+            V a = Ops::add(Ops::set1(t.first[i]),
+                           Ops::mul(Ops::set1(t.second[i]), Ops::mul(sin_dlon, sin_dlon)));
+            a = Ops::min(a, Ops::set1(1.0));
+            V d = Ops::mul(Ops::set1(2.0 * EARTH_RADIUS_KM), SurfaceAsin<Ops>::apply(Ops::sqrt(a)));
+            acc = Ops::add(acc, Ops::abs(Ops::sub(d, Ops::set1(ranges[i]))));
+        }
+        store_floats<Ops>(out + c, acc);
+    }
+    return c;
+}
+
+template <typename Ops>
+int equirectangular_row(const StationTable &s, const RowTerms &t, const ColumnTrig &col,
+                        const double *ranges, int c, int end, float *out)
+{
+    typedef typename Ops::V V;
+    for (; c + Ops::width <= end; c += Ops::width) {
+        V lon = Ops::load(&col.lon_rad[c]);
+        V acc = Ops::set1(0.0);
+        for (int i = 0; i < s.size(); i++) {
+            V x = Ops::mul(Ops::sub(lon, Ops::set1(s.lon_rad[i])), Ops::set1(t.first[i]));
+            V y = Ops::set1(t.second[i]);
+            V d = Ops::mul(Ops::set1(EARTH_RADIUS_KM), Ops::sqrt(Ops::add(Ops::mul(x, x), Ops::mul(y, y))));
+            acc = Ops::add(acc, Ops::abs(Ops::sub(d, Ops::set1(ranges[i]))));
+        }
+        store_floats<Ops>(out + c, acc);
+    }
+    return c;
+}
+
+void put_le(unsigned char *p, uint64_t v, int bytes)
+{
+    for (int k = 0; k < bytes; k++) {
+        p[k] = (unsigned char)(v >> (8 * k));
+    }
+}
+
+void put_double(unsigned char *p, double x)
+{
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    put_le(p, bits, 8);
+}
+
+} // namespace
+
+void rasterize_objective(const StationTable &stations, DistanceModel model,
+                         const double *station_ranges, const RasterGrid &grid,
+                         float *values, ThreadPool *pool)
+{
+    if (grid.rows < 0 || grid.cols < 0) {
+        throw std::invalid_argument("rasterize_objective: negative grid size");
+    }
+
+    ColumnTrig col;
+    col.lon_rad.resize(grid.cols);
+    col.sin_half_lon.resize(grid.cols);
+    col.cos_half_lon.resize(grid.cols);
+    for (int c = 0; c < grid.cols; c++) {
+        double lon = (grid.origin.lon + c * grid.step_lon) * PI_ON_180;
+        col.lon_rad[c] = lon;
+        col.sin_half_lon[c] = std::sin(0.5 * lon);
+        col.cos_half_lon[c] = std::cos(0.5 * lon);
+    }
+
+    const int tile_rows = (grid.rows + TILE_ROWS - 1) / TILE_ROWS;
+    const int tile_cols = (grid.cols + TILE_COLS - 1) / TILE_COLS;
+    auto body = [&](int begin, int end) {
+        RowTerms terms;
+        for (int tile = begin; tile < end; tile++) {
+            int r0 = (tile / tile_cols) * TILE_ROWS;
+            int c0 = (tile % tile_cols) * TILE_COLS;
+            int r1 = std::min(grid.rows, r0 + TILE_ROWS);
+            int c1 = std::min(grid.cols, c0 + TILE_COLS);
+            for (int r = r0; r < r1; r++) {
+                terms.assign(stations, model, grid.origin.lat + r * grid.step_lat);
+                float *row = values + (size_t)r * grid.cols;
+                if (model == DISTANCE_EQUIRECTANGULAR) {
+                    int c = equirectangular_row<VectorOps>(stations, terms, col, station_ranges, c0, c1, row);
+                    equirectangular_row<ScalarOps>(stations, terms, col, station_ranges, c, c1, row);
+                } else {
+                    int c = haversine_row<VectorOps>(stations, terms, col, station_ranges, c0, c1, row);
+                    haversine_row<ScalarOps>(stations, terms, col, station_ranges, c, c1, row);
+                }
+            }
+        }
+    };
+    if (pool) {
+        pool->parallel_for(0, tile_rows * tile_cols, 1, body);
+    } else {
+        body(0, tile_rows * tile_cols);
+    }
+}
+
+bool write_raster(const char *path, const RasterGrid &grid, const float *values)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    unsigned char header[RASTER_HEADER_SIZE] = {0};
+    memcpy(header, "MLRAST01", 8);
+    put_le(header + 8, (uint32_t)grid.rows, 4);
+    put_le(header + 12, (uint32_t)grid.cols, 4);
+    put_double(header + 16, grid.origin.lat);
+    put_double(header + 24, grid.origin.lon);
+    put_double(header + 32, grid.step_lat);
+    put_double(header + 40, grid.step_lon);
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+
+    // One row at a time through a byte buffer, so the file is
+    // little-endian whatever the host is
+    std::vector<unsigned char> row((size_t)grid.cols * 4);
+    for (int r = 0; ok && r < grid.rows; r++) {
+        for (int c = 0; c < grid.cols; c++) {
+            uint32_t bits;
+            memcpy(&bits, &values[(size_t)r * grid.cols + c], sizeof(bits));
+            put_le(&row[(size_t)c * 4], bits, 4);
+        }
+        ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+    }
+    return fclose(f) == 0 && ok;
+}
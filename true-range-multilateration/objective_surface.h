@@ -0,0 +1,64 @@
+#ifndef OBJECTIVE_SURFACE_H
+#define OBJECTIVE_SURFACE_H
+
+#include "distance_kernel.h"
+
+class ThreadPool;
+
+/**
+ * Regular lat/lon grid, row 0 at the south edge
+ *
+ * Cell (row, col) is evaluated at origin + (row * step_lat, col * step_lon),
+ * the same points np.meshgrid(np.arange(...), np.arange(...)) gives in
+ * multi_algo.py.
+ */
+struct RasterGrid
+{
+    PointLatLon origin;     // cell (0, 0)
+    double step_lat;        // degrees between rows
+    double step_lon;        // degrees between columns
+    int rows;
+    int cols;
+};
+
+/**
+ * Evaluate the L1 objective on every cell of a grid
+ *
+ * The grid is cut into tiles that are dealt out to the pool. Within a row
+ * the latitude terms of every station are fixed, so each station costs a
+ * few multiplies per cell plus the square root and asin, and neighbouring
+ * columns go through the vector kernels together. Matches
+ * batch_l1_objective at each cell to rounding.
+ *
+ * @param stations station table
+ * @param model distance model
+ * @param station_ranges one range (km) per station
+ * @param grid cells to evaluate
+ * @param values receives grid.rows * grid.cols values (km), row-major
+ * @param pool if not null, tiles are evaluated on it in parallel
+ */
+void rasterize_objective(const StationTable &stations, DistanceModel model,
+                         const double *station_ranges, const RasterGrid &grid,
+                         float *values, ThreadPool *pool = nullptr);
+
+/** Bytes before the first value of a raster file */
+const int RASTER_HEADER_SIZE = 64;
+
+/**
+ * Write a raster for plotting tools to memory-map
+ *
+ * The file is a 64-byte header followed by rows * cols little-endian
+ * float32 values, row-major. The header is the magic "MLRAST01", rows and
+ * cols as int32, then origin lat, origin lon, step_lat and step_lon as
+ * float64, zero padded. From numpy:
+ *
+ *     np.memmap(path, dtype='<f4', mode='r', offset=64, shape=(rows, cols))
+ *
+ * @param path file to create
+ * @param grid grid the values were evaluated on
+ * @param values grid.rows * grid.cols values, row-major
+ * @return false if the file could not be written
+ */
+bool write_raster(const char *path, const RasterGrid &grid, const float *values);
+
+#endif
@@ -0,0 +1,157 @@
+// Native version of quantized_errors.py: the localization error caused by
+// AS3935 range quantization over a grid of simulated strikes.
+//
+//   g++ -O2 -mavx2 -std=c++14 -pthread -o quantized_errors quantized_errors.cc
+//       multilat.cpp region.cpp batch.cpp geodesy.cpp distance_kernel.cpp thread_pool.cpp
+//       objective_surface.cpp
+//   ./quantized_errors [--step 0.01] [--lat 33.5 34.2] [--lon -84.8 -84.0]
+//                      [--solver nm|lm] [--threads 0] [--out quantized_errors]
+//
+// Writes <out>.f32, the errors in km as a raster in write_raster's format
+// (one row per latitude, row 0 at --lat min), and <out>.csv. Load the
+// raster with
+//
+//     np.memmap('quantized_errors.f32', dtype='<f4', mode='r', offset=64, shape=(rows, cols))
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "multilat.h"
+#include "objective_surface.h"
+#include "thread_pool.h"
+
+namespace {
+
+// Strikes solved per batch
+const int BAND_STRIKES = 16384;
+
+// Same length rule as np.arange(start, stop, step)
+int arange_count(double start, double stop, double step)
+{
+    return std::max(0, (int)std::ceil((stop - start) / step));
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: quantized_errors [--step deg] [--lat min max] [--lon min max]\n"
+                    "                        [--solver nm|lm] [--threads n] [--out prefix]\n");
+    exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    double step = 0.01;
+    double lat_min = 33.5, lat_max = 34.2;
+    double lon_min = -84.8, lon_max = -84.0;
+    SolverMode mode = SOLVER_NELDER_MEAD;
+    int threads = 0;
+    const char *out = "quantized_errors";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--step") && i + 1 < argc) {
+            step = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--lat") && i + 2 < argc) {
+            lat_min = atof(argv[++i]);
+            lat_max = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--lon") && i + 2 < argc) {
+            lon_min = atof(argv[++i]);
+            lon_max = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--solver") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "lm")) {
+                mode = SOLVER_LEVENBERG_MARQUARDT;
+            } else if (strcmp(argv[i], "nm")) {
+                usage();
+            }
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (step <= 0) {
+        usage();
+    }
+
+    // Station grid from quantized_errors.py
+    std::vector<PointLatLon> station_locations;
+    for (int a = 0; a < arange_count(33.6, 34, 0.1); a++) {
+        for (int o = 0; o < arange_count(-84.7, -84.1, 0.1); o++) {
+            station_locations.push_back({33.6 + 0.1 * a, -84.7 + 0.1 * o});
+        }
+    }
+    Multilat multilat(station_locations);
+
+    const int rows = arange_count(lat_min, lat_max, step);
+    const int cols = arange_count(lon_min, lon_max, step);
+    std::vector<float> errors((size_t)rows * cols);
+
+    // Bands of whole latitude rows, each one batch: large enough to keep
+    // the pool busy, small enough that the ranges stay a few MB whatever
+    // the grid
+    const int n = (int)station_locations.size();
+    const int band_rows = std::max(1, BAND_STRIKES / std::max(cols, 1));
+    StrikeBatch batch;
+    FixBatch fixes;
+    ThreadPool pool(threads);
+    double elapsed = 0;
+    for (int row0 = 0; row0 < rows; row0 += band_rows) {
+        const int first = row0 * cols;
+        const int strikes = std::min(band_rows, rows - row0) * cols;
+        batch.strikes = strikes;
+        batch.ranges.resize((size_t)n * strikes);
+        for (int k = 0; k < strikes; k++) {
+            PointLatLon strike = {lat_min + step * ((first + k) / cols), lon_min + step * (k % cols)};
+            for (int s = 0; s < n; s++) {
+                batch.ranges[(size_t)s * strikes + k] = round_to_range_points(d_haversine(station_locations[s], strike));
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        multilat.locate_batch(batch, &fixes, mode, &pool);
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (int k = 0; k < strikes; k++) {
+            PointLatLon strike = {lat_min + step * ((first + k) / cols), lon_min + step * (k % cols)};
+            errors[first + k] = (float)d_haversine({fixes.lat[k], fixes.lon[k]}, strike);
+        }
+    }
+
+    std::string prefix(out);
+    RasterGrid grid = {{lat_min, lon_min}, step, step, rows, cols};
+    if (!write_raster((prefix + ".f32").c_str(), grid, errors.data())) {
+        fprintf(stderr, "could not write %s.f32\n", out);
+        return 1;
+    }
+
+    FILE *f = fopen((prefix + ".csv").c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "could not write %s.csv\n", out);
+        return 1;
+    }
+    fprintf(f, "lat,lon,error_km\n");
+    for (int k = 0; k < rows * cols; k++) {
+        fprintf(f, "%.6f,%.6f,%.4f\n", lat_min + step * (k / cols), lon_min + step * (k % cols),
+                errors[k]);
+    }
+    fclose(f);
+
+    double mean = 0;
+    for (float e : errors) {
+        mean += e;
+    }
+    printf("%d x %d strikes, %zu stations, %d threads: %.2f s (%.0f fixes/s), mean error %.3f km\n",
+           rows, cols, station_locations.size(), pool.size(), elapsed, rows * cols / elapsed,
+           mean / errors.size());
+    return 0;
+}
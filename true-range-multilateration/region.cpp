@@ -0,0 +1,146 @@
+#include "multilat.h"
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+struct Box
+{
+    double x0, y0, x1, y1;  // km, east-north plane around the station centroid
+    uint64_t undecided;     // stations whose annulus does not yet contain the box
+};
+
+// Squared nearest and farthest distance from (x, y) to any point of a box
+void box_distance_bounds(const Box &b, double x, double y, double *near_sq, double *far_sq)
+{
+    double dx = std::fmax(std::fmax(b.x0 - x, 0.0), x - b.x1);
+    double dy = std::fmax(std::fmax(b.y0 - y, 0.0), y - b.y1);
+    *near_sq = dx * dx + dy * dy;
+    double fx = std::fmax(std::fabs(x - b.x0), std::fabs(x - b.x1));
+    double fy = std::fmax(std::fabs(y - b.y0), std::fabs(y - b.y1));
+    *far_sq = fx * fx + fy * fy;
+}
+
+} // namespace
+
+StrikeRegion Multilat::locate_region(const std::vector<double> &station_ranges,
+                                     double resolution) const
+{
+    // Boxes would never get coarser, and every attempt would run out
+    if (!(resolution > 0)) {
+        throw std::invalid_argument("Multilat::locate_region: resolution must be positive");
+    }
+    const int n = number_of_stations();
+    const int max_boxes = 1 << 16;     // per attempt at one resolution
+
+    std::vector<double> lo(n), hi(n), lo_sq(n), hi_sq(n);
+    for (int i = 0; i < n; i++) {
+        range_bin_interval(station_ranges[i], &lo[i], &hi[i]);
+    }
+
+    // A box inside an annulus stays inside when split, so each box carries
+    // the stations still worth testing. Stations past the 64th are always
+    // tested.
+    const int tracked = n < 64 ? n : 64;
+    const uint64_t all_tracked = tracked == 64 ? ~(uint64_t)0 : ((uint64_t)1 << tracked) - 1;
+
+    StrikeRegion region = {plane.centroid, plane.centroid, plane.centroid, 0, 0, 0, resolution};
+    for (double slack = 0; slack <= 32; slack = slack == 0 ? 0.5 : 2 * slack) {
+        // Start from the intersection of the outer discs' bounding boxes
+        const double reach = search_radius + plane.station_spread;
+        Box start = {-reach, -reach, reach, reach, all_tracked};
+        for (int i = 0; i < n; i++) {
+            double l = std::fmax(lo[i] - slack, 0.0);
+            lo_sq[i] = l * l;
+            hi_sq[i] = (hi[i] + slack) * (hi[i] + slack);
+        }
+        for (int i = 0; i < n; i++) {
+            if (hi[i] != HUGE_VAL) {
+                start.x0 = std::fmax(start.x0, east[i] - hi[i] - slack);
+                start.x1 = std::fmin(start.x1, east[i] + hi[i] + slack);
+                start.y0 = std::fmax(start.y0, north[i] - hi[i] - slack);
+                start.y1 = std::fmin(start.y1, north[i] + hi[i] + slack);
+            }
+        }
+        if (start.x0 > start.x1 || start.y0 > start.y1) {
+            continue;
+        }
+
+        // A region too large to resolve within the box budget is resolved
+        // again with boxes twice the size, rather than summed up partially
+        double area, cx, cy;
+        Box bounds;
+        double edge = resolution / 2;
+        std::vector<Box> stack;
+        do {
+            edge *= 2;
+            area = cx = cy = 0;
+            bounds = {HUGE_VAL, HUGE_VAL, -HUGE_VAL, -HUGE_VAL, 0};
+            stack.assign(1, start);
+            int boxes = 0;
+            while (!stack.empty() && boxes < max_boxes) {
+                Box b = stack.back();
+                stack.pop_back();
+                boxes++;
+                region.boxes++;
+
+                bool excluded = false;
+                for (int i = 0; i < n && !excluded; i++) {
+                    uint64_t bit = i < 64 ? (uint64_t)1 << i : 0;
+                    if (i < 64 && !(b.undecided & bit)) {
+                        continue;
+                    }
+                    double near_sq, far_sq;
+                    box_distance_bounds(b, east[i], north[i], &near_sq, &far_sq);
+                    excluded = far_sq < lo_sq[i] || near_sq > hi_sq[i];
+                    if (near_sq >= lo_sq[i] && far_sq <= hi_sq[i]) {
+                        b.undecided &= ~bit;
+                    }
+                }
+                if (excluded) {
+                    continue;
+                }
+                bool inside = b.undecided == 0 && n <= 64;
+
+                double w = b.x1 - b.x0, h = b.y1 - b.y0;
+                if (!inside && (w > edge || h > edge)) {
+                    double mx = 0.5 * (b.x0 + b.x1), my = 0.5 * (b.y0 + b.y1);
+                    if (w >= h) {
+                        stack.push_back({b.x0, b.y0, mx, b.y1, b.undecided});
+                        stack.push_back({mx, b.y0, b.x1, b.y1, b.undecided});
+                    } else {
+                        stack.push_back({b.x0, b.y0, b.x1, my, b.undecided});
+                        stack.push_back({b.x0, my, b.x1, b.y1, b.undecided});
+                    }
+                    continue;
+                }
+
+                area += w * h;
+                cx += w * h * 0.5 * (b.x0 + b.x1);
+                cy += w * h * 0.5 * (b.y0 + b.y1);
+                bounds.x0 = std::fmin(bounds.x0, b.x0);
+                bounds.y0 = std::fmin(bounds.y0, b.y0);
+                bounds.x1 = std::fmax(bounds.x1, b.x1);
+                bounds.y1 = std::fmax(bounds.y1, b.y1);
+            }
+        } while (!stack.empty());
+
+        if (area > 0) {
+            cx /= area;
+            cy /= area;
+            region.centroid = {plane.centroid.lat + cy / plane.km_per_deg_lat,
+                               plane.centroid.lon + cx / plane.km_per_deg_lon};
+            region.south_west = {plane.centroid.lat + bounds.y0 / plane.km_per_deg_lat,
+                                 plane.centroid.lon + bounds.x0 / plane.km_per_deg_lon};
+            region.north_east = {plane.centroid.lat + bounds.y1 / plane.km_per_deg_lat,
+                                 plane.centroid.lon + bounds.x1 / plane.km_per_deg_lon};
+            region.area = area;
+            region.slack = slack;
+            region.resolution = edge;
+            return region;
+        }
+    }
+    return region;
+}
@@ -0,0 +1,201 @@
+#include "multilat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+namespace {
+
+struct Subset
+{
+    int a, b, c;
+};
+
+struct Score
+{
+    double cost;    // MSAC: squared bin miss, capped at inlier_slack^2
+    int inliers;
+    int sampled_inliers;    // inliers among the stations subsets are drawn from
+};
+
+// Probability that the best consensus found is not beaten by a subset
+// that has not been tried yet
+const double ROBUST_CONFIDENCE = 0.99;
+
+} // namespace
+
+StrikeFix Multilat::locate_robust(const std::vector<double> &station_ranges,
+                                  std::vector<int> *rejected, SolverMode mode,
+                                  ThreadPool *pool) const
+{
+    const int n = number_of_stations();
+    if ((int)station_ranges.size() != n) {
+        throw std::invalid_argument("Multilat::locate_robust: one range per station required");
+    }
+    if (rejected) {
+        rejected->clear();
+    }
+
+    std::vector<double> lo(n), hi(n);
+    std::vector<int> candidates;
+    for (int i = 0; i < n; i++) {
+        range_bin_interval(station_ranges[i], &lo[i], &hi[i]);
+        if (hi[i] != HUGE_VAL) {
+            candidates.push_back(i);
+        }
+    }
+    const int m = (int)candidates.size();
+    // With three reporting stations there is nothing to vote against
+    if (m < 4) {
+        return locate_strike(station_ranges, mode);
+    }
+
+    // Every subset when there are few, otherwise a fixed pseudo-random
+    // sequence so the same reports always give the same fix
+    std::vector<Subset> subsets;
+    long total = (long)m * (m - 1) * (m - 2) / 6;
+    if (total <= max_subsets) {
+        for (int a = 0; a < m; a++) {
+            for (int b = a + 1; b < m; b++) {
+                for (int c = b + 1; c < m; c++) {
+                    subsets.push_back({candidates[a], candidates[b], candidates[c]});
+                }
+            }
+        }
+    } else {
+        unsigned seed = 12345u;
+        auto draw = [&seed, m]() {
+            seed = seed * 1103515245u + 12345u;
+            return (int)((seed >> 8) % (unsigned)m);
+        };
+        for (int k = 0; k < max_subsets; k++) {
+            int a = draw(), b = draw(), c = draw();
+            while (b == a) {
+                b = draw();
+            }
+            while (c == a || c == b) {
+                c = draw();
+            }
+            subsets.push_back({candidates[a], candidates[b], candidates[c]});
+        }
+    }
+
+    /*
+     * Each hypothesis is the exact trilateration of its three stations in
+     * the seed's local plane: subtracting station a's circle from b's and
+     * c's leaves two linear equations. Quantized circles need not meet, and
+     * then this is their radical centre, still within a bin width or so.
+     */
+    const double slack_sq = inlier_slack * inlier_slack;
+    auto score = [&](const Subset &s, PointLatLon *at, std::vector<double> *distances) {
+        double a00 = 2 * (east[s.b] - east[s.a]), a01 = 2 * (north[s.b] - north[s.a]);
+        double a10 = 2 * (east[s.c] - east[s.a]), a11 = 2 * (north[s.c] - north[s.a]);
+        double det = a00 * a11 - a01 * a10;
+        double scale = std::hypot(a00, a01) * std::hypot(a10, a11);
+        if (std::fabs(det) <= 1E-3 * scale) {
+            return Score{HUGE_VAL, 0, 0};
+        }
+        double ra = station_ranges[s.a];
+        double r0 = norm_sq[s.b] - norm_sq[s.a] - (station_ranges[s.b] * station_ranges[s.b] - ra * ra);
+        double r1 = norm_sq[s.c] - norm_sq[s.a] - (station_ranges[s.c] * station_ranges[s.c] - ra * ra);
+        double x = (a11 * r0 - a01 * r1) / det;
+        double y = (a00 * r1 - a10 * r0) / det;
+        *at = {plane.centroid.lat + y / plane.km_per_deg_lat,
+               plane.centroid.lon + x / plane.km_per_deg_lon};
+
+        distances->resize(n);
+        if (distance_model == DISTANCE_EQUIRECTANGULAR) {
+            batch_equirectangular(table, *at, distances->data());
+        } else {
+            batch_haversine(table, *at, distances->data());
+        }
+        Score result = {0, 0, 0};
+        for (int i = 0; i < n; i++) {
+            double d = (*distances)[i];
+            double miss = d < lo[i] ? lo[i] - d : d > hi[i] ? d - hi[i] : 0;
+            if (miss <= inlier_slack) {
+                result.inliers++;
+                result.sampled_inliers += hi[i] != HUGE_VAL;
+                result.cost += miss * miss;
+            } else {
+                result.cost += slack_sq;
+            }
+        }
+        return result;
+    };
+
+    const int batch = pool ? 4 * pool->size() : 4;
+    std::vector<Score> scores(subsets.size());
+    std::vector<PointLatLon> hypotheses(subsets.size());
+    int best = -1;
+    int tried = 0;
+    while (tried < (int)subsets.size()) {
+        int end = std::min((int)subsets.size(), tried + batch);
+        auto body = [&](int begin, int stop) {
+            std::vector<double> distances;
+            for (int k = begin; k < stop; k++) {
+                scores[k] = score(subsets[k], &hypotheses[k], &distances);
+            }
+        };
+        if (pool) {
+            pool->parallel_for(tried, end, 1, body);
+        } else {
+            body(tried, end);
+        }
+        for (int k = tried; k < end; k++) {
+            if (best < 0 || scores[k].cost < scores[best].cost) {
+                best = k;
+            }
+        }
+        tried = end;
+
+        // Standard RANSAC bound on the subsets needed to draw an all-inlier
+        // one, with the inlier ratio of the best consensus so far among the
+        // stations the subsets come from
+        double w = std::fmin(1.0, (double)scores[best].sampled_inliers / m);
+        if (w >= 1.0) {
+            break;
+        }
+        double all_inliers = w * w * w;
+        if (all_inliers > 0 && tried >= std::log(1 - ROBUST_CONFIDENCE) / std::log(1 - all_inliers)) {
+            break;
+        }
+    }
+
+    std::vector<int> keep;
+    if (best >= 0 && scores[best].cost < HUGE_VAL) {
+        std::vector<double> distances(n);
+        score(subsets[best], &hypotheses[best], &distances);
+        for (int i = 0; i < n; i++) {
+            double d = distances[i];
+            double miss = d < lo[i] ? lo[i] - d : d > hi[i] ? d - hi[i] : 0;
+            if (miss <= inlier_slack) {
+                keep.push_back(i);
+            } else if (rejected) {
+                rejected->push_back(i);
+            }
+        }
+    }
+
+    StrikeFix fix;
+    if (keep.size() < 3 || (int)keep.size() == n) {
+        if (rejected) {
+            rejected->clear();
+        }
+        fix = locate_strike(station_ranges, mode);
+    } else {
+        std::vector<PointLatLon> subset;
+        std::vector<double> ranges;
+        for (int i : keep) {
+            subset.push_back(station_locations[i]);
+            ranges.push_back(station_ranges[i]);
+        }
+        Multilat inliers(*this);
+        inliers.set_stations(subset);
+        fix = inliers.locate_strike(ranges, mode);
+    }
+    fix.evaluations += tried;
+    return fix;
+}
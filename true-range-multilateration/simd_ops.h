@@ -0,0 +1,140 @@
+#ifndef SIMD_OPS_H
+#define SIMD_OPS_H
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Vector operations for the batch kernels (distance_kernel.cpp,
+ * objective_surface.cpp), which are written once against this small set.
+ * The widest path the compiler was told about (-mavx2, SSE2 on any x86-64)
+ * handles whole blocks of stations and the scalar path finishes the tail,
+ * so results do not depend on how the stations line up with the vectors.
+ */
+
+namespace {
+
+struct ScalarOps
+{
+    typedef double V;
+    static const int width = 1;
+    static V load(const double *p) { return *p; }
+    static void store(double *p, V v) { *p = v; }
+    static V set1(double x) { return x; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static V sqrt(V a) { return std::sqrt(a); }
+    static V min(V a, V b) { return a < b ? a : b; }
+    static V max(V a, V b) { return a > b ? a : b; }
+    static V abs(V a) { return std::fabs(a); }
+    static V greater(V a, double b) { return a > b ? 1.0 : 0.0; }
+    static V blend(V a, V b, V mask) { return mask != 0 ? b : a; }
+    static double hsum(V a) { return a; }
+    static V asin(V a) { return std::asin(a); }
+};
+
+/*
+ * asin on [0, 1] for the vector paths. Each half-angle step
+ * asin(y) = 2 asin(y / sqrt(2 (1 + sqrt(1 - y^2)))) is only taken when some
+ * lane needs it, so the common case (ranges under ~1200 km) goes straight
+ * to the series, which is accurate to double precision below 0.2 with all
+ * 13 terms. Callers that round the result to float can take fewer: after
+ * 6 terms the relative error is below 1E-10.
+ */
+template <typename Ops, int terms = 13>
+typename Ops::V vector_asin(typename Ops::V y)
+{
+    typedef typename Ops::V V;
+    const double threshold = 0.2;
+    V scale = Ops::set1(1.0);
+    for (int step = 0; step < 3 && Ops::any_greater(y, threshold); step++) {
+        V reduced = Ops::div(y, Ops::sqrt(Ops::mul(Ops::set1(2.0),
+                    Ops::add(Ops::set1(1.0), Ops::sqrt(Ops::sub(Ops::set1(1.0), Ops::mul(y, y)))))));
+        V mask = Ops::greater(y, threshold);
+        y = Ops::blend(y, reduced, mask);
+        scale = Ops::blend(scale, Ops::add(scale, scale), mask);
+    }
+
+    // asin(x) = sum (2n)! / (4^n (n!)^2 (2n + 1)) x^(2n + 1)
+    static const double c[] = {
+        1.0, 1.0 / 6, 3.0 / 40, 15.0 / 336, 105.0 / 3456, 945.0 / 42240,
+        10395.0 / 599040, 135135.0 / 9676800, 2027025.0 / 175472640,
+        34459425.0 / 3530096640.0, 654729075.0 / 78033715200.0,
+        13749310575.0 / 1880240947200.0, 316234143225.0 / 48957460070400.0
+    };
+    static_assert(terms >= 1 && terms <= (int)(sizeof(c) / sizeof(c[0])), "vector_asin: 1 to 13 terms");
+    V y2 = Ops::mul(y, y);
+    V poly = Ops::set1(c[terms - 1]);
+    for (int k = terms - 2; k >= 0; k--) {
+        poly = Ops::add(Ops::mul(poly, y2), Ops::set1(c[k]));
+    }
+    return Ops::mul(scale, Ops::mul(y, poly));
+}
+
+#if defined(__AVX2__)
+struct VectorOps
+{
+    typedef __m256d V;
+    static const int width = 4;
+    static V load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+    static V set1(double x) { return _mm256_set1_pd(x); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V sqrt(V a) { return _mm256_sqrt_pd(a); }
+    static V min(V a, V b) { return _mm256_min_pd(a, b); }
+    static V max(V a, V b) { return _mm256_max_pd(a, b); }
+    static V abs(V a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static V greater(V a, double b) { return _mm256_cmp_pd(a, _mm256_set1_pd(b), _CMP_GT_OQ); }
+    static bool any_greater(V a, double b) { return _mm256_movemask_pd(greater(a, b)) != 0; }
+    static V blend(V a, V b, V mask) { return _mm256_blendv_pd(a, b, mask); }
+    static double hsum(V a)
+    {
+        __m128d lo = _mm256_castpd256_pd128(a);
+        __m128d hi = _mm256_extractf128_pd(a, 1);
+        lo = _mm_add_pd(lo, hi);
+        return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+    }
+    static V asin(V a) { return vector_asin<VectorOps>(a); }
+};
+const char *const kernel_isa = "avx2";
+#elif defined(__SSE2__)
+struct VectorOps
+{
+    typedef __m128d V;
+    static const int width = 2;
+    static V load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+    static V set1(double x) { return _mm_set1_pd(x); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm_div_pd(a, b); }
+    static V sqrt(V a) { return _mm_sqrt_pd(a); }
+    static V min(V a, V b) { return _mm_min_pd(a, b); }
+    static V max(V a, V b) { return _mm_max_pd(a, b); }
+    static V abs(V a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a); }
+    static V greater(V a, double b) { return _mm_cmpgt_pd(a, _mm_set1_pd(b)); }
+    static bool any_greater(V a, double b) { return _mm_movemask_pd(greater(a, b)) != 0; }
+    static V blend(V a, V b, V mask) { return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a)); }
+    static double hsum(V a) { return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a))); }
+    static V asin(V a) { return vector_asin<VectorOps>(a); }
+};
+const char *const kernel_isa = "sse2";
+#else
+typedef ScalarOps VectorOps;
+const char *const kernel_isa = "scalar";
+#endif
+
+} // namespace
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef SOLVERS_H
+#define SOLVERS_H
+
+#include <cmath>
+
+#include "multilat.h"
+
+/*
+ * The 2D optimizers behind Multilat and StaticMultilat, written against
+ * the objective (and, for Levenberg-Marquardt, per-station residuals) so
+ * each engine can supply its own distance evaluation, and the seed and
+ * uncertainty both engines share, over plain station arrays.
+ */
+
+/*
+ * Two-dimensional Nelder-Mead, step for step the scipy 'nelder-mead' method
+ * (non-adaptive coefficients, 5% initial simplex) so fixes agree with
+ * multi_algo.py. A positive initial_step replaces the 5% simplex with a
+ * fixed one, for starting points that are already close; it receives the
+ * size of the final simplex.
+ */
+template <typename Objective>
+StrikeFix nelder_mead(const Objective &f, PointLatLon start, double *initial_step,
+                      double xatol, double fatol, int max_itter)
+{
+    const double rho = 1.0, chi = 2.0, psi = 0.5, sigma = 0.5;
+    const double nonzdelt = 0.05, zdelt = 0.00025;
+
+    PointLatLon sim[3];
+    double fsim[3];
+    sim[0] = start;
+    sim[1] = start;
+    sim[2] = start;
+    if (*initial_step > 0) {
+        sim[1].lat += *initial_step;
+        sim[2].lon += *initial_step;
+    } else {
+        sim[1].lat = start.lat != 0 ? (1 + nonzdelt) * start.lat : zdelt;
+        sim[2].lon = start.lon != 0 ? (1 + nonzdelt) * start.lon : zdelt;
+    }
+
+    int fcalls = 0;
+    for (int k = 0; k < 3; k++) {
+        fsim[k] = f(sim[k]);
+    }
+    fcalls += 3;
+
+    auto sort_simplex = [&]() {
+        for (int i = 1; i < 3; i++) {
+            for (int j = i; j > 0 && fsim[j] < fsim[j - 1]; j--) {
+                double tf = fsim[j]; fsim[j] = fsim[j - 1]; fsim[j - 1] = tf;
+                PointLatLon tp = sim[j]; sim[j] = sim[j - 1]; sim[j - 1] = tp;
+            }
+        }
+    };
+    sort_simplex();
+
+    int iterations = 1;
+    while (fcalls < max_itter && iterations < max_itter) {
+        double xspread = 0, fspread = 0;
+        for (int k = 1; k < 3; k++) {
+            xspread = std::fmax(xspread, std::fabs(sim[k].lat - sim[0].lat));
+            xspread = std::fmax(xspread, std::fabs(sim[k].lon - sim[0].lon));
+            fspread = std::fmax(fspread, std::fabs(fsim[0] - fsim[k]));
+        }
+        if (xspread <= xatol && fspread <= fatol) {
+            break;
+        }
+
+        PointLatLon xbar = {0.5 * (sim[0].lat + sim[1].lat), 0.5 * (sim[0].lon + sim[1].lon)};
+        auto along = [&](double t) {
+            // xbar + t * (xbar - worst)
+            PointLatLon p = {(1 + t) * xbar.lat - t * sim[2].lat,
+                             (1 + t) * xbar.lon - t * sim[2].lon};
+            return p;
+        };
+
+        PointLatLon xr = along(rho);
+        double fxr = f(xr);
+        fcalls++;
+        bool doshrink = false;
+
+        if (fxr < fsim[0]) {
+            PointLatLon xe = along(rho * chi);
+            double fxe = f(xe);
+            fcalls++;
+            if (fxe < fxr) {
+                sim[2] = xe;
+                fsim[2] = fxe;
+            } else {
+                sim[2] = xr;
+                fsim[2] = fxr;
+            }
+        } else if (fxr < fsim[1]) {
+            sim[2] = xr;
+            fsim[2] = fxr;
+        } else if (fxr < fsim[2]) {
+            PointLatLon xc = along(psi * rho);
+            double fxc = f(xc);
+            fcalls++;
+            if (fxc <= fxr) {
+                sim[2] = xc;
+                fsim[2] = fxc;
+            } else {
+                doshrink = true;
+            }
+        } else {
+            PointLatLon xcc = along(-psi);
+            double fxcc = f(xcc);
+            fcalls++;
+            if (fxcc < fsim[2]) {
+                sim[2] = xcc;
+                fsim[2] = fxcc;
+            } else {
+                doshrink = true;
+            }
+        }
+
+        if (doshrink) {
+            for (int k = 1; k < 3; k++) {
+                sim[k].lat = sim[0].lat + sigma * (sim[k].lat - sim[0].lat);
+                sim[k].lon = sim[0].lon + sigma * (sim[k].lon - sim[0].lon);
+                fsim[k] = f(sim[k]);
+                fcalls++;
+            }
+        }
+
+        iterations++;
+        sort_simplex();
+    }
+
+    double final_step = 0;
+    for (int k = 1; k < 3; k++) {
+        final_step = std::fmax(final_step, std::fabs(sim[k].lat - sim[0].lat));
+        final_step = std::fmax(final_step, std::fabs(sim[k].lon - sim[0].lon));
+    }
+    *initial_step = final_step;
+
+    StrikeFix fix;
+    fix.location = sim[0];
+    fix.residual = fsim[0];
+    fix.iterations = iterations;
+    fix.evaluations = fcalls;
+    return fix;
+}
+
+// Levenberg-Marquardt constants, shared with the lane-parallel copy in batch.cpp
+const double LM_IRLS_FLOOR = 1E-3;      // km, keeps weights finite at zero residual
+const double LM_IRLS_START = 0.3;       // km, floor the weights start from
+const double LM_STALL = 1E-2;           // km, least decrease of a short step that counts as progress
+const double LM_MAX_STEP = 5.0;         // degrees
+
+/*
+ * Reweighted normal equations at x from one station at a time, for
+ * levenberg_marquardt where no station table is at hand (StaticMultilat).
+ * residual(i, lat, lon, cos_lat, &d_dlat, &d_dlon) returns station i's
+ * range error at a point given in radians and its gradient in km per
+ * degree; the sums are those of batch_l1_normal_equations with irls_floor
+ * floor.
+ */
+template <typename Residual>
+void irls_normal_equations(int n, const Residual &residual, const PointLatLon &x, double floor,
+                           double *jtj, double *jtr)
+{
+    double lat = x.lat * PI_ON_180;
+    double lon = x.lon * PI_ON_180;
+    double cos_lat = std::cos(lat);
+    jtj[0] = jtj[1] = jtj[2] = 0;
+    jtr[0] = jtr[1] = 0;
+    for (int i = 0; i < n; i++) {
+        double g_lat, g_lon;
+        double r = residual(i, lat, lon, cos_lat, &g_lat, &g_lon);
+        double w = 1.0 / std::fmax(std::fabs(r), floor);
+        jtj[0] += w * g_lat * g_lat;
+        jtj[1] += w * g_lat * g_lon;
+        jtj[2] += w * g_lon * g_lon;
+        jtr[0] += w * g_lat * r;
+        jtr[1] += w * g_lon * r;
+    }
+}
+
+/*
+ * Levenberg-Marquardt on the L1 objective f. normal_equations(x, floor,
+ * jtj, jtr) fills the reweighted normal equations at x with the weights
+ * floored at floor, as batch_l1_normal_equations does. damping is the
+ * starting lambda and receives the final one.
+ */
+template <typename Objective, typename NormalEquations>
+StrikeFix levenberg_marquardt(const Objective &f, const NormalEquations &normal_equations,
+                              PointLatLon start, double *damping,
+                              double xtol, double tol, int max_itter)
+{
+    /*
+     * The L1 objective is minimized by iteratively reweighted least squares:
+     * each step is a damped Gauss-Newton step on sum(w_i * r_i^2) with
+     * w_i = 1 / max(|r_i|, floor), which has the same minimizer. The
+     * damping (lambda) follows the usual Levenberg-Marquardt schedule on
+     * the true L1 objective, and steps are capped so a far-off start does
+     * not jump past the stations.
+     *
+     * A station whose residual reaches zero gets a weight of 1 / floor and
+     * pins the steps to its circle even where the minimum lies across it;
+     * the steps shrink but keep paying off. So the floor starts at
+     * LM_IRLS_START and drops tenfold each time the solve settles, and a
+     * short step only ends a stage once it stops gaining LM_STALL.
+     */
+    PointLatLon x = start;
+    double fx = f(x);
+    double lambda = *damping;
+    double floor = LM_IRLS_START;
+    int evaluations = 1;
+    int iterations = 0;
+    bool converged = false;
+
+    while (!converged && iterations < max_itter && evaluations < max_itter) {
+        iterations++;
+
+        // Normal equations of the weighted problem
+        double jtj[3], jtr[2];
+        normal_equations(x, floor, jtj, jtr);
+        double jtj00 = jtj[0], jtj01 = jtj[1], jtj11 = jtj[2], jtr0 = jtr[0], jtr1 = jtr[1];
+
+        bool accepted = false;
+        while (!accepted && evaluations < max_itter) {
+            // Additive damping keeps the step in the range of J when the
+            // stations are nearly co-located and J^T W J is close to rank one
+            double mu = lambda * (jtj00 + jtj11) + 1E-12;
+            double a00 = jtj00 + mu;
+            double a11 = jtj11 + mu;
+            double det = a00 * a11 - jtj01 * jtj01;
+            double step_lat = -(a11 * jtr0 - jtj01 * jtr1) / det;
+            double step_lon = -(a00 * jtr1 - jtj01 * jtr0) / det;
+            double step = std::fmax(std::fabs(step_lat), std::fabs(step_lon));
+            if (step > LM_MAX_STEP) {
+                step_lat *= LM_MAX_STEP / step;
+                step_lon *= LM_MAX_STEP / step;
+                step = LM_MAX_STEP;
+            }
+
+            PointLatLon candidate = {x.lat + step_lat, x.lon + step_lon};
+            double fc = f(candidate);
+            evaluations++;
+            if (fc <= fx) {
+                converged = (step <= xtol && fx - fc <= LM_STALL) || fx - fc <= tol * 1E-3;
+                x = candidate;
+                fx = fc;
+                lambda = std::fmax(lambda * 0.1, 1E-9);
+                accepted = true;
+            } else if (step <= xtol) {
+                // No descent left at the resolution we care about
+                converged = true;
+                break;
+            } else {
+                lambda *= 10;
+            }
+        }
+        if (!accepted && !converged) {
+            break;
+        }
+        if (converged && floor > LM_IRLS_FLOOR) {
+            // Settled with these weights; sharpen them and go on
+            floor = std::fmax(0.1 * floor, LM_IRLS_FLOOR);
+            converged = false;
+        }
+    }
+
+    *damping = lambda;
+
+    StrikeFix fix;
+    fix.location = x;
+    fix.residual = fx;
+    fix.iterations = iterations;
+    fix.evaluations = evaluations;
+    return fix;
+}
+
+/*
+ * Distance from a station to a point and its gradient w.r.t. the point, with
+ * both in radians and the gradient in km per degree
+ */
+inline double station_range_gradient(DistanceModel distance_model, double station_lat,
+                                     double station_lon, double station_cos_lat,
+                                     double lat, double lon, double cos_lat,
+                                     double *d_dlat, double *d_dlon)
+{
+    double dlat = lat - station_lat;
+    double dlon = lon - station_lon;
+
+    if (distance_model == DISTANCE_EQUIRECTANGULAR) {
+        double mid = 0.5 * (lat + station_lat);
+        double cos_mid = std::cos(mid);
+        double x = dlon * cos_mid;
+        double y = dlat;
+        double norm = std::sqrt(x * x + y * y);
+        if (norm < 1E-12) {
+            *d_dlat = 0;
+            *d_dlon = 0;
+            return 0;
+        }
+        double scale = EARTH_RADIUS_KM * PI_ON_180 / norm;
+        *d_dlat = scale * (y - 0.5 * x * dlon * std::sin(mid));
+        *d_dlon = scale * x * cos_mid;
+        return EARTH_RADIUS_KM * norm;
+    }
+
+    double sin_half_dlat = std::sin(0.5 * dlat);
+    double sin_half_dlon = std::sin(0.5 * dlon);
+    double cos_product = station_cos_lat * cos_lat;
+    double a = sin_half_dlat * sin_half_dlat + cos_product * sin_half_dlon * sin_half_dlon;
+    a = std::fmin(a, 1.0);
+    double d = EARTH_RADIUS_KM * 2.0 * std::asin(std::sqrt(a));
+
+    // d(d)/da = R / sqrt(a (1 - a)); undefined on top of the station or its antipode
+    double denom = std::sqrt(a * (1.0 - a));
+    if (denom < 1E-15) {
+        *d_dlat = 0;
+        *d_dlon = 0;
+        return d;
+    }
+    double da_dlat = 0.5 * std::sin(dlat)
+                     - station_cos_lat * std::sin(lat) * sin_half_dlon * sin_half_dlon;
+    double da_dlon = 0.5 * cos_product * std::sin(dlon);
+    double scale = EARTH_RADIUS_KM * PI_ON_180 / denom;
+    *d_dlat = scale * da_dlat;
+    *d_dlon = scale * da_dlon;
+    return d;
+}
+
+/*
+ * Project n stations onto the east-north plane around their centroid and
+ * precompute the linearized seed's (A^T A)^-1. Rows of A are
+ * 2 * (east_i, north_i); the centroid is the origin.
+ */
+inline void project_stations(const PointLatLon *stations, int n, LocalPlane *plane,
+                             double *east, double *north, double *norm_sq)
+{
+    plane->centroid = {0, 0};
+    for (int i = 0; i < n; i++) {
+        plane->centroid.lat += stations[i].lat / n;
+        plane->centroid.lon += stations[i].lon / n;
+    }
+    plane->km_per_deg_lat = EARTH_RADIUS_KM * PI_ON_180;
+    plane->km_per_deg_lon = plane->km_per_deg_lat * std::cos(plane->centroid.lat * PI_ON_180);
+
+    double mean_norm_sq = 0;
+    plane->station_spread = 0;
+    for (int i = 0; i < n; i++) {
+        east[i] = (stations[i].lon - plane->centroid.lon) * plane->km_per_deg_lon;
+        north[i] = (stations[i].lat - plane->centroid.lat) * plane->km_per_deg_lat;
+        norm_sq[i] = east[i] * east[i] + north[i] * north[i];
+        mean_norm_sq += norm_sq[i] / n;
+        plane->station_spread = std::fmax(plane->station_spread, std::sqrt(norm_sq[i]));
+    }
+
+    double ata00 = 0, ata01 = 0, ata11 = 0;
+    for (int i = 0; i < n; i++) {
+        norm_sq[i] -= mean_norm_sq;
+        ata00 += 4 * east[i] * east[i];
+        ata01 += 4 * east[i] * north[i];
+        ata11 += 4 * north[i] * north[i];
+    }
+    double det = ata00 * ata11 - ata01 * ata01;
+    double trace = ata00 + ata11;
+    plane->seed_degenerate = n < 3 || det <= 1E-6 * trace * trace;
+    if (!plane->seed_degenerate) {
+        plane->seed_inverse[0] = ata11 / det;
+        plane->seed_inverse[1] = -ata01 / det;
+        plane->seed_inverse[2] = ata00 / det;
+    }
+}
+
+/*
+ * Linearized least-squares seed (Multilat::initial_guess) from the
+ * projection project_stations made
+ */
+inline PointLatLon linearized_guess(const LocalPlane &plane, const double *east, const double *north,
+                                    const double *norm_sq, int n, const double *station_ranges)
+{
+    if (plane.seed_degenerate) {
+        return plane.centroid;
+    }
+
+    /*
+     * Subtracting the mean of |p - s_i|^2 = r_i^2 over all stations removes
+     * |p|^2 and leaves 2 s_i . p = (|s_i|^2 - mean) - (r_i^2 - mean), which
+     * is linear in the strike position p.
+     */
+    double mean_range_sq = 0;
+    double max_range = 0;
+    for (int i = 0; i < n; i++) {
+        mean_range_sq += station_ranges[i] * station_ranges[i] / n;
+        max_range = std::fmax(max_range, station_ranges[i]);
+    }
+    double atb0 = 0, atb1 = 0;
+    for (int i = 0; i < n; i++) {
+        double b = norm_sq[i] - (station_ranges[i] * station_ranges[i] - mean_range_sq);
+        atb0 += 2 * east[i] * b;
+        atb1 += 2 * north[i] * b;
+    }
+    double x = plane.seed_inverse[0] * atb0 + plane.seed_inverse[1] * atb1;
+    double y = plane.seed_inverse[1] * atb0 + plane.seed_inverse[2] * atb1;
+
+    if (std::sqrt(x * x + y * y) > max_range + plane.station_spread) {
+        return plane.centroid;
+    }
+    PointLatLon guess = {plane.centroid.lat + y / plane.km_per_deg_lat,
+                         plane.centroid.lon + x / plane.km_per_deg_lon};
+    return guess;
+}
+
+/*
+ * Uncertainty of a fix from the range gradients at the fix and the widths
+ * of the reported bins (Multilat::uncertainty). gradient(i, &g_lat, &g_lon)
+ * returns station i's distance to the fix and its gradient in km per
+ * degree.
+ */
+template <typename Gradient>
+ErrorEllipse bin_uncertainty(const PointLatLon &location, int n, const double *station_ranges,
+                             const Gradient &gradient)
+{
+    double km_per_deg = EARTH_RADIUS_KM * PI_ON_180;
+    double km_per_deg_east = std::fmax(km_per_deg * std::cos(location.lat * PI_ON_180), 1E-9);
+
+    double info_ee = 0, info_en = 0, info_nn = 0;
+    double chi_sq = 0;
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        double sigma = range_bin_sigma(station_ranges[i]);
+        if (sigma == HUGE_VAL) {
+            continue;
+        }
+        double g_lat, g_lon;
+        double d = gradient(i, &g_lat, &g_lon);
+        double g_e = g_lon / km_per_deg_east;
+        double g_n = g_lat / km_per_deg;
+        double w = 1 / (sigma * sigma);
+        info_ee += w * g_e * g_e;
+        info_en += w * g_e * g_n;
+        info_nn += w * g_n * g_n;
+        chi_sq += w * (d - station_ranges[i]) * (d - station_ranges[i]);
+        used++;
+    }
+    // Reports that disagree by more than their bins allow mean the bins
+    // understate the error (or the fix is off); widen by the misfit
+    double scale = used > 2 ? std::fmax(1.0, chi_sq / (used - 2)) : 1.0;
+    scale *= RANGE_BIN_COVARIANCE_INFLATION;
+    ErrorEllipse e = error_ellipse(info_ee / scale, info_en / scale, info_nn / scale);
+    e.lower_bound = used < 4;
+    return e;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#include "static_multilat.h"
+
+template class StaticMultilat<3>;
+template class StaticMultilat<4>;
+template class StaticMultilat<5>;
+template class StaticMultilat<6>;
+template class StaticMultilat<7>;
+template class StaticMultilat<8>;
+
+namespace {
+
+// Multilat behind the StrikeLocator interface, for station counts without
+// a StaticMultilat instantiation
+class DynamicLocator : public StrikeLocator
+{
+public:
+    explicit DynamicLocator(const std::vector<PointLatLon> &station_locations)
+        : multilat(station_locations)
+    {
+    }
+
+    int number_of_stations() const override { return multilat.number_of_stations(); }
+
+    StrikeFix locate(const std::vector<double> &station_ranges, SolverMode mode) const override
+    {
+        return multilat.locate_strike(station_ranges, mode);
+    }
+
+private:
+    Multilat multilat;
+};
+
+} // namespace
+
+std::unique_ptr<StrikeLocator> make_strike_locator(const std::vector<PointLatLon> &station_locations)
+{
+    switch (station_locations.size()) {
+    case 3: return std::unique_ptr<StrikeLocator>(new StaticMultilat<3>(station_locations));
+    case 4: return std::unique_ptr<StrikeLocator>(new StaticMultilat<4>(station_locations));
+    case 5: return std::unique_ptr<StrikeLocator>(new StaticMultilat<5>(station_locations));
+    case 6: return std::unique_ptr<StrikeLocator>(new StaticMultilat<6>(station_locations));
+    case 7: return std::unique_ptr<StrikeLocator>(new StaticMultilat<7>(station_locations));
+    case 8: return std::unique_ptr<StrikeLocator>(new StaticMultilat<8>(station_locations));
+    default: return std::unique_ptr<StrikeLocator>(new DynamicLocator(station_locations));
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef STATIC_MULTILAT_H
+#define STATIC_MULTILAT_H
+
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "distance_models.h"
+#include "multilat.h"
+#include "solvers.h"
+#include "strike_locator.h"
+
+/**
+ * Multilateration over a fixed number of stations
+ *
+ * Same objective, seed and solvers as Multilat, but the station trig lives
+ * in std::array members and every loop runs to the compile-time N, so the
+ * compiler unrolls the objective and keeps it in registers. The seed and
+ * uncertainty are the shared ones from solvers.h. Nothing on the Nelder-
+ * Mead and Levenberg-Marquardt solve paths touches the heap; interval mode
+ * builds a Multilat over the same stations per call. The distance model
+ * is a policy from distance_models.h, so it is inlined into the objective
+ * too. make_strike_locator instantiates the haversine engine for N = 3..8.
+ */
+template <int N, typename Distance = HaversineDistance>
+class StaticMultilat : public StrikeLocator
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param station_locations locations of exactly N detection stations
+    */
+    explicit StaticMultilat(const std::vector<PointLatLon> &station_locations)
+        : seed_step(0.05), tol(1E-6), xtol(1E-4), max_itter(5000)
+    {
+        if ((int)station_locations.size() != N) {
+            throw std::invalid_argument("StaticMultilat: wrong number of stations");
+        }
+        for (int i = 0; i < N; i++) {
+            locations[i] = station_locations[i];
+            stations[i] = Distance::station(station_locations[i]);
+        }
+        project_stations(locations.data(), N, &plane, east.data(), north.data(), norm_sq.data());
+    }
+
+    int number_of_stations() const override { return N; }
+
+    /**
+    * L1 objective under the Distance model
+    */
+    double objective(const PointLatLon &guess, const double *station_ranges) const
+    {
+        typename Distance::Point p = Distance::point(guess.lat * PI_ON_180, guess.lon * PI_ON_180);
+        double sum = 0;
+        for (int i = 0; i < N; i++) {
+            sum += std::fabs(Distance::distance(stations[i], p) - station_ranges[i]);
+        }
+        return sum;
+    }
+
+    /**
+    * Locate a strike from one range per station
+    */
+    StrikeFix locate_strike(const std::array<double, N> &station_ranges,
+                            SolverMode mode = SOLVER_NELDER_MEAD) const
+    {
+        const double *ranges = station_ranges.data();
+        if (mode == SOLVER_INTERVAL) {
+            Multilat interval(std::vector<PointLatLon>(locations.begin(), locations.end()));
+            interval.distance_model = Distance::runtime_model;
+            return interval.locate_strike(std::vector<double>(ranges, ranges + N), mode);
+        }
+        PointLatLon start = initial_guess(ranges);
+        auto f = [this, ranges](const PointLatLon &p) { return objective(p, ranges); };
+        StrikeFix fix;
+        if (mode == SOLVER_LEVENBERG_MARQUARDT) {
+            // The solver asks for every station at one point before moving,
+            // so the point terms are built once per point
+            typename Distance::Point p = Distance::point(0, 0);
+            double p_lat = 0, p_lon = 0;
+            auto residual = [this, ranges, &p, &p_lat, &p_lon](int i, double lat, double lon, double,
+                                                              double *g_lat, double *g_lon) {
+                if (lat != p_lat || lon != p_lon) {
+                    p = Distance::point(lat, lon);
+                    p_lat = lat;
+                    p_lon = lon;
+                }
+                return Distance::gradient(stations[i], p, g_lat, g_lon) - ranges[i];
+            };
+            double damping = 1E-3;
+            auto normal_equations = [&residual](const PointLatLon &x, double floor,
+                                                double *jtj, double *jtr) {
+                irls_normal_equations(N, residual, x, floor, jtj, jtr);
+            };
+            fix = levenberg_marquardt(f, normal_equations, start, &damping, xtol, tol, max_itter);
+        } else {
+            double step = seed_step;
+            fix = nelder_mead(f, start, &step, xtol, tol, max_itter);
+        }
+        fix.uncertainty = uncertainty(fix.location, ranges);
+        return fix;
+    }
+
+    /**
+    * Uncertainty of a fix, as Multilat::uncertainty
+    */
+    ErrorEllipse uncertainty(const PointLatLon &location, const double *station_ranges) const
+    {
+        typename Distance::Point p = Distance::point(location.lat * PI_ON_180,
+                                                     location.lon * PI_ON_180);
+        auto gradient = [this, &p](int i, double *g_lat, double *g_lon) {
+            return Distance::gradient(stations[i], p, g_lat, g_lon);
+        };
+        return bin_uncertainty(location, N, station_ranges, gradient);
+    }
+
+    StrikeFix locate(const std::vector<double> &station_ranges, SolverMode mode) const override
+    {
+        if ((int)station_ranges.size() != N) {
+            throw std::invalid_argument("StaticMultilat::locate: one range per station required");
+        }
+        std::array<double, N> ranges;
+        for (int i = 0; i < N; i++) {
+            ranges[i] = station_ranges[i];
+        }
+        return locate_strike(ranges, mode);
+    }
+
+    /**
+    * Linearized least-squares seed, as Multilat::initial_guess
+    */
+    PointLatLon initial_guess(const double *station_ranges) const
+    {
+        return linearized_guess(plane, east.data(), north.data(), norm_sq.data(), N, station_ranges);
+    }
+
+    double seed_step;       // Nelder-Mead simplex size (degrees) around the seed
+    double tol;             // absolute objective tolerance (km)
+    double xtol;            // absolute location tolerance (degrees)
+    int max_itter;          // iteration and evaluation limit
+
+private:
+    std::array<PointLatLon, N> locations;
+    std::array<typename Distance::Station, N> stations;
+
+    LocalPlane plane;
+    std::array<double, N> east, north, norm_sq;
+};
+
+extern template class StaticMultilat<3>;
+extern template class StaticMultilat<4>;
+extern template class StaticMultilat<5>;
+extern template class StaticMultilat<6>;
+extern template class StaticMultilat<7>;
+extern template class StaticMultilat<8>;
+
+#endif
@@ -0,0 +1,105 @@
+#include "station_registry.h"
+
+#include <algorithm>
+#include <cmath>
+
+StationRegistry::StationRegistry(double cell_km)
+    : sensor_range(as3935_range_points[0]), cell_deg(cell_km / (EARTH_RADIUS_KM * PI_ON_180))
+{
+}
+
+long long StationRegistry::cell_key(int row, int col) const
+{
+    return ((long long)row << 32) ^ (unsigned int)col;
+}
+
+int StationRegistry::row_of(double lat) const
+{
+    return (int)std::floor(lat / cell_deg);
+}
+
+int StationRegistry::col_of(double lon) const
+{
+    return (int)std::floor(lon / cell_deg);
+}
+
+int StationRegistry::add(const PointLatLon &location)
+{
+    int id = (int)locations.size();
+    locations.push_back(location);
+    cells[cell_key(row_of(location.lat), col_of(location.lon))].push_back(id);
+    return id;
+}
+
+void StationRegistry::within(const PointLatLon &center, double radius, std::vector<int> *ids) const
+{
+    ids->clear();
+    double dlat = radius / (EARTH_RADIUS_KM * PI_ON_180);
+    // Longitude degrees shrink toward the poles; size the span for the
+    // highest latitude the disc reaches
+    double max_lat = std::fmin(89.0, std::fabs(center.lat) + dlat);
+    double dlon = dlat / std::cos(max_lat * PI_ON_180);
+
+    for (int row = row_of(center.lat - dlat); row <= row_of(center.lat + dlat); row++) {
+        for (int col = col_of(center.lon - dlon); col <= col_of(center.lon + dlon); col++) {
+            std::unordered_map<long long, std::vector<int>>::const_iterator cell =
+                cells.find(cell_key(row, col));
+            if (cell == cells.end()) {
+                continue;
+            }
+            for (int id : cell->second) {
+                if (d_haversine(center, locations[id]) <= radius) {
+                    ids->push_back(id);
+                }
+            }
+        }
+    }
+}
+
+void StationRegistry::select(const StrikeJob &job, std::vector<int> *ids,
+                             std::vector<double> *ranges) const
+{
+    ids->assign(job.stations.begin(), job.stations.end());
+    ranges->assign(job.ranges.begin(), job.ranges.end());
+    if (job.stations.empty()) {
+        return;
+    }
+
+    // The strike is within the upper bin edge of the closest reporter, so
+    // every station that could have seen it is within sensor range of that
+    size_t closest = 0;
+    for (size_t i = 1; i < job.ranges.size(); i++) {
+        if (job.ranges[i] < job.ranges[closest]) {
+            closest = i;
+        }
+    }
+    double lo, hi;
+    range_bin_interval(job.ranges[closest], &lo, &hi);
+    if (hi == HUGE_VAL) {
+        hi = sensor_range;
+    }
+
+    std::vector<int> nearby;
+    within(locations[job.stations[closest]], hi + sensor_range, &nearby);
+    std::sort(nearby.begin(), nearby.end());
+    for (int id : nearby) {
+        if (!std::binary_search(job.stations.begin(), job.stations.end(), id)) {
+            ids->push_back(id);
+            ranges->push_back(as3935_range_points[0]);
+        }
+    }
+}
+
+StrikeFix StationRegistry::locate(const StrikeJob &job, SolverMode mode) const
+{
+    std::vector<int> ids;
+    std::vector<double> ranges;
+    select(job, &ids, &ranges);
+
+    std::vector<PointLatLon> subset(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        subset[i] = locations[ids[i]];
+    }
+    Multilat multilat(subset);
+    return multilat.locate_strike(ranges, mode);
+}
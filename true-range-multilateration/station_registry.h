@@ -0,0 +1,81 @@
+#ifndef STATION_REGISTRY_H
+#define STATION_REGISTRY_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "multilat.h"
+#include "strike_correlator.h"
+
+/**
+ * Every station of a network, bucketed on a lat/lon grid
+ *
+ * The AS3935 cannot see past 40 km, so a strike only involves the stations
+ * that reported it and the silent ones close enough that they would have.
+ * The grid answers "stations within r km" by visiting the few cells that
+ * overlap the disc, which keeps per-fix cost flat as the network grows.
+ */
+class StationRegistry
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param cell_km grid cell edge (km); around the sensor range works well
+    */
+    explicit StationRegistry(double cell_km = 40);
+
+    /**
+    * Add a station
+    *
+    * @return station id, as used in StrikeReport::station
+    */
+    int add(const PointLatLon &location);
+
+    int size() const { return (int)locations.size(); }
+    const PointLatLon &location(int id) const { return locations[id]; }
+
+    /**
+    * Stations within a distance of a point
+    *
+    * @param center query point
+    * @param radius distance (km)
+    * @param ids receives the station ids, unordered
+    */
+    void within(const PointLatLon &center, double radius, std::vector<int> *ids) const;
+
+    /**
+    * Stations that take part in localizing a job
+    *
+    * The reporting stations, plus silent stations within sensor range of
+    * the area the reports allow. Silent stations are given the farthest
+    * bin, which is what the AS3935 model reports past its range.
+    *
+    * @param job reports of one strike
+    * @param ids receives the station ids
+    * @param ranges receives one range per id
+    */
+    void select(const StrikeJob &job, std::vector<int> *ids, std::vector<double> *ranges) const;
+
+    /**
+    * Localize a job against the stations chosen by select()
+    *
+    * @param job reports of one strike
+    * @param mode solver
+    * @return the fix
+    */
+    StrikeFix locate(const StrikeJob &job, SolverMode mode = SOLVER_LEVENBERG_MARQUARDT) const;
+
+    double sensor_range;    // km within which a silent station counts as "saw nothing"
+
+private:
+    long long cell_key(int row, int col) const;
+    int row_of(double lat) const;
+    int col_of(double lon) const;
+
+    double cell_deg;
+    std::vector<PointLatLon> locations;
+    std::unordered_map<long long, std::vector<int>> cells;
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include "storm_cells.h"
+
+#include <algorithm>
+#include <cmath>
+
+StormCellClusterer::StormCellClusterer(double eps, int min_strikes, long long window,
+                                       size_t max_strikes)
+    : eps(eps), min_strikes(min_strikes), window(window), max_strikes(std::max<size_t>(max_strikes, 1)),
+      have_origin(false), origin({0, 0}), km_per_deg(EARTH_RADIUS_KM * PI_ON_180),
+      first_seq(0), next_cell(0)
+{
+}
+
+namespace {
+
+// Rows are eps of latitude; within a row, columns are eps of longitude at
+// the row's middle latitude
+int grid_row(double lat, double eps, double km_per_deg)
+{
+    return (int)std::floor(lat * km_per_deg / eps);
+}
+
+int grid_col(double lon, double cos_row, double eps, double km_per_deg)
+{
+    return (int)std::floor(lon * km_per_deg * cos_row / eps);
+}
+
+long long row_col_key(int row, int col)
+{
+    return ((long long)row << 32) ^ (unsigned int)col;
+}
+
+} // namespace
+
+double StormCellClusterer::row_cos(int row) const
+{
+    double lat = (row + 0.5) * eps / km_per_deg;
+    return std::fmax(std::cos(lat * PI_ON_180), 1E-6);
+}
+
+long long StormCellClusterer::grid_key(const Point &p) const
+{
+    int row = grid_row(p.lat, eps, km_per_deg);
+    return row_col_key(row, grid_col(p.lon, row_cos(row), eps, km_per_deg));
+}
+
+void StormCellClusterer::add_to(Summary *s, const Point &p, double sign) const
+{
+    double dlat = p.lat - origin.lat, dlon = p.lon - origin.lon;
+    s->sum_lat += sign * dlat;
+    s->sum_lon += sign * dlon;
+    s->sum_lat_sq += sign * dlat * dlat;
+    s->sum_lon_sq += sign * dlon * dlon;
+}
+
+void StormCellClusterer::neighbours_of(long long seq, std::vector<long long> *out)
+{
+    out->clear();
+    const Point &p = point(seq);
+    int row = grid_row(p.lat, eps, km_per_deg);
+    // Longitude eps can span on the poleward side of the neighbourhood
+    double poleward = std::fabs(p.lat) + eps / km_per_deg;
+    double reach = eps / (km_per_deg * std::fmax(std::cos(poleward * PI_ON_180), 1E-6));
+    for (int r = row - 1; r <= row + 1; r++) {
+        double cos_row = row_cos(r);
+        int col_lo = grid_col(p.lon - reach, cos_row, eps, km_per_deg);
+        int col_hi = grid_col(p.lon + reach, cos_row, eps, km_per_deg);
+        for (int c = col_lo; c <= col_hi; c++) {
+            std::unordered_map<long long, std::vector<long long>>::const_iterator cell =
+                grid.find(row_col_key(r, c));
+            if (cell == grid.end()) {
+                continue;
+            }
+            for (long long other : cell->second) {
+                const Point &q = point(other);
+                // Mean of the two cosines keeps the test symmetric, so
+                // neighbour counts added and removed always match
+                double dx = (q.lon - p.lon) * km_per_deg * 0.5 * (p.cos_lat + q.cos_lat);
+                double dy = (q.lat - p.lat) * km_per_deg;
+                if (other != seq && dx * dx + dy * dy <= eps * eps) {
+                    out->push_back(other);
+                }
+            }
+        }
+    }
+}
+
+int StormCellClusterer::find(int cell)
+{
+    // Path halving keeps the chains short without recursion
+    while (parent[cell] != cell) {
+        int up = parent[parent[cell]];
+        parent[cell] = up;
+        cell = up;
+    }
+    return cell;
+}
+
+int StormCellClusterer::new_cell()
+{
+    int id = next_cell++;
+    parent[id] = id;
+    summaries[id] = {0, 0, 0, 0, 0, 0};
+    return id;
+}
+
+int StormCellClusterer::join(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+        return a;
+    }
+    Summary &sa = summaries[a], &sb = summaries[b];
+    if (sa.strikes < sb.strikes) {
+        std::swap(a, b);
+    }
+    Summary &big = summaries[a];
+    const Summary &small = summaries[b];
+    big.strikes += small.strikes;
+    big.sum_lat += small.sum_lat;
+    big.sum_lon += small.sum_lon;
+    big.sum_lat_sq += small.sum_lat_sq;
+    big.sum_lon_sq += small.sum_lon_sq;
+    big.last_time = std::max(big.last_time, small.last_time);
+    summaries.erase(b);
+    parent[b] = a;
+    return a;
+}
+
+void StormCellClusterer::attach(long long seq, int cell)
+{
+    Point &p = point(seq);
+    p.cell = cell;
+    Summary &s = summaries[cell];
+    s.strikes++;
+    add_to(&s, p, 1);
+    s.last_time = std::max(s.last_time, p.time);
+}
+
+int StormCellClusterer::insert(const PointLatLon &location, long long time)
+{
+    expire(time);
+    if (points.size() >= max_strikes) {
+        remove_oldest();
+    }
+    if (!have_origin) {
+        have_origin = true;
+        origin = location;
+    }
+
+    Point p;
+    p.lat = location.lat;
+    p.lon = location.lon;
+    p.cos_lat = std::cos(location.lat * PI_ON_180);
+    p.time = time;
+    p.neighbours = 1;
+    p.cell = -1;
+    long long seq = first_seq + (long long)points.size();
+    points.push_back(p);
+    grid[grid_key(p)].push_back(seq);
+
+    neighbours_of(seq, &scratch);
+    point(seq).neighbours += (int)scratch.size();
+    for (long long n : scratch) {
+        point(n).neighbours++;
+    }
+
+    // Only the new strike and neighbours that just reached min_strikes can
+    // have become core, so only their neighbourhoods need linking
+    std::vector<long long> cores;
+    if (point(seq).neighbours >= min_strikes) {
+        cores.push_back(seq);
+    }
+    for (long long n : scratch) {
+        if (point(n).neighbours == min_strikes) {
+            cores.push_back(n);
+        }
+    }
+    for (long long c : cores) {
+        neighbours_of(c, &around);
+        int cell = point(c).cell >= 0 ? find(point(c).cell) : -1;
+        for (long long m : around) {
+            const Point &q = point(m);
+            if (q.cell >= 0 && q.neighbours >= min_strikes) {
+                cell = cell < 0 ? find(q.cell) : join(cell, q.cell);
+            }
+        }
+        if (cell < 0) {
+            cell = new_cell();
+        }
+        if (point(c).cell < 0) {
+            attach(c, cell);
+        }
+        for (long long m : around) {
+            if (point(m).cell < 0) {
+                attach(m, cell);
+            }
+        }
+    }
+
+    // A border strike joins any core strike it reaches
+    if (point(seq).cell < 0) {
+        for (long long n : scratch) {
+            if (point(n).cell >= 0 && point(n).neighbours >= min_strikes) {
+                attach(seq, find(point(n).cell));
+                break;
+            }
+        }
+    }
+
+    if (parent.size() > 2 * summaries.size() + 1024) {
+        compact();
+    }
+    return point(seq).cell < 0 ? -1 : find(point(seq).cell);
+}
+
+void StormCellClusterer::remove_oldest()
+{
+    long long seq = first_seq;
+    const Point &p = points.front();
+
+    std::unordered_map<long long, std::vector<long long>>::iterator cell = grid.find(grid_key(p));
+    std::vector<long long> &bucket = cell->second;
+    *std::find(bucket.begin(), bucket.end(), seq) = bucket.back();
+    bucket.pop_back();
+    if (bucket.empty()) {
+        grid.erase(cell);
+    }
+
+    neighbours_of(seq, &scratch);
+    for (long long n : scratch) {
+        point(n).neighbours--;
+    }
+
+    if (p.cell >= 0) {
+        int root = find(p.cell);
+        Summary &s = summaries[root];
+        s.strikes--;
+        add_to(&s, p, -1);
+        if (s.strikes == 0) {
+            summaries.erase(root);
+        }
+    }
+    points.pop_front();
+    first_seq++;
+}
+
+void StormCellClusterer::expire(long long now)
+{
+    while (!points.empty() && points.front().time <= now - window) {
+        remove_oldest();
+    }
+}
+
+void StormCellClusterer::compact()
+{
+    // Point every strike straight at its root, then forget merged and
+    // emptied ids so the union-find tables stay proportional to live cells
+    for (Point &p : points) {
+        if (p.cell >= 0) {
+            p.cell = find(p.cell);
+        }
+    }
+    parent.clear();
+    for (const std::pair<const int, Summary> &s : summaries) {
+        parent[s.first] = s.first;
+    }
+}
+
+std::vector<StormCell> StormCellClusterer::cells() const
+{
+    std::vector<StormCell> out;
+    double minutes = window / 60000.0;
+    for (const std::pair<const int, Summary> &entry : summaries) {
+        const Summary &s = entry.second;
+        if (s.strikes == 0) {
+            continue;
+        }
+        double mean_lat = s.sum_lat / s.strikes;
+        double mean_lon = s.sum_lon / s.strikes;
+        double var_lat = std::max(0.0, s.sum_lat_sq / s.strikes - mean_lat * mean_lat);
+        double var_lon = std::max(0.0, s.sum_lon_sq / s.strikes - mean_lon * mean_lon);
+        PointLatLon centroid = {origin.lat + mean_lat, origin.lon + mean_lon};
+        double km_per_deg_lon = km_per_deg * std::cos(centroid.lat * PI_ON_180);
+        double spread = var_lat * km_per_deg * km_per_deg + var_lon * km_per_deg_lon * km_per_deg_lon;
+
+        StormCell cell;
+        cell.id = entry.first;
+        cell.centroid = centroid;
+        cell.strikes = s.strikes;
+        cell.flash_rate = s.strikes / minutes;
+        cell.extent = 2 * std::sqrt(spread);
+        cell.last_time = s.last_time;
+        out.push_back(cell);
+    }
+    std::sort(out.begin(), out.end(),
+              [](const StormCell &a, const StormCell &b) { return a.id < b.id; });
+    return out;
+}
@@ -0,0 +1,122 @@
+#ifndef STORM_CELLS_H
+#define STORM_CELLS_H
+
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "geodesy.h"
+
+/**
+ * Summary of one storm cell
+ */
+struct StormCell
+{
+    int id;
+    PointLatLon centroid;
+    int strikes;            // strikes in the window
+    double flash_rate;      // strikes per minute over the window
+    double extent;          // km, twice the RMS distance of strikes from the centroid
+    long long last_time;    // ms
+};
+
+/**
+ * Online density-based clustering of located strikes into storm cells
+ *
+ * DBSCAN-style: a strike with at least min_strikes strikes (itself
+ * included) within eps km is a core strike, and core strikes within eps
+ * of each other share a cell. Distances are flat-earth with the east-west
+ * scale taken at the strikes' own latitude, so storms anywhere measure
+ * the same. Strikes are bucketed on a grid of eps-sized cells (rows of
+ * latitude, each with its own longitude width), so an insert or expiry
+ * only visits the cells around it. Cells merge as soon as a strike links them; they are not
+ * split when a bridging strike expires, they just age out of the window.
+ *
+ * Strikes older than the window are dropped, and at most max_strikes are
+ * kept, which bounds memory and per-insert work during a heavy storm.
+ */
+class StormCellClusterer
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param eps neighbourhood radius (km)
+    * @param min_strikes strikes within eps that make a core strike
+    * @param window sliding time window (ms)
+    * @param max_strikes strikes kept before the oldest are dropped early
+    */
+    StormCellClusterer(double eps, int min_strikes, long long window, size_t max_strikes = 65536);
+
+    /**
+    * Add a located strike; strikes must arrive in time order
+    *
+    * @return id of its cell, or -1 while it is noise
+    */
+    int insert(const PointLatLon &location, long long time);
+
+    /**
+    * Drop strikes that fell out of the window
+    *
+    * @param now current time (ms)
+    */
+    void expire(long long now);
+
+    /**
+    * @return every cell with at least one strike in the window
+    */
+    std::vector<StormCell> cells() const;
+
+    size_t strikes() const { return points.size(); }
+
+private:
+    struct Point
+    {
+        double lat, lon;    // degrees
+        double cos_lat;
+        long long time;
+        int neighbours;     // strikes within eps, itself included
+        int cell;           // -1 for noise, otherwise a (possibly merged) cell id
+    };
+
+    // Sums of degrees relative to origin, which only keeps them small
+    struct Summary
+    {
+        int strikes;
+        double sum_lat, sum_lon, sum_lat_sq, sum_lon_sq;
+        long long last_time;
+    };
+
+    double row_cos(int row) const;
+    long long grid_key(const Point &p) const;
+    void add_to(Summary *s, const Point &p, double sign) const;
+    Point &point(long long seq) { return points[seq - first_seq]; }
+    void neighbours_of(long long seq, std::vector<long long> *out);
+    int find(int cell);
+    int new_cell();
+    int join(int a, int b);
+    void attach(long long seq, int cell);
+    void remove_oldest();
+    void compact();
+
+    double eps;
+    int min_strikes;
+    long long window;
+    size_t max_strikes;
+
+    bool have_origin;
+    PointLatLon origin;
+    double km_per_deg;
+
+    std::deque<Point> points;   // time order
+    long long first_seq;
+    std::unordered_map<long long, std::vector<long long>> grid;
+    std::unordered_map<int, int> parent;        // union-find over cell ids
+    std::unordered_map<int, Summary> summaries; // by root id
+    int next_cell;
+    std::vector<long long> scratch;
+    std::vector<long long> around;
+};
+
+#endif
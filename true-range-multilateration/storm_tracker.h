@@ -0,0 +1,186 @@
+#ifndef STORM_TRACKER_H
+#define STORM_TRACKER_H
+
+#include <cmath>
+
+#include "geodesy.h"
+
+/**
+ * Closest approach of a tracked storm cell to a point
+ */
+struct StormApproach
+{
+    double distance;        // km at closest approach (now, if the cell is moving away)
+    double eta;             // hours until closest approach, 0 if it is moving away
+    bool approaching;
+};
+
+/**
+ * Constant-velocity Kalman filter over one storm cell's fixes
+ *
+ * The state is position and velocity in a local east/north plane (km,
+ * km/h) about the first fix, driven by white-noise acceleration. With an
+ * isotropic fix error the east and north axes never couple, so the filter
+ * runs as two independent two-state filters: an update is a fixed couple of
+ * dozen multiplies and one divide per axis, with no allocation, and Real
+ * can be float on targets without a double FPU.
+ */
+template <typename Real>
+class StormTracker
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param fix_sigma standard deviation of a fix (km)
+    * @param acceleration_sigma standard deviation of the cell's acceleration (km/h^2)
+    * @param speed_sigma prior standard deviation of the cell's speed (km/h)
+    */
+    StormTracker(Real fix_sigma = 3, Real acceleration_sigma = 20, Real speed_sigma = 60)
+        : fix_var(fix_sigma * fix_sigma), accel_var(acceleration_sigma * acceleration_sigma),
+          speed_var(speed_sigma * speed_sigma), fixes(0), last_time(0)
+    {
+    }
+
+    /**
+    * Fold in one fix; fixes must arrive in time order
+    *
+    * @param fix strike location
+    * @param time strike time (ms)
+    */
+    void update(const PointLatLon &fix, long long time)
+    {
+        if (fixes == 0) {
+            origin = fix;
+            km_per_deg_lat = (Real)(EARTH_RADIUS_KM * PI_ON_180);
+            km_per_deg_lon = km_per_deg_lat * (Real)std::cos(fix.lat * PI_ON_180);
+            east.reset(0, fix_var, speed_var);
+            north.reset(0, fix_var, speed_var);
+        } else {
+            Real dt = (Real)(time - last_time) / (Real)3600000;
+            Real x = (Real)(fix.lon - origin.lon) * km_per_deg_lon;
+            Real y = (Real)(fix.lat - origin.lat) * km_per_deg_lat;
+            east.predict(dt, accel_var);
+            north.predict(dt, accel_var);
+            east.correct(x, fix_var);
+            north.correct(y, fix_var);
+        }
+        fixes++;
+        last_time = time;
+    }
+
+    /**
+    * @return number of fixes folded in
+    */
+    long count() const { return fixes; }
+
+    /**
+    * @return time of the last fix (ms)
+    */
+    long long time() const { return last_time; }
+
+    /**
+    * @return filtered position at the last fix
+    */
+    PointLatLon position() const
+    {
+        return {origin.lat + north.position / km_per_deg_lat, origin.lon + east.position / km_per_deg_lon};
+    }
+
+    /**
+    * @return predicted position at a later time (ms)
+    */
+    PointLatLon predict(long long time) const
+    {
+        Real dt = (Real)(time - last_time) / (Real)3600000;
+        return {origin.lat + (north.position + north.velocity * dt) / km_per_deg_lat,
+                origin.lon + (east.position + east.velocity * dt) / km_per_deg_lon};
+    }
+
+    Real velocity_east() const { return east.velocity; }     // km/h
+    Real velocity_north() const { return north.velocity; }   // km/h
+    Real speed() const { return std::sqrt(east.velocity * east.velocity + north.velocity * north.velocity); }
+
+    /**
+    * @return standard deviation of the filtered position (km, per axis)
+    */
+    Real position_sigma() const { return std::sqrt((Real)0.5 * (east.p00 + north.p00)); }
+
+    /**
+    * @return standard deviation of the velocity (km/h, per axis)
+    */
+    Real velocity_sigma() const { return std::sqrt((Real)0.5 * (east.p11 + north.p11)); }
+
+    /**
+    * Closest approach of the cell to a point on its current heading
+    *
+    * @param point e.g. the user's location
+    */
+    StormApproach closest_approach(const PointLatLon &point) const
+    {
+        Real rx = east.position - (Real)(point.lon - origin.lon) * km_per_deg_lon;
+        Real ry = north.position - (Real)(point.lat - origin.lat) * km_per_deg_lat;
+        Real vx = east.velocity, vy = north.velocity;
+        Real v2 = vx * vx + vy * vy;
+        Real t = v2 > 0 ? -(rx * vx + ry * vy) / v2 : 0;
+
+        StormApproach approach;
+        approach.approaching = t > 0;
+        if (!approach.approaching) {
+            t = 0;
+        }
+        rx += vx * t;
+        ry += vy * t;
+        approach.distance = std::sqrt(rx * rx + ry * ry);
+        approach.eta = t;
+        return approach;
+    }
+
+private:
+    // Position and velocity along one axis with their 2x2 covariance
+    struct Axis
+    {
+        Real position, velocity;
+        Real p00, p01, p11;
+
+        void reset(Real x, Real position_var, Real velocity_var)
+        {
+            position = x;
+            velocity = 0;
+            p00 = position_var;
+            p01 = 0;
+            p11 = velocity_var;
+        }
+
+        void predict(Real dt, Real accel_var)
+        {
+            position += velocity * dt;
+            // P = F P F' + Q for F = [1 dt; 0 1], Q the white-acceleration noise
+            Real dt2 = dt * dt;
+            p00 += dt * (2 * p01 + dt * p11) + accel_var * dt2 * dt2 / 4;
+            p01 += dt * p11 + accel_var * dt2 * dt / 2;
+            p11 += accel_var * dt2;
+        }
+
+        void correct(Real z, Real fix_var)
+        {
+            Real s = p00 + fix_var;
+            Real k0 = p00 / s, k1 = p01 / s;
+            Real innovation = z - position;
+            position += k0 * innovation;
+            velocity += k1 * innovation;
+            p11 -= k1 * p01;
+            p01 -= k0 * p01;
+            p00 -= k0 * p00;
+        }
+    };
+
+    Real fix_var, accel_var, speed_var;
+    PointLatLon origin;
+    Real km_per_deg_lat, km_per_deg_lon;
+    Axis east, north;
+    long fixes;
+    long long last_time;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "strike_correlator.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+StrikeCorrelator::StrikeCorrelator(int number_of_stations, long long skew,
+                                   long long allowed_lateness, int min_stations,
+                                   int eager_stations, size_t max_open)
+    : number_of_stations(number_of_stations), skew(skew), allowed_lateness(allowed_lateness),
+      min_stations(min_stations),
+      eager_stations(eager_stations > 0 ? eager_stations : number_of_stations),
+      max_open(max_open > 0 ? max_open : 1), newest(LLONG_MIN), current_watermark(LLONG_MIN),
+      emitted_count(0), late_count(0), dropped_count(0), evicted_count(0)
+{
+}
+
+void StrikeCorrelator::on_job(const std::function<void(const StrikeJob &)> &callback)
+{
+    this->callback = callback;
+}
+
+void StrikeCorrelator::add(const StrikeReport &report)
+{
+    if (report.station < 0 || report.station >= number_of_stations) {
+        return;
+    }
+    // Its group would already have been closed
+    if (current_watermark != LLONG_MIN && report.time + skew < current_watermark) {
+        late_count++;
+        return;
+    }
+
+    // Closest open group in time that still lacks this station
+    std::deque<Group>::iterator best = groups.end();
+    long long best_gap = skew + 1;
+    for (std::deque<Group>::iterator g = groups.begin(); g != groups.end(); ++g) {
+        long long gap = std::llabs(g->time - report.time);
+        if (gap < best_gap && std::isnan(g->ranges[report.station])) {
+            best = g;
+            best_gap = gap;
+        }
+    }
+
+    if (best == groups.end()) {
+        if (groups.size() >= max_open) {
+            evicted_count++;
+            close(groups.front());
+            groups.pop_front();
+        }
+        Group group;
+        if (!spares.empty()) {
+            group = std::move(spares.back());
+            spares.pop_back();
+        }
+        group.time = report.time;
+        group.reports = 0;
+        group.ranges.assign(number_of_stations, NAN);
+        group.times.resize(number_of_stations);
+
+        // Keep the deque ordered by time; reports are mostly in order
+        std::deque<Group>::iterator at = groups.end();
+        while (at != groups.begin() && (at - 1)->time > report.time) {
+            --at;
+        }
+        best = groups.insert(at, std::move(group));
+    }
+
+    best->ranges[report.station] = report.range;
+    best->times[report.station] = report.time;
+    best->reports++;
+    if (best->reports >= eager_stations) {
+        close(*best);
+        groups.erase(best);
+    }
+
+    if (report.time > newest) {
+        newest = report.time;
+        advance_watermark(newest - allowed_lateness);
+    }
+}
+
+void StrikeCorrelator::advance_watermark(long long time)
+{
+    if (time > current_watermark) {
+        current_watermark = time;
+        close_expired();
+    }
+}
+
+void StrikeCorrelator::flush()
+{
+    while (!groups.empty()) {
+        close(groups.front());
+        groups.pop_front();
+    }
+}
+
+void StrikeCorrelator::close_expired()
+{
+    while (!groups.empty() && groups.front().time + skew < current_watermark) {
+        close(groups.front());
+        groups.pop_front();
+    }
+}
+
+void StrikeCorrelator::close(Group &group)
+{
+    if (group.reports >= min_stations) {
+        job.time = group.time;
+        job.stations.clear();
+        job.ranges.clear();
+        job.times.clear();
+        for (int i = 0; i < number_of_stations; i++) {
+            if (!std::isnan(group.ranges[i])) {
+                job.stations.push_back(i);
+                job.ranges.push_back(group.ranges[i]);
+                job.times.push_back(group.times[i]);
+            }
+        }
+        emitted_count++;
+        if (callback) {
+            callback(job);
+        }
+    } else {
+        dropped_count++;
+    }
+    spares.push_back(std::move(group));
+}
@@ -0,0 +1,123 @@
+#ifndef STRIKE_CORRELATOR_H
+#define STRIKE_CORRELATOR_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+/**
+ * One station's report of a strike, as sent by a data collector
+ */
+struct StrikeReport
+{
+    int station;            // index of the detector in the station set
+    double range;           // reported distance (km)
+    long long time;         // event time (ms)
+};
+
+/**
+ * Reports from different stations grouped as one strike
+ */
+struct StrikeJob
+{
+    long long time;                 // event time of the first report (ms)
+    std::vector<int> stations;      // reporting stations, ascending
+    std::vector<double> ranges;     // range per entry of stations (km)
+    std::vector<long long> times;   // event time per entry of stations (ms)
+};
+
+/**
+ * Groups per-station reports into multilateration jobs
+ *
+ * A report joins the open group whose first report is within skew of it
+ * and that has nothing from the same station yet; otherwise it opens a
+ * new group. A group is emitted as soon as eager_stations have reported,
+ * or when the watermark passes its window and at least min_stations have
+ * reported; smaller groups are dropped.
+ *
+ * The watermark trails the newest event time seen by allowed_lateness, so
+ * out-of-order packets are still grouped as long as they arrive within
+ * that budget. Reports behind the watermark are counted and dropped. At
+ * most max_open groups are kept; beyond that the oldest is closed early,
+ * which bounds memory during storm-rate bursts.
+ */
+class StrikeCorrelator
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param number_of_stations size of the station set
+    * @param skew largest time difference between reports of one strike (ms)
+    * @param allowed_lateness how far behind the newest report a packet may arrive (ms)
+    * @param min_stations fewest reports worth solving
+    * @param eager_stations reports that close a group immediately, 0 for all stations
+    * @param max_open open groups kept before the oldest is forced closed
+    */
+    StrikeCorrelator(int number_of_stations, long long skew, long long allowed_lateness,
+                     int min_stations = 3, int eager_stations = 0, size_t max_open = 256);
+
+    /**
+    * Called with every emitted job
+    */
+    void on_job(const std::function<void(const StrikeJob &)> &callback);
+
+    /**
+    * Add one report; may emit jobs
+    */
+    void add(const StrikeReport &report);
+
+    /**
+    * Move the watermark forward without a report, e.g. from a wall clock
+    *
+    * @param time new watermark (ms), ignored if not ahead of the current one
+    */
+    void advance_watermark(long long time);
+
+    /**
+    * Close every open group
+    */
+    void flush();
+
+    long long watermark() const { return current_watermark; }
+    size_t open_groups() const { return groups.size(); }
+
+    long emitted() const { return emitted_count; }
+    long late() const { return late_count; }               // reports behind the watermark
+    long dropped() const { return dropped_count; }         // groups closed with too few reports
+    long evicted() const { return evicted_count; }         // groups closed early by max_open
+
+private:
+    struct Group
+    {
+        long long time;
+        int reports;
+        std::vector<double> ranges;     // NaN where a station has not reported
+        std::vector<long long> times;
+    };
+
+    void close(Group &group);
+    void close_expired();
+
+    int number_of_stations;
+    long long skew;
+    long long allowed_lateness;
+    int min_stations;
+    int eager_stations;
+    size_t max_open;
+
+    std::deque<Group> groups;           // ordered by time
+    std::vector<Group> spares;          // closed groups whose storage is reused
+    std::function<void(const StrikeJob &)> callback;
+    StrikeJob job;
+    long long newest;
+    long long current_watermark;
+
+    long emitted_count;
+    long late_count;
+    long dropped_count;
+    long evicted_count;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef STRIKE_LOCATOR_H
+#define STRIKE_LOCATOR_H
+
+#include <memory>
+#include <vector>
+
+#include "multilat.h"
+
+/**
+ * Common interface of the dynamic-size engine (Multilat) and the
+ * fixed-size ones (StaticMultilat<N>)
+ */
+class StrikeLocator
+{
+public:
+    virtual ~StrikeLocator() {}
+
+    /**
+    * @return number of stations in the set
+    */
+    virtual int number_of_stations() const = 0;
+
+    /**
+    * Locate a strike from the ranges reported by every station
+    *
+    * @param station_ranges one range (km) per station, in station order
+    * @param mode optimizer to use for this fix
+    * @return the fix and its residual
+    */
+    virtual StrikeFix locate(const std::vector<double> &station_ranges, SolverMode mode) const = 0;
+};
+
+/**
+ * Best engine for a station set: StaticMultilat<N> for 3 to 8 stations,
+ * Multilat otherwise
+ *
+ * @param station_locations locations of the detection stations
+ */
+std::unique_ptr<StrikeLocator> make_strike_locator(const std::vector<PointLatLon> &station_locations);
+
+#endif
@@ -0,0 +1,125 @@
+// Objective heatmap for plotting, the C++ side of multi_algo.py's __main__.
+//
+//   g++ -O2 -mavx2 -std=c++14 -pthread -o surface surface.cc objective_surface.cpp
+//       multilat.cpp region.cpp geodesy.cpp distance_kernel.cpp thread_pool.cpp
+//   ./surface [--layout campus|grid] [--strike lat,lon] [--south-west lat,lon]
+//             [--north-east lat,lon] [--step deg] [--exact] [--threads n]
+//             [--out objective.f32]
+//
+// Each station reports the haversine range to the strike, snapped to the
+// AS3935 bins unless --exact is given, and the L1 objective is evaluated
+// over the box. The defaults are multi_algo.py's stations, strike and
+// grid. Load the result with
+//
+//     np.memmap('objective.f32', dtype='<f4', mode='r', offset=64, shape=(rows, cols))
+//
+// using the rows and cols printed here (or stored in the header).
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "multilat.h"
+#include "objective_surface.h"
+#include "thread_pool.h"
+
+namespace {
+
+void usage()
+{
+    fprintf(stderr, "usage: surface [--layout campus|grid] [--strike lat,lon] [--south-west lat,lon]\n"
+                    "               [--north-east lat,lon] [--step deg] [--exact] [--threads n] [--out file]\n");
+    exit(1);
+}
+
+PointLatLon parse_point(const char *text)
+{
+    PointLatLon p;
+    if (sscanf(text, "%lf,%lf", &p.lat, &p.lon) != 2) {
+        usage();
+    }
+    return p;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const char *layout = "campus";
+    PointLatLon strike = {33.641154, -84.435819};   // Bobby Jones Golf Course
+    PointLatLon south_west = {33.5, -84.6};
+    PointLatLon north_east = {34.0, -84.2};
+    double step = 0.005;
+    bool quantize = true;
+    int threads = 0;
+    const char *out = "objective.f32";
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+            layout = argv[++i];
+        } else if (!strcmp(argv[i], "--strike") && i + 1 < argc) {
+            strike = parse_point(argv[++i]);
+        } else if (!strcmp(argv[i], "--south-west") && i + 1 < argc) {
+            south_west = parse_point(argv[++i]);
+        } else if (!strcmp(argv[i], "--north-east") && i + 1 < argc) {
+            north_east = parse_point(argv[++i]);
+        } else if (!strcmp(argv[i], "--step") && i + 1 < argc) {
+            step = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--exact")) {
+            quantize = false;
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            usage();
+        }
+    }
+    if (step <= 0 || threads < 0 || north_east.lat <= south_west.lat || north_east.lon <= south_west.lon) {
+        usage();
+    }
+
+    std::vector<PointLatLon> stations;
+    if (!strcmp(layout, "campus")) {
+        stations = {{33.778662, -84.408694}, {33.769620, -84.390898}, {33.781994, -84.402854}};
+    } else if (!strcmp(layout, "grid")) {
+        for (int a = 0; a < 4; a++) {
+            for (int o = 0; o < 7; o++) {
+                stations.push_back({33.6 + 0.1 * a, -84.7 + 0.1 * o});
+            }
+        }
+    } else {
+        usage();
+    }
+
+    std::vector<double> ranges;
+    for (const PointLatLon &s : stations) {
+        double range = d_haversine(s, strike);
+        ranges.push_back(quantize ? round_to_range_points(range) : range);
+    }
+    StationTable table;
+    table.assign(stations);
+
+    // Same cells as np.arange(south_west, north_east, step); the slack
+    // keeps a box that is a whole number of steps from gaining a cell
+    RasterGrid grid = {south_west, step, step,
+                       (int)std::ceil((north_east.lat - south_west.lat) / step - 1E-9),
+                       (int)std::ceil((north_east.lon - south_west.lon) / step - 1E-9)};
+    std::vector<float> values((size_t)grid.rows * grid.cols);
+
+    ThreadPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    rasterize_objective(table, DISTANCE_HAVERSINE, ranges.data(), grid, values.data(), &pool);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!write_raster(out, grid, values.data())) {
+        fprintf(stderr, "could not write %s\n", out);
+        return 1;
+    }
+    printf("%s: %d rows x %d cols, %zu stations, %.1f ms on %d threads\n",
+           out, grid.rows, grid.cols, stations.size(), 1E3 * seconds, pool.size());
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads)
+    : generation(0), stopping(false), pending(0), error(nullptr)
+{
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < threads; i++) {
+        queues.emplace_back(new Queue);
+    }
+    // Queue 0 belongs to the thread that calls parallel_for
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(int begin, int end, int grain,
+                              const std::function<void(int, int)> &body)
+{
+    if (end <= begin) {
+        return;
+    }
+    grain = std::max(grain, 1);
+
+    std::lock_guard<std::mutex> run_guard(run_lock);
+    int chunks = (end - begin + grain - 1) / grain;
+
+    // A worker still in run_tasks from the last loop can take a task the
+    // moment it is queued, so the count has to be in place before that
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        pending = chunks;
+        error = nullptr;
+    }
+    int chunk = 0;
+    for (int i = begin; i < end; i += grain, chunk++) {
+        Queue &queue = *queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back({i, std::min(end, i + grain), &body});
+    }
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        generation++;
+    }
+    wake.notify_all();
+
+    run_tasks(0);
+
+    std::exception_ptr failure;
+    {
+        std::unique_lock<std::mutex> guard(state_lock);
+        done.wait(guard, [this]() { return pending == 0; });
+        failure = error;
+        error = nullptr;
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void ThreadPool::worker_loop(int index)
+{
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(state_lock);
+            wake.wait(guard, [&]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        run_tasks(index);
+    }
+}
+
+void ThreadPool::run_tasks(int index)
+{
+    Task task;
+    while (pop_local(index, &task) || steal(index, &task)) {
+        try {
+            (*task.body)(task.begin, task.end);
+        } catch (...) {
+            // Keep the first failure for the caller, the remaining chunks
+            // still run so that pending reaches zero
+            std::lock_guard<std::mutex> guard(state_lock);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        if (--pending == 0) {
+            std::lock_guard<std::mutex> guard(state_lock);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::pop_local(int index, Task *task)
+{
+    Queue &queue = *queues[index];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    *task = queue.tasks.back();
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(int index, Task *task)
+{
+    int n = (int)queues.size();
+    for (int k = 1; k < n; k++) {
+        Queue &victim = *queues[(index + k) % n];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
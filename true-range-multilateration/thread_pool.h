@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing thread pool for data-parallel loops
+ *
+ * parallel_for cuts a range into grain-sized chunks and deals them out to
+ * one deque per thread. Each thread works from the back of its own deque
+ * and, once that is empty, steals from the front of the others, so uneven
+ * chunks (solves that need more iterations) even out on their own. The
+ * calling thread takes part in the loop.
+ */
+class ThreadPool
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param threads total threads including the caller, 0 for one per core
+    */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+    * @return number of threads that run loop bodies, including the caller
+    */
+    int size() const { return (int)queues.size(); }
+
+    /**
+    * Run body(chunk_begin, chunk_end) over [begin, end) and wait for it
+    *
+    * @param begin, end index range
+    * @param grain indices per chunk
+    * @param body called concurrently on disjoint chunks; the first exception
+    * it throws is rethrown here once every chunk has finished
+    */
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+private:
+    struct Task
+    {
+        int begin;
+        int end;
+        const std::function<void(int, int)> *body;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    void worker_loop(int index);
+    void run_tasks(int index);
+    bool pop_local(int index, Task *task);
+    bool steal(int index, Task *task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex run_lock;                // one parallel_for at a time
+    std::mutex state_lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned long generation;
+    bool stopping;
+    std::atomic<int> pending;
+    std::exception_ptr error;           // first exception thrown by a body
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "warm_locator.h"
+
+#include <utility>
+
+WarmLocator::WarmLocator(const StationRegistry *registry, SolverMode mode, size_t max_cells)
+    : match_residual(3.0), cold_residual(3.0), registry(registry), mode(mode),
+      max_cells(max_cells > 0 ? max_cells : 1), next_id(0),
+      warm_count(0), cold_count(0), fallback_count(0)
+{
+}
+
+StrikeFix WarmLocator::locate(const StrikeJob &job, int *cell_id)
+{
+    registry->select(job, &ids, &ranges);
+    subset.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        subset[i] = registry->location(ids[i]);
+    }
+    const double n = ids.empty() ? 1 : (double)ids.size();
+
+    // The cell whose last fix best explains these reports
+    std::deque<Cell>::iterator best = cells.end();
+    double best_residual = match_residual;
+    Multilat probe;
+    for (std::deque<Cell>::iterator c = cells.begin(); c != cells.end(); ++c) {
+        const Multilat *m = &c->multilat;
+        if (c->ids != ids) {
+            if (probe.number_of_stations() == 0) {
+                probe.set_stations(subset);
+            }
+            m = &probe;
+        }
+        double residual = m->objective(c->state.location, ranges.data()) / n;
+        if (residual <= best_residual) {
+            best = c;
+            best_residual = residual;
+        }
+    }
+
+    if (best != cells.end()) {
+        // Solve without touching the cell, which keeps its state if the
+        // fix turns out not to belong to it
+        const Multilat *m = &best->multilat;
+        if (best->ids != ids) {
+            if (probe.number_of_stations() == 0) {
+                probe.set_stations(subset);
+            }
+            m = &probe;
+        }
+        // With no station to spare, Levenberg-Marquardt stops at the edge
+        // of the region the bins allow nearest the cell's last fix rather
+        // than near its middle, and is less accurate than from the cold
+        // seed (bench_warm_locator); it keeps the cell but starts cold
+        bool from_cell = mode != SOLVER_LEVENBERG_MARQUARDT || ids.size() > 3;
+        WarmStart start = best->state;
+        WarmStart seed = m->cold_start(ranges);
+        if (!from_cell) {
+            start = seed;
+        } else if (m->objective(seed.location, ranges.data()) < best_residual * n) {
+            start.location = seed.location;
+        }
+        WarmStart next;
+        StrikeFix fix = m->locate_strike(ranges, mode, start, &next);
+        Cell warm = std::move(*best);
+        cells.erase(best);
+        if (fix.residual / n <= cold_residual) {
+            if (from_cell) {
+                warm_count++;
+            } else {
+                cold_count++;
+            }
+            if (warm.ids != ids) {
+                warm.ids = ids;
+                warm.multilat = std::move(probe);
+            }
+            warm.state = next;
+            if (cell_id) {
+                *cell_id = warm.id;
+            }
+            cells.push_front(std::move(warm));
+            return fix;
+        }
+        // Reports no longer fit this cell; keep it as it was for later jobs
+        fallback_count++;
+        cells.push_front(std::move(warm));
+    }
+
+    cold_count++;
+    Cell &cell = cell_for(ids, subset);
+    StrikeFix fix = cell.multilat.locate_strike(ranges, mode, cell.multilat.cold_start(ranges),
+                                                &cell.state);
+    if (cell_id) {
+        *cell_id = cell.id;
+    }
+    return fix;
+}
+
+WarmLocator::Cell &WarmLocator::cell_for(const std::vector<int> &ids,
+                                         const std::vector<PointLatLon> &subset)
+{
+    if (cells.size() >= max_cells) {
+        cells.pop_back();
+    }
+    Cell cell;
+    cell.id = next_id++;
+    cell.ids = ids;
+    cell.multilat.set_stations(subset);
+    cell.state.location = cell.multilat.x0;
+    cell.state.step = cell.multilat.seed_step;
+    cell.state.lambda = 1E-3;
+    cells.push_front(cell);
+    return cells.front();
+}
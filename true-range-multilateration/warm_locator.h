@@ -0,0 +1,81 @@
+#ifndef WARM_LOCATOR_H
+#define WARM_LOCATOR_H
+
+#include <deque>
+#include <vector>
+
+#include "multilat.h"
+#include "station_registry.h"
+#include "strike_correlator.h"
+
+/**
+ * Incremental localization that keeps solver state per storm cell
+ *
+ * Each cell remembers its last fix, the scale the solver ended at and the
+ * station subset (with its precomputed trig). A new job is scored against
+ * every cell's last fix; if one explains the reports well enough, the
+ * solve starts at that cell's scale, from its last fix or from the cold
+ * seed if the seed fits the reports better (with many stations it usually
+ * lands closer than the previous strike). If the warm fix still leaves a
+ * large residual the job is from somewhere else: it is re-solved cold and
+ * starts a new cell.
+ *
+ * Levenberg-Marquardt jobs with only three stations are matched to cells
+ * but solved from the cold seed, which is the more accurate start there.
+ */
+class WarmLocator
+{
+public:
+    /**
+    * Constructor
+    *
+    * @param registry stations the jobs refer to; must outlive the locator
+    * @param mode solver for every fix
+    * @param max_cells cells remembered, least recently used dropped first
+    */
+    explicit WarmLocator(const StationRegistry *registry,
+                         SolverMode mode = SOLVER_LEVENBERG_MARQUARDT, size_t max_cells = 32);
+
+    /**
+    * Localize one job
+    *
+    * @param job reports of one strike
+    * @param cell if not null, receives the id of the cell the fix went to
+    * @return the fix
+    */
+    StrikeFix locate(const StrikeJob &job, int *cell = nullptr);
+
+    double match_residual;  // km per station at a cell's last fix to warm-start from it
+    double cold_residual;   // km per station after a warm solve that triggers a cold one
+
+    long warm_solves() const { return warm_count; }
+    long cold_solves() const { return cold_count; }
+    long fallbacks() const { return fallback_count; }   // warm solves redone cold
+
+private:
+    struct Cell
+    {
+        int id;
+        std::vector<int> ids;
+        Multilat multilat;
+        WarmStart state;
+    };
+
+    Cell &cell_for(const std::vector<int> &ids, const std::vector<PointLatLon> &subset);
+
+    const StationRegistry *registry;
+    SolverMode mode;
+    size_t max_cells;
+    std::deque<Cell> cells;     // most recently used first
+    int next_id;
+
+    std::vector<int> ids;
+    std::vector<double> ranges;
+    std::vector<PointLatLon> subset;
+
+    long warm_count;
+    long cold_count;
+    long fallback_count;
+};
+
+#endif